@@ -0,0 +1,160 @@
+#ifdef BENCHMARK
+#include <QApplication>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "diffengine.h"
+#include "framesource.h"
+#include "qsnapper.h"
+#ifdef HAVE_LIBJPEG
+#include "stripjpegencoder.h"
+#endif
+
+/*!
+ * \brief Times QSnapper's comparing, encoding and saving on made up pictures.
+ * \details Build with CONFIG+=benchmark and run as
+ * QCompanionBenchmark [iterations]. Each line gives the median and 95th
+ * percentile time of one step, and the megapixels per second at the median.
+ */
+class SnapperBenchmark
+{
+  ///\brief The snapper whose steps are timed.
+  QSnapper snapper;
+  ///\brief Where difference images and saved pictures go.
+  QTemporaryDir dir;
+  ///\brief How many times each step is timed.
+  int iterations;
+  void report(const char *step, const QSize &size, double changeRatio,
+              std::vector<qint64> &nsecs);
+
+public:
+  explicit SnapperBenchmark(int iterations);
+  void runDiff(const QSize &size, double changeRatio);
+  void runEncode(const QSize &size);
+};
+
+/*!
+ * \brief Sets up a snapper to time.
+ * \param iterations How many times each step is timed.
+ */
+SnapperBenchmark::SnapperBenchmark(int iterations)
+    : snapper(nullptr), iterations(iterations)
+{
+}
+
+/*!
+ * \brief Prints one line of results.
+ * \param step What was timed.
+ * \param size The size of the pictures.
+ * \param changeRatio How much changed between pictures.
+ * \param nsecs How long each run took, in nanoseconds. Sorted in place.
+ */
+void SnapperBenchmark::report(const char *step, const QSize &size,
+                              double changeRatio, std::vector<qint64> &nsecs)
+{
+  std::sort(nsecs.begin(), nsecs.end());
+  const double median = nsecs[nsecs.size() / 2] / 1e6;
+  const double p95 = nsecs[(nsecs.size() * 95) / 100] / 1e6;
+  const double megapixels = size.width() * size.height() / 1e6;
+  std::printf("%-22s %5dx%-5d %6.2f%%  median %9.2f ms  p95 %9.2f ms  "
+              "%9.1f Mpx/s\n",
+              step, size.width(), size.height(), changeRatio * 100, median,
+              p95, megapixels / (median / 1e3));
+}
+
+/*!
+ * \brief Times both imagesDiffer overloads, the lenient one both exactly and
+ * sampled.
+ * \param size The size of the pictures.
+ * \param changeRatio How much changes between pictures.
+ */
+void SnapperBenchmark::runDiff(const QSize &size, double changeRatio)
+{
+  SyntheticFrameSource source(size, changeRatio);
+  const QString diffFile = dir.path() + "/diff.jpg";
+  std::vector<qint64> lenient, sampled, withImage;
+  QImage previous = source.nextFrame();
+  QElapsedTimer timer;
+  for(int i = 0; i < iterations; ++i)
+  {
+    const QImage next = source.nextFrame();
+    timer.start();
+    snapper.imagesDiffer(previous, next, 0);
+    lenient.push_back(timer.nsecsElapsed());
+    timer.start();
+    snapper.imagesDiffer(previous, next, 0.001);
+    sampled.push_back(timer.nsecsElapsed());
+    timer.start();
+    snapper.imagesDiffer(previous, next, diffFile);
+    withImage.push_back(timer.nsecsElapsed());
+    previous = next;
+  }
+  report("imagesDiffer", size, changeRatio, lenient);
+  report("imagesDiffer(sampled)", size, changeRatio, sampled);
+  report("imagesDiffer(diff)", size, changeRatio, withImage);
+}
+
+/*!
+ * \brief Times encoding a picture in memory, through Qt and a strip per core,
+ * and saving one to disk.
+ * \param size The size of the pictures.
+ */
+void SnapperBenchmark::runEncode(const QSize &size)
+{
+  SyntheticFrameSource source(size, 0.01);
+  const QString saveFile = dir.path() + "/frame.jpg";
+  std::vector<qint64> encode, strips, save;
+  QElapsedTimer timer;
+  for(int i = 0; i < iterations; ++i)
+  {
+    const QImage frame = source.nextFrame();
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    timer.start();
+    frame.save(&buffer, "JPG", 75);
+    encode.push_back(timer.nsecsElapsed());
+#ifdef HAVE_LIBJPEG
+    std::vector<unsigned char> jpeg;
+    const FrameView view = {frame.constScanLine(0), frame.width(),
+                            frame.height(), frame.bytesPerLine()};
+    timer.start();
+    StripJpegEncoder::encode(view, 75, jpeg);
+    strips.push_back(timer.nsecsElapsed());
+#endif
+    timer.start();
+    frame.save(saveFile);
+    save.push_back(timer.nsecsElapsed());
+  }
+  report("encode jpg", size, 0.01, encode);
+  if(!strips.empty())
+    report("encode jpg strips", size, 0.01, strips);
+  report("save jpg", size, 0.01, save);
+}
+
+int main(int argc, char *argv[])
+{
+  QApplication a(argc, argv);
+  // Keeps the benchmark's snapper away from the real settings.
+  QCoreApplication::setOrganizationDomain("coderfrog.com");
+  QCoreApplication::setOrganizationName("Coderfrog");
+  QCoreApplication::setApplicationName("QCompanionBenchmark");
+  const int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 10;
+  std::printf("Diff kernel: %s, %d iterations\n", DiffEngine::kernelName(),
+              iterations);
+  SnapperBenchmark benchmark(iterations);
+  const QList<QSize> sizes = {QSize(1920, 1080), QSize(2560, 1440),
+                              QSize(3840, 2160), QSize(7680, 4320)};
+  for(const QSize &size : sizes)
+  {
+    for(double changeRatio : {0.0, 0.005, 0.05})
+      benchmark.runDiff(size, changeRatio);
+    benchmark.runEncode(size);
+  }
+  return 0;
+}
+#endif
@@ -10,6 +10,18 @@ unix {
     LIBS += -ltbb -lflite_cmu_us_kal -lflite_usenglish -lflite_cmulex -lflite
     SOURCES += dbusadaptor.cpp
     HEADERS += dbusadaptor.h
+    !macx:greaterThan(QT_MAJOR_VERSION, 4) {
+        DEFINES += HAVE_XSHM HAVE_XSS
+        LIBS += -lX11 -lXext -lXss
+        SOURCES += xshmcapture.cpp xssidlesource.cpp
+        HEADERS += xshmcapture.h xssidlesource.h
+    }
+    !macx {
+        DEFINES += HAVE_LIBJPEG
+        LIBS += -ljpeg
+        SOURCES += stripjpegencoder.cpp
+        HEADERS += stripjpegencoder.h
+    }
 }
 
 win32 {
@@ -24,11 +36,18 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 TARGET = QCompanion
 TEMPLATE = app
 
+# qmake CONFIG+=benchmark builds the QSnapper benchmarks instead of the app.
+benchmark {
+    DEFINES += BENCHMARK
+    TARGET = QCompanionBenchmark
+}
+
 QMAKE_CXXFLAGS_RELEASE += -g
 
 SOURCES += main.cpp\
         qcompanion.cpp \
     UnitTests.cpp \
+    Benchmarks.cpp \
     component.cpp \
     speaker.cpp \
     hourreader.cpp \
@@ -39,7 +58,27 @@ SOURCES += main.cpp\
     qlipperwidget.cpp \
     qlippercomponent.cpp \
     waitercrondialog.cpp \
-    waitercronoccurance.cpp
+    waitercronoccurance.cpp \
+    diffengine.cpp \
+    tilehasher.cpp \
+    snappipeline.cpp \
+    snaparchive.cpp \
+    capturebackend.cpp \
+    framesource.cpp \
+    snapcadence.cpp \
+    idlesource.cpp \
+    screensaversource.cpp \
+    contentstore.cpp \
+    snapcompactor.cpp \
+    timelineindex.cpp \
+    thumbnailloader.cpp \
+    snaptimelinemodel.cpp \
+    snaptimelinedialog.cpp \
+    similarityindex.cpp \
+    similarityrebuilder.cpp \
+    framepool.cpp \
+    phrasestore.cpp \
+    savefolderlock.cpp
 
 HEADERS  += qcompanion.h \
     component.h \
@@ -52,7 +91,27 @@ HEADERS  += qcompanion.h \
     qlipperwidget.h \
     qlippercomponent.h \
     waitercrondialog.h \
-    waitercronoccurance.h
+    waitercronoccurance.h \
+    diffengine.h \
+    tilehasher.h \
+    snappipeline.h \
+    snaparchive.h \
+    capturebackend.h \
+    framesource.h \
+    snapcadence.h \
+    idlesource.h \
+    screensaversource.h \
+    contentstore.h \
+    snapcompactor.h \
+    timelineindex.h \
+    thumbnailloader.h \
+    snaptimelinemodel.h \
+    snaptimelinedialog.h \
+    similarityindex.h \
+    similarityrebuilder.h \
+    framepool.h \
+    phrasestore.h \
+    savefolderlock.h
 
 FORMS    += qcompanion.ui \
     waiterdialog.ui \
@@ -1,11 +1,42 @@
 #ifdef TEST
 #include <QApplication>
 #include <QAction>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QPixmap>
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "speaker.h"
 #include "hourreader.h"
 #include "qsnapper.h"
+#include "diffengine.h"
+#include "tilehasher.h"
+#include "snappipeline.h"
+#include "snaparchive.h"
+#include "framesource.h"
+#include "snapcadence.h"
+#include "idlesource.h"
+#include "contentstore.h"
+#include "snapcompactor.h"
+#include "timelineindex.h"
+#include "snaptimelinemodel.h"
+#include "thumbnailloader.h"
+#include "similarityindex.h"
+#include "similarityrebuilder.h"
+#include "framepool.h"
+#include "phrasestore.h"
+#include "savefolderlock.h"
+#ifdef HAVE_LIBJPEG
+#include "stripjpegencoder.h"
+#endif
+#include <QTemporaryDir>
+#ifdef HAVE_XSHM
+#include "xshmcapture.h"
+#include <QScreen>
+#endif
 #include "waitercrondialog.h"
 #include "waiterwidget.h"
 // QDateTime::fromTime_t(1234567890) is Fri Feb 13 15:31:30 2009 PST
@@ -59,10 +90,20 @@ TEST(QSnapperTests, QSnapperStartsMuted)
   ASSERT_TRUE(Snapper.isMuted());
 }
 
-TEST(QSnapperTests, QSnapperHasFiveMenuItems)
+TEST(QSnapperTests, QSnapperHasSevenMenuItems)
+{
+  QSnapper Snapper(nullptr);
+  ASSERT_EQ(7, Snapper.getMenuContents().size());
+}
+
+TEST(QSnapperTests, BurstRejectsBadRates)
 {
   QSnapper Snapper(nullptr);
-  ASSERT_EQ(5, Snapper.getMenuContents().size());
+  ASSERT_EQ(QString("Idle"), Snapper.burstStatus());
+  ASSERT_FALSE(Snapper.startBurst(0, 10));
+  ASSERT_FALSE(Snapper.startBurst(4, 0));
+  ASSERT_FALSE(Snapper.startBurst(120, 10));
+  ASSERT_EQ(QString("Idle"), Snapper.burstStatus());
 }
 
 TEST(QSnapperTests, QSnapperHasMuteActionChecked)
@@ -102,6 +143,860 @@ TEST(QSnapperTests, QSnapperHasChangeSaveLocationMenuAction)
   ASSERT_EQ("Change Save Location", Snapper.getMenuContents().at(0)->text());
 }
 
+TEST(DiffEngineTests, CountsDifferingPixelsInUnevenRows)
+{
+  QImage a(37, 5, QImage::Format_RGB32);
+  a.fill(Qt::black);
+  QImage b = a.copy();
+  b.setPixel(0, 0, qRgb(255, 0, 0));
+  b.setPixel(36, 4, qRgb(0, 255, 0));
+  b.setPixel(33, 2, qRgb(0, 0, 255));
+  FrameView va = {a.constScanLine(0), a.width(), a.height(), a.bytesPerLine()};
+  FrameView vb = {b.constScanLine(0), b.width(), b.height(), b.bytesPerLine()};
+  ASSERT_EQ(3, DiffEngine::countDifferences(va, vb));
+  ASSERT_EQ(1, DiffEngine::countRow(va.row(2), vb.row(2), a.width()));
+}
+
+TEST(DiffEngineTests, ExceedsLimitOnlyPastTheLimit)
+{
+  QImage a(64, 64, QImage::Format_RGB32);
+  a.fill(Qt::white);
+  QImage b = a.copy();
+  for(int i = 0; i < 41; ++i)
+    b.setPixel(i, i, qRgb(0, 0, 0));
+  FrameView va = {a.constScanLine(0), a.width(), a.height(), a.bytesPerLine()};
+  FrameView vb = {b.constScanLine(0), b.width(), b.height(), b.bytesPerLine()};
+  ASSERT_FALSE(DiffEngine::exceedsLimit(va, vb, 41));
+  ASSERT_TRUE(DiffEngine::exceedsLimit(va, vb, 40));
+}
+
+TEST(DiffEngineTests, SampledLimitSettlesClearCasesEarly)
+{
+  QImage a(1280, 720, QImage::Format_RGB32);
+  a.fill(Qt::white);
+  QImage b = a.copy();
+  FrameView va = {a.constScanLine(0), a.width(), a.height(), a.bytesPerLine()};
+  const long long limit = 1280 * 720 / 100;
+  long long examined = 0;
+  ASSERT_FALSE(DiffEngine::sampledExceedsLimit(va, va, limit, 0.001,
+                                               &examined));
+  ASSERT_LT(examined, limit);
+  b.fill(Qt::black);
+  FrameView vb = {b.constScanLine(0), b.width(), b.height(), b.bytesPerLine()};
+  ASSERT_TRUE(DiffEngine::sampledExceedsLimit(va, vb, limit, 0.001,
+                                              &examined));
+  ASSERT_LT(examined, limit);
+  ASSERT_TRUE(DiffEngine::sampledExceedsLimit(va, vb, limit, 0, &examined));
+  ASSERT_EQ(1280 * 720, examined);
+}
+
+TEST(DiffEngineTests, TouchingChangesShareARegion)
+{
+  QImage a(100, 50, QImage::Format_RGB32);
+  a.fill(Qt::white);
+  QImage b = a.copy();
+  b.setPixel(1, 1, qRgb(0, 0, 0));
+  b.setPixel(17, 17, qRgb(0, 0, 0));
+  b.setPixel(99, 49, qRgb(0, 0, 0));
+  FrameView va = {a.constScanLine(0), a.width(), a.height(), a.bytesPerLine()};
+  FrameView vb = {b.constScanLine(0), b.width(), b.height(), b.bytesPerLine()};
+  std::vector<DiffRegion> regions = DiffEngine::changedRegions(va, vb, 16);
+  ASSERT_EQ(2u, regions.size());
+  ASSERT_EQ(QRect(0, 0, 32, 32), QRect(regions[0].x, regions[0].y,
+                                       regions[0].width, regions[0].height));
+  ASSERT_EQ(QRect(96, 48, 4, 2), QRect(regions[1].x, regions[1].y,
+                                       regions[1].width, regions[1].height));
+  ASSERT_TRUE(DiffEngine::changedRegions(va, va).empty());
+}
+
+TEST(TileHasherTests, OnlyTheTouchedTileChanges)
+{
+  QImage a(200, 130, QImage::Format_RGB32);
+  a.fill(Qt::gray);
+  QImage b = a.copy();
+  b.setPixel(199, 129, qRgb(1, 2, 3));
+  FrameView va = {a.constScanLine(0), a.width(), a.height(), a.bytesPerLine()};
+  FrameView vb = {b.constScanLine(0), b.width(), b.height(), b.bytesPerLine()};
+  std::vector<std::uint64_t> ha = TileHasher::hashTiles(va);
+  std::vector<std::uint64_t> hb = TileHasher::hashTiles(vb);
+  ASSERT_EQ(4u * 3u, hb.size());
+  ASSERT_EQ(1, TileHasher::countChanged(ha, hb));
+  ASSERT_NE(ha.back(), hb.back());
+  ASSERT_EQ(0, TileHasher::countChanged(ha, TileHasher::hashTiles(va)));
+}
+
+TEST(SnapPipelineTests, CountsSkippedAndSavedJobs)
+{
+  SnapPipeline pipeline(nullptr, [](SnapJob &job) { return job.lenient; },
+                        [](SnapJob &) { return true; },
+                        [](SnapJob &) { return true; }, 4);
+  SnapJob kept;
+  kept.lenient = true;
+  ASSERT_TRUE(pipeline.submit(kept));
+  ASSERT_TRUE(pipeline.submit(SnapJob()));
+  ASSERT_TRUE(pipeline.submit(kept));
+  for(int wait = 0; wait < 500 && pipeline.savedFrames() < 2; ++wait)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(2, pipeline.savedFrames());
+  ASSERT_EQ(1, pipeline.skippedFrames());
+  ASSERT_EQ(0, pipeline.droppedFrames());
+}
+
+TEST(SnapPipelineTests, CountsFailuresApartFromSkips)
+{
+  SnapPipeline pipeline(nullptr, [](SnapJob &job) { return job.lenient; },
+                        [](SnapJob &job) { return job.quality > 0; },
+                        [](SnapJob &job) { return job.screen == 0; }, 4);
+  SnapJob kept;
+  kept.lenient = true;
+  SnapJob unencodable = kept;
+  unencodable.quality = 0;
+  SnapJob unwritable = kept;
+  unwritable.screen = 1;
+  ASSERT_TRUE(pipeline.submit(SnapJob()));
+  ASSERT_TRUE(pipeline.submit(unencodable));
+  ASSERT_TRUE(pipeline.submit(unwritable));
+  ASSERT_TRUE(pipeline.submit(kept));
+  pipeline.finish();
+  ASSERT_FALSE(pipeline.submit(kept));
+  const SnapCounts counts = pipeline.counts();
+  ASSERT_EQ(1, counts.dropped);
+  ASSERT_EQ(1, counts.skipped);
+  ASSERT_EQ(2, counts.failed);
+  ASSERT_EQ(1, counts.saved);
+}
+
+TEST(SnapPipelineTests, DroppedJobsSkipLaterStages)
+{
+  std::atomic<int> diffed(0), encoded(0), written(0);
+  {
+    SnapPipeline pipeline(nullptr,
+                          [&](SnapJob &job)
+                          {
+      ++diffed;
+      return job.lenient;
+    },
+                          [&](SnapJob &)
+                          {
+      ++encoded;
+      return true;
+    },
+                          [&](SnapJob &)
+                          {
+      ++written;
+      return true;
+    },
+                          4);
+    SnapJob kept;
+    kept.lenient = true;
+    ASSERT_TRUE(pipeline.submit(kept));
+    ASSERT_TRUE(pipeline.submit(SnapJob()));
+  }
+  ASSERT_EQ(2, diffed);
+  ASSERT_EQ(1, encoded);
+  ASSERT_EQ(1, written);
+}
+
+TEST(SnapArchiveTests, DeltaRebuildsTheChangedTile)
+{
+  QTemporaryDir dir;
+  const QString path =
+      SnapArchiveWriter::archiveName(dir.path(), QDate(2009, 2, 13));
+  const QDateTime first = QDateTime::fromTime_t(1234567890);
+  const QDateTime second = first.addSecs(60);
+  QImage before(200, 130, QImage::Format_RGB32);
+  before.fill(Qt::white);
+  QImage after = before.copy();
+  for(int y = 64; y < 128; ++y)
+    for(int x = 64; x < 128; ++x)
+      after.setPixel(x, y, qRgb(0, 0, 0));
+
+  SnapArchiveWriter writer;
+  const QByteArray keyframe =
+      writer.encode(path, before, first, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10});
+  const QByteArray delta = writer.encode(path, after, second, {5});
+  QFile file(path);
+  ASSERT_TRUE(file.open(QIODevice::Append));
+  ASSERT_EQ(SnapArchiveWriter::headerSize,
+            SnapArchiveWriter::append(file, keyframe));
+  ASSERT_LT(0, SnapArchiveWriter::append(file, delta));
+  file.close();
+
+  SnapArchiveReader reader(path);
+  ASSERT_TRUE(reader.isValid());
+  ASSERT_EQ(2, reader.timestamps().size());
+  ASSERT_GT(qGray(reader.frameAt(first).pixel(96, 96)), 225);
+  const QImage rebuilt = reader.frameAt(second);
+  ASSERT_EQ(QSize(200, 130), rebuilt.size());
+  ASSERT_LT(qGray(rebuilt.pixel(96, 96)), 30);
+  ASSERT_GT(qGray(rebuilt.pixel(10, 10)), 225);
+  ASSERT_TRUE(reader.frameAt(first.addSecs(-1)).isNull());
+}
+
+TEST(SnapArchiveTests, FailedWriteRestartsWithAKeyframe)
+{
+  QTemporaryDir dir;
+  const QString path =
+      SnapArchiveWriter::archiveName(dir.path(), QDate(2009, 2, 13));
+  const QDateTime first = QDateTime::fromTime_t(1234567890);
+  QImage white(200, 130, QImage::Format_RGB32);
+  white.fill(Qt::white);
+  QImage black = white.copy();
+  black.fill(Qt::black);
+  SnapArchiveWriter writer;
+
+  // The file was created, but nothing made it in, so the header is still
+  // needed.
+  QFile file(path);
+  ASSERT_TRUE(file.open(QIODevice::Append));
+  file.close();
+  QFile readOnly(path);
+  ASSERT_TRUE(readOnly.open(QIODevice::ReadOnly));
+  const QByteArray lost = writer.encode(path, white, first, {});
+  ASSERT_TRUE(SnapArchiveWriter::isKeyframe(lost));
+  ASSERT_EQ(-1, SnapArchiveWriter::append(readOnly, lost));
+  readOnly.close();
+  ASSERT_EQ(0, QFileInfo(path).size());
+
+  writer.restart();
+  const QByteArray keyframe =
+      writer.encode(path, black, first.addSecs(60), {5});
+  ASSERT_TRUE(SnapArchiveWriter::isKeyframe(keyframe));
+  ASSERT_TRUE(file.open(QIODevice::Append));
+  ASSERT_EQ(SnapArchiveWriter::headerSize,
+            SnapArchiveWriter::append(file, keyframe));
+  file.close();
+
+  SnapArchiveReader reader(path);
+  ASSERT_TRUE(reader.isValid());
+  ASSERT_EQ(1, reader.timestamps().size());
+  ASSERT_LT(qGray(reader.frameAt(first.addSecs(60)).pixel(96, 96)), 30);
+}
+
+TEST(CaptureBackendTests, ServerPixelsMatchQtPixelsOnceOpaque)
+{
+  // The X server leaves the pad byte at 0, like an XShm segment does.
+  const int width = 40, height = 30, bytesPerLine = 48 * 4;
+  std::vector<quint32> segment(bytesPerLine / 4 * height, 0x00336699u);
+  QImage fallback(width, height, QImage::Format_RGB32);
+  fallback.fill(QColor(0x33, 0x66, 0x99));
+  QImage server(reinterpret_cast<uchar *>(segment.data()), width, height,
+                bytesPerLine, QImage::Format_RGB32);
+  const FrameView fallbackView = {fallback.constScanLine(0), width, height,
+                                  fallback.bytesPerLine()};
+  const FrameView serverView = {server.constScanLine(0), width, height,
+                                bytesPerLine};
+  ASSERT_EQ(width * height,
+            DiffEngine::countDifferences(fallbackView, serverView));
+
+  CaptureBackend::setOpaque(reinterpret_cast<uchar *>(segment.data()), width,
+                            height, bytesPerLine);
+  ASSERT_EQ(0, DiffEngine::countDifferences(fallbackView, serverView));
+  ASSERT_EQ(ContentStore::frameKey(fallback), ContentStore::frameKey(server));
+  ASSERT_EQ(TileHasher::hashTiles(fallbackView),
+            TileHasher::hashTiles(serverView));
+}
+
+#ifdef HAVE_XSHM
+// Run under Xvfb to exercise this without a real display.
+TEST(XShmCaptureTests, PicturesEveryScreenInPlace)
+{
+  XShmCaptureBackend backend;
+  if(!backend.isAvailable())
+    return;
+  const QList<QImage> first = backend.grabScreens();
+  ASSERT_EQ(QGuiApplication::screens().size(), first.size());
+  ASSERT_EQ(QGuiApplication::primaryScreen()->size(), first.at(0).size());
+  ASSERT_EQ(QImage::Format_RGB32, first.at(0).format());
+  const QList<QImage> second = backend.grabScreens();
+  ASSERT_NE(first.at(0).constBits(), second.at(0).constBits());
+}
+#endif
+
+TEST(FrameSourceTests, SyntheticBlockChangesExactlyTheRatio)
+{
+  SyntheticFrameSource source(QSize(320, 200), 0.05,
+                              SyntheticFrameSource::Block);
+  const QImage first = source.nextFrame();
+  const QImage second = source.grabScreens().at(0);
+  FrameView va = {first.constScanLine(0), first.width(), first.height(),
+                  first.bytesPerLine()};
+  FrameView vb = {second.constScanLine(0), second.width(), second.height(),
+                  second.bytesPerLine()};
+  ASSERT_EQ(320 * 200 / 20, DiffEngine::countDifferences(va, vb));
+}
+
+TEST(FrameSourceTests, ReplayLoopsOverReadableFiles)
+{
+  QTemporaryDir dir;
+  QImage red(8, 8, QImage::Format_RGB32);
+  red.fill(Qt::red);
+  QImage blue = red.copy();
+  blue.fill(Qt::blue);
+  red.save(dir.path() + "/1.png");
+  blue.save(dir.path() + "/2.png");
+  ReplayFrameSource source({dir.path() + "/1.png", dir.path() + "/missing.png",
+                            dir.path() + "/2.png"});
+  ASSERT_EQ(2, source.frameCount());
+  ASSERT_EQ(qRgb(255, 0, 0), source.grabScreens().at(0).pixel(0, 0));
+  ASSERT_EQ(qRgb(0, 0, 255), source.grabScreens().at(0).pixel(0, 0));
+  ASSERT_EQ(qRgb(255, 0, 0), source.grabScreens().at(0).pixel(0, 0));
+}
+
+TEST(ContentStoreTests, RepeatedFramesShareAnObject)
+{
+  QTemporaryDir dir;
+  ContentStore store(dir.path());
+  QImage first(40, 30, QImage::Format_RGB32);
+  first.fill(Qt::red);
+  QImage second = first.copy();
+  second.setPixel(5, 5, qRgb(0, 0, 255));
+  const QByteArray firstKey = ContentStore::frameKey(first);
+  const QByteArray secondKey = ContentStore::frameKey(second);
+  ASSERT_EQ(ContentStore::keySize, firstKey.size());
+  ASSERT_NE(firstKey, secondKey);
+  ASSERT_EQ(firstKey, ContentStore::frameKey(
+                          first.convertToFormat(QImage::Format_ARGB32)));
+  const QDateTime start = QDateTime::fromTime_t(1234567890);
+  ASSERT_FALSE(store.contains(firstKey));
+  ASSERT_TRUE(store.addObject(firstKey, "first"));
+  ASSERT_TRUE(store.addObject(secondKey, "second"));
+  ASSERT_TRUE(store.record(start, 0, firstKey));
+  ASSERT_TRUE(store.record(start.addSecs(60), 0, secondKey));
+  ASSERT_TRUE(store.record(start.addSecs(120), 0, firstKey));
+  ASSERT_TRUE(store.contains(firstKey));
+  ASSERT_EQ(3, store.entries().size());
+  ASSERT_EQ(3 * ContentStore::recordSize,
+            QFileInfo(store.indexPath()).size());
+  ASSERT_EQ(store.objectPath(secondKey), store.frameAt(start.addSecs(90), 0));
+  ASSERT_EQ(store.objectPath(firstKey), store.frameAt(start.addSecs(150), 0));
+  ASSERT_TRUE(store.frameAt(start.addSecs(-1), 0).isEmpty());
+}
+
+TEST(SnapCompactorTests, CompactsByAgeThenQuota)
+{
+  QTemporaryDir dir;
+  QImage frame(100, 80, QImage::Format_RGB32);
+  frame.fill(Qt::darkGreen);
+  const QStringList names = {"20090213153000.jpg", "20090210090000.jpg",
+                             "20090201100500.jpg", "20090201103000.jpg"};
+  for(const QString &name : names)
+    ASSERT_TRUE(frame.save(dir.path() + '/' + name));
+  SnapCompactor compactor;
+  SnapCompactor::Policy policy;
+  ASSERT_TRUE(compactor.compact(dir.path(), policy, QDate(2009, 2, 13)));
+  compactor.wait();
+  ASSERT_EQ(QSize(100, 80), QImage(dir.path() + '/' + names[0]).size());
+  ASSERT_EQ(QSize(50, 40), QImage(dir.path() + '/' + names[1]).size());
+  ASSERT_EQ(QSize(50, 40), QImage(dir.path() + '/' + names[2]).size());
+  ASSERT_FALSE(QFile::exists(dir.path() + '/' + names[3]));
+  ASSERT_EQ(2, compactor.reducedFiles());
+  ASSERT_EQ(1, compactor.removedFiles());
+
+  policy.quotaBytes = 1;
+  ASSERT_TRUE(compactor.compact(dir.path(), policy, QDate(2009, 2, 13)));
+  compactor.wait();
+  ASSERT_EQ(0, compactor.reducedFiles());
+  ASSERT_EQ(2, compactor.removedFiles());
+  ASSERT_TRUE(QFile::exists(dir.path() + '/' + names[0]));
+  ASSERT_TRUE(compactor.status().startsWith("Finished"));
+}
+
+TEST(SnapCompactorTests, QuotaCountsTheStoreAndThumbnails)
+{
+  QTemporaryDir dir;
+  const QDir folder(dir.path());
+  ASSERT_TRUE(folder.mkpath(".thumbs/objects"));
+  QImage frame(100, 80, QImage::Format_RGB32);
+  frame.fill(Qt::darkGreen);
+  ASSERT_TRUE(frame.save(folder.filePath("20090213153000.jpg")));
+  ASSERT_TRUE(frame.save(folder.filePath("20090201100500.jpg")));
+  ASSERT_TRUE(frame.save(folder.filePath(".thumbs/20090201100500.jpg")));
+  ASSERT_TRUE(frame.save(folder.filePath(".thumbs/20080101000000.jpg")));
+
+  const ContentStore store(dir.path());
+  QImage other = frame;
+  other.fill(Qt::red);
+  const QByteArray oldKey = ContentStore::frameKey(frame);
+  const QByteArray keptKey = ContentStore::frameKey(other);
+  ASSERT_TRUE(store.addObject(oldKey, "old"));
+  ASSERT_TRUE(store.addObject(keptKey, "kept"));
+  const QString oldThumbnail =
+      folder.filePath(".thumbs/" + folder.relativeFilePath(
+                                       store.objectPath(oldKey)));
+  ASSERT_TRUE(folder.mkpath(QFileInfo(oldThumbnail).path()));
+  ASSERT_TRUE(frame.save(oldThumbnail, "JPG"));
+  const QDateTime old(QDate(2009, 2, 1), QTime(9, 0));
+  ASSERT_TRUE(store.record(old, 0, oldKey));
+  ASSERT_TRUE(store.record(old.addSecs(7200), 0, keptKey));
+  ASSERT_TRUE(store.record(QDateTime(QDate(2009, 2, 13), QTime(9, 0)), 0,
+                           keptKey));
+  QFile manifest(folder.filePath(".compacted"));
+  ASSERT_TRUE(manifest.open(QIODevice::WriteOnly));
+  manifest.write("gone.jpg\n");
+  manifest.close();
+
+  SnapCompactor compactor;
+  SnapCompactor::Policy policy;
+  policy.quotaBytes = 1;
+  ASSERT_TRUE(compactor.compact(dir.path(), policy, QDate(2009, 2, 13)));
+  compactor.wait();
+  ASSERT_TRUE(folder.exists("20090213153000.jpg"));
+  ASSERT_FALSE(folder.exists("20090201100500.jpg"));
+  ASSERT_FALSE(folder.exists(".thumbs/20090201100500.jpg"));
+  ASSERT_FALSE(folder.exists(".thumbs/20080101000000.jpg"));
+  ASSERT_FALSE(QFile::exists(store.objectPath(oldKey)));
+  ASSERT_FALSE(QFile::exists(oldThumbnail));
+  ASSERT_TRUE(QFile::exists(store.objectPath(keptKey)));
+  const QList<ContentStoreEntry> records = store.entries();
+  ASSERT_EQ(1, records.size());
+  ASSERT_EQ(keptKey, records.first().key);
+  ASSERT_TRUE(manifest.open(QIODevice::ReadOnly));
+  ASSERT_TRUE(manifest.readAll().isEmpty());
+}
+
+TEST(SnapCompactorTests, DropsDeletedPicturesFromTheIndexes)
+{
+  QTemporaryDir dir;
+  QImage frame(100, 80, QImage::Format_RGB32);
+  frame.fill(Qt::darkGreen);
+  const TimelineIndex timeline(dir.path());
+  const SimilarityIndex similar(dir.path());
+  const QStringList names = {"20090201100500.jpg", "20090210090000.jpg",
+                             "20090213153000.jpg"};
+  for(const QString &name : names)
+  {
+    ASSERT_TRUE(frame.save(dir.path() + '/' + name));
+    TimelineEntry entry;
+    entry.taken = QDateTime::fromString(name.left(14), "yyyyMMddhhmmss");
+    entry.fileName = name;
+    ASSERT_TRUE(timeline.append(entry));
+    ASSERT_TRUE(similar.append(entry.taken, 0, SimilarityIndex::dHash(frame)));
+  }
+
+  SnapCompactor compactor;
+  SnapCompactor::Policy policy;
+  policy.quotaBytes = 1;
+  ASSERT_TRUE(compactor.compact(dir.path(), policy, QDate(2009, 2, 13)));
+  compactor.wait();
+  ASSERT_EQ(2, compactor.removedFiles());
+  ASSERT_EQ(1, timeline.count());
+  ASSERT_EQ(names[2], timeline.at(0).fileName);
+  ASSERT_EQ(1, similar.count());
+  SimilarityIndex search(dir.path());
+  const QList<SimilarFrame> found =
+      search.find(SimilarityIndex::dHash(frame), 0);
+  ASSERT_EQ(1, found.size());
+  ASSERT_EQ(timeline.at(0).taken, found.first().taken);
+  ASSERT_FALSE(compactor.status().contains("rebuilding"));
+}
+
+#ifdef HAVE_LIBJPEG
+TEST(StripJpegEncoderTests, StripsMatchAWholeFrameEncode)
+{
+  QImage frame(333, 517, QImage::Format_RGB32);
+  for(int y = 0; y < frame.height(); ++y)
+    for(int x = 0; x < frame.width(); ++x)
+      frame.setPixel(x, y, qRgb(x * 7, y * 3, x ^ y));
+  FrameView view = {frame.constScanLine(0), frame.width(), frame.height(),
+                    frame.bytesPerLine()};
+  std::vector<unsigned char> strips, whole;
+  ASSERT_TRUE(StripJpegEncoder::encode(view, 80, strips, 64));
+  ASSERT_TRUE(StripJpegEncoder::encode(view, 80, whole, 1024));
+  ASSERT_TRUE(strips == whole);
+  const QImage decoded = QImage::fromData(strips.data(), int(strips.size()));
+  ASSERT_EQ(frame.size(), decoded.size());
+}
+#endif
+
+TEST(TimelineIndexTests, FindsRangesAndRebuilds)
+{
+  QTemporaryDir dir;
+  TimelineIndex index(dir.path());
+  const QDateTime start = QDateTime::fromTime_t(1234567890);
+  for(int minute = 0; minute < 100; ++minute)
+  {
+    TimelineEntry entry;
+    entry.taken = start.addSecs(minute * 60);
+    entry.screen = minute % 2;
+    entry.fileName = entry.taken.toString("yyyyMMddhhmmss") + "-" +
+                     QString::number(entry.screen) + ".jpg";
+    ASSERT_TRUE(index.append(entry));
+  }
+  ASSERT_EQ(100, index.count());
+  ASSERT_EQ(10, index.lowerBound(start.addSecs(541)));
+  const QList<TimelineEntry> hour =
+      index.range(start.addSecs(600), start.addSecs(1200));
+  ASSERT_EQ(11, hour.size());
+  ASSERT_EQ(start.addSecs(600), hour.first().taken);
+  ASSERT_EQ(0, hour.first().screen);
+  ASSERT_EQ(1, index.at(11).screen);
+  ASSERT_EQ(start.addSecs(60).toString("yyyyMMddhhmmss") + "-1.jpg",
+            index.at(1).fileName);
+
+  QImage frame(8, 8, QImage::Format_RGB32);
+  frame.fill(Qt::blue);
+  frame.save(dir.path() + "/20090213153000-1_2.jpg");
+  frame.save(dir.path() + "/20090213152900.jpg");
+  ASSERT_TRUE(index.rebuild());
+  ASSERT_EQ(2, index.count());
+  ASSERT_EQ(QString("20090213152900.jpg"), index.at(0).fileName);
+  ASSERT_EQ(1, index.at(1).screen);
+}
+
+TEST(TimelineIndexTests, ForgettingKeepsRecordsAppendedMeanwhile)
+{
+  QTemporaryDir dir;
+  const TimelineIndex index(dir.path());
+  const QDateTime start = QDateTime::fromTime_t(1234567890);
+  TimelineEntry entry;
+  entry.screen = 0;
+  for(int second = 0; second < 100; ++second)
+  {
+    entry.taken = start.addSecs(second);
+    entry.fileName = "old-" + QString::number(second) + ".jpg";
+    ASSERT_TRUE(index.append(entry));
+  }
+  std::atomic<bool> appending(true);
+  std::thread writer(
+      [&]()
+      {
+        TimelineEntry added;
+        added.screen = 0;
+        for(int second = 100; second < 300; ++second)
+        {
+          added.taken = start.addSecs(second);
+          added.fileName = "new-" + QString::number(second) + ".jpg";
+          QMutexLocker locker(SaveFolderLock::of(dir.path()));
+          index.append(added);
+        }
+        appending = false;
+      });
+  int passes = 0;
+  while(appending || passes == 0)
+  {
+    // The same folder named another way shares the lock.
+    QMutexLocker locker(SaveFolderLock::of(dir.path() + "/"));
+    EXPECT_TRUE(index.forget(
+        [](const TimelineEntry &picture)
+        {
+          return picture.fileName.startsWith("old-") &&
+                 picture.taken.toTime_t() % 2 == 0;
+        }));
+    ++passes;
+  }
+  writer.join();
+  ASSERT_EQ(250, index.count());
+  const QList<TimelineEntry> added =
+      index.range(start.addSecs(100), start.addSecs(299));
+  ASSERT_EQ(200, added.size());
+  for(int second = 100; second < 300; ++second)
+    ASSERT_EQ("new-" + QString::number(second) + ".jpg",
+              added[second - 100].fileName);
+}
+
+TEST(SnapTimelineTests, DecodesThumbnailsNewestFirst)
+{
+  QTemporaryDir dir;
+  TimelineIndex index(dir.path());
+  QImage frame(640, 480, QImage::Format_RGB32);
+  frame.fill(Qt::green);
+  for(int second = 0; second < 3; ++second)
+  {
+    TimelineEntry entry;
+    entry.taken = QDateTime::fromTime_t(1234567890 + second);
+    entry.screen = 0;
+    entry.fileName = QString::number(second) + ".jpg";
+    ASSERT_TRUE(frame.save(dir.path() + "/" + entry.fileName));
+    ASSERT_TRUE(index.append(entry));
+  }
+  SnapTimelineModel model(dir.path(), QSize(160, 120));
+  ASSERT_EQ(3, model.rowCount());
+  const QModelIndex newest = model.index(0);
+  ASSERT_EQ(QString("2.jpg"),
+            newest.data(SnapTimelineModel::FileNameRole).toString());
+  ASSERT_FALSE(newest.data(Qt::DecorationRole).isValid());
+  model.thumbnails()->waitForDone();
+  QCoreApplication::processEvents();
+  ASSERT_EQ(QSize(160, 120),
+            newest.data(Qt::DecorationRole).value<QPixmap>().size());
+  ASSERT_TRUE(QFileInfo(dir.path() + "/.thumbs/2.jpg").exists());
+  ASSERT_FALSE(QFileInfo(dir.path() + "/.thumbs/0.jpg").exists());
+}
+
+TEST(SnapTimelineTests, ArchiveThumbnailsOutliveArchiveWrites)
+{
+  QTemporaryDir dir;
+  const QString path =
+      SnapArchiveWriter::archiveName(dir.path(), QDate(2009, 2, 13));
+  const QDateTime taken = QDateTime::fromTime_t(1234567890);
+  QImage frame(640, 480, QImage::Format_RGB32);
+  frame.fill(Qt::green);
+  SnapArchiveWriter writer;
+  QFile archive(path);
+  ASSERT_TRUE(archive.open(QIODevice::Append));
+  ASSERT_LE(0, SnapArchiveWriter::append(
+                   archive, writer.encode(path, frame, taken, {})));
+  archive.close();
+
+  // Made before the archive was last added to, as it would be by now.
+  const QString fileName = QFileInfo(path).fileName();
+  const QString sidecar = dir.path() + "/.thumbs/" + fileName.left(8) + '-' +
+                          QString::number(taken.toMSecsSinceEpoch()) + ".jpg";
+  ASSERT_TRUE(QDir().mkpath(dir.path() + "/.thumbs"));
+  QImage kept(16, 12, QImage::Format_RGB32);
+  kept.fill(Qt::red);
+  ASSERT_TRUE(kept.save(sidecar));
+  QFile sidecarFile(sidecar);
+  ASSERT_TRUE(sidecarFile.open(QIODevice::Append));
+  ASSERT_TRUE(sidecarFile.setFileTime(taken,
+                                      QFileDevice::FileModificationTime));
+  sidecarFile.close();
+
+  ThumbnailLoader loader(dir.path(), QSize(160, 120));
+  ASSERT_TRUE(loader.thumbnail(fileName, taken).isNull());
+  loader.waitForDone();
+  QCoreApplication::processEvents();
+  ASSERT_EQ(QSize(16, 12), loader.thumbnail(fileName, taken).size());
+}
+
+TEST(SimilarityIndexTests, BkTreeMatchesABruteForceSearch)
+{
+  BkTree tree;
+  std::vector<quint64> hashes;
+  quint64 seed = 88172645463325252ULL;
+  for(int i = 0; i < 2000; ++i)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    const quint64 hash =
+        i % 4 == 0 || hashes.empty() ? seed : hashes.back() ^ (seed & 0x111);
+    hashes.push_back(hash);
+    tree.insert(hash, i);
+  }
+  for(int radius : {0, 3, 12})
+  {
+    size_t expected = 0;
+    for(quint64 hash : hashes)
+      expected += SimilarityIndex::distance(hash, hashes[7]) <= radius;
+    ASSERT_EQ(expected, tree.find(hashes[7], radius).size());
+  }
+}
+
+TEST(SimilarityIndexTests, FindsAPictureAtAnotherSize)
+{
+  QTemporaryDir dir;
+  SimilarityIndex index(dir.path());
+  QImage dialog(400, 300, QImage::Format_RGB32);
+  QImage desktop(400, 300, QImage::Format_RGB32);
+  for(int y = 0; y < 300; ++y)
+    for(int x = 0; x < 400; ++x)
+    {
+      dialog.setPixel(x, y, qRgb(x * 255 / 400, 255 - y * 255 / 300, 128));
+      desktop.setPixel(x, y, qRgb(255 - x * 255 / 400, y * 255 / 300, 0));
+    }
+  const QDateTime start = QDateTime::fromTime_t(1234567890);
+  ASSERT_TRUE(index.append(start, 0, SimilarityIndex::dHash(desktop)));
+  ASSERT_TRUE(index.append(start.addSecs(60), 1,
+                           SimilarityIndex::dHash(dialog)));
+  const quint64 reference =
+      SimilarityIndex::dHash(dialog.scaled(200, 150).convertToFormat(
+          QImage::Format_RGB16));
+  const QList<SimilarFrame> found = index.find(reference, 8);
+  ASSERT_EQ(1, found.size());
+  ASSERT_EQ(start.addSecs(60), found.first().taken);
+  ASSERT_EQ(1, found.first().screen);
+  ASSERT_TRUE(index.append(start.addSecs(120), 0,
+                           SimilarityIndex::dHash(dialog)));
+  ASSERT_EQ(2, index.find(reference, 8).size());
+  ASSERT_EQ(start.addSecs(120), index.find(reference, 8).first().taken);
+}
+
+TEST(SimilarityIndexTests, RebuildsInterleavedArchivesInTheBackground)
+{
+  QTemporaryDir dir;
+  const QDateTime first = QDateTime::fromTime_t(1234567890);
+  QImage white(200, 130, QImage::Format_RGB32);
+  white.fill(Qt::white);
+  QList<QPair<QDateTime, int>> taken;
+  for(int screen = 0; screen < 2; ++screen)
+  {
+    const QString path =
+        SnapArchiveWriter::archiveName(dir.path(), QDate(2009, 2, 13),
+                                       screen ? "-1" : "");
+    SnapArchiveWriter writer;
+    QImage frame = white.copy();
+    QFile file(path);
+    ASSERT_TRUE(file.open(QIODevice::Append));
+    ASSERT_LE(0, SnapArchiveWriter::append(
+                     file, writer.encode(path, frame, first.addSecs(screen),
+                                         {0, 1, 2, 3, 4, 5, 6, 7, 8, 9})));
+    taken.append(qMakePair(first.addSecs(screen), screen));
+    // Each delta darkens one more tile, so every picture hashes apart.
+    for(int tile = 0; tile < 3; ++tile)
+    {
+      const int column = tile, row = screen;
+      for(int y = row * 64; y < row * 64 + 64; ++y)
+        for(int x = column * 64; x < column * 64 + 64; ++x)
+          frame.setPixel(x, y, qRgb(0, 0, 0));
+      const QDateTime when = first.addSecs(60 * (tile + 1) + screen);
+      ASSERT_LT(0, SnapArchiveWriter::append(
+                       file, writer.encode(path, frame, when,
+                                           {row * 4 + column})));
+      taken.append(qMakePair(when, screen));
+    }
+  }
+  ASSERT_TRUE(TimelineIndex(dir.path()).rebuild());
+
+  SimilarityRebuilder rebuilder;
+  ASSERT_EQ(QString("Idle"), rebuilder.status());
+  ASSERT_TRUE(rebuilder.rebuild(dir.path()));
+  rebuilder.wait();
+  ASSERT_EQ(QString("Finished: 8 of 8 pictures hashed"), rebuilder.status());
+  SimilarityIndex index(dir.path());
+  ASSERT_EQ(8, index.count());
+  for(const QPair<QDateTime, int> &picture : taken)
+  {
+    SnapArchiveReader reader(SnapArchiveWriter::archiveName(
+        dir.path(), QDate(2009, 2, 13), picture.second ? "-1" : ""));
+    const QList<SimilarFrame> found =
+        index.find(SimilarityIndex::dHash(reader.frameAt(picture.first)), 0);
+    bool matched = false;
+    for(const SimilarFrame &frame : found)
+      matched |= frame.taken == picture.first &&
+                 frame.screen == picture.second;
+    ASSERT_TRUE(matched);
+  }
+}
+
+TEST(FramePoolTests, ReusesBuffersAndTracksTheHighWaterMark)
+{
+  FramePool pool(2);
+  {
+    QImage first = pool.acquire(64, 48);
+    QImage second = pool.acquire(64, 48);
+    const uchar *firstBits = first.constBits();
+    ASSERT_EQ(2, pool.inUse());
+    ASSERT_EQ(0, pool.fallbacks());
+    first = QImage();
+    QImage third = pool.acquire(64, 48);
+    ASSERT_EQ(firstBits, third.constBits());
+    QImage overflow = pool.acquire(64, 48);
+    ASSERT_FALSE(overflow.isNull());
+    ASSERT_EQ(1, pool.fallbacks());
+  }
+  ASSERT_EQ(0, pool.inUse());
+  ASSERT_EQ(2, pool.highWaterMark());
+  ASSERT_EQ(2, pool.allocations());
+  QImage resized = pool.acquire(32, 24);
+  ASSERT_EQ(3, pool.allocations());
+  ASSERT_TRUE(pool.acquire(8, 8, QImage::Format_RGB16).isNull());
+}
+
+TEST(FramePoolTests, PicturesMayOutliveThePool)
+{
+  QImage kept;
+  {
+    FramePool pool(1);
+    kept = pool.acquire(16, 16);
+    kept.fill(Qt::red);
+  }
+  ASSERT_EQ(qRgb(255, 0, 0), kept.pixel(3, 3));
+}
+
+TEST(SnapCadenceTests, BacksOffUntilAChange)
+{
+  SnapCadence cadence(60000, 300000);
+  ASSERT_EQ(60000, cadence.interval());
+  ASSERT_EQ(120000, cadence.recordUnchanged());
+  ASSERT_EQ(240000, cadence.recordUnchanged());
+  ASSERT_EQ(300000, cadence.recordUnchanged());
+  ASSERT_EQ(300000, cadence.recordUnchanged());
+  ASSERT_EQ(4, cadence.unchangedStreak());
+  ASSERT_EQ(60000, cadence.recordChanged());
+  ASSERT_EQ(0, cadence.unchangedStreak());
+}
+
+/*!
+ * \brief An idle source the test sets by hand.
+ */
+class FakeIdleSource : public IdleSource
+{
+public:
+  qint64 idle = 0;
+  virtual qint64 idleMsecs() override { return idle; }
+  virtual QString name() const override { return "Fake"; }
+};
+
+TEST(QSnapperTests, StopsWhileIdleAndResumesOnInput)
+{
+  QSnapper Snapper(nullptr);
+  FakeIdleSource *idle = new FakeIdleSource();
+  Snapper.setIdleSource(idle);
+  idle->idle = 24 * 3600 * 1000LL;
+  QMetaObject::invokeMethod(&Snapper, "emitSpeak");
+  ASSERT_TRUE(Snapper.isSuspendedForIdle());
+  QMetaObject::invokeMethod(&Snapper, "checkForInput");
+  ASSERT_TRUE(Snapper.isSuspendedForIdle());
+  idle->idle = 0;
+  QMetaObject::invokeMethod(&Snapper, "checkForInput");
+  ASSERT_FALSE(Snapper.isSuspendedForIdle());
+}
+
+/*!
+ * \brief A screensaver source the test sets by hand.
+ */
+class FakeScreensaverSource : public ScreensaverSource
+{
+public:
+  bool active = false;
+  int checks = 0;
+  virtual bool isActive() override
+  {
+    ++checks;
+    return active;
+  }
+  virtual QString name() const override { return "Fake"; }
+};
+
+TEST(QSnapperTests, SnapsOnlyWhileTheScreensaverIsOff)
+{
+  QTemporaryDir dir;
+  QSnapper Snapper(nullptr);
+  const bool wasEnabled = Snapper.isEnabled();
+  FakeScreensaverSource *screensaver = new FakeScreensaverSource();
+  Snapper.setScreensaverSource(screensaver);
+  Snapper.setCaptureBackend(new SyntheticFrameSource(QSize(64, 48), 0.5));
+  Snapper.setSaveDirectory(dir.path());
+  Snapper.enableSnapping(true);
+  screensaver->active = true;
+  ASSERT_FALSE(Snapper.snap());
+  ASSERT_EQ(1, screensaver->checks);
+  screensaver->active = false;
+  ASSERT_TRUE(Snapper.snap());
+  ASSERT_EQ(2, screensaver->checks);
+  Snapper.enableSnapping(wasEnabled);
+}
+
+TEST(QSnapperTests, SnappingDoesNotAskTheScreensaverAgain)
+{
+  QTemporaryDir dir;
+  QSnapper Snapper(nullptr);
+  const bool wasEnabled = Snapper.isEnabled();
+  FakeScreensaverSource *screensaver = new FakeScreensaverSource();
+  Snapper.setScreensaverSource(screensaver);
+  Snapper.setCaptureBackend(new SyntheticFrameSource(QSize(64, 48), 0.5));
+  Snapper.setSaveDirectory(dir.path());
+  Snapper.enableSnapping(true);
+  const int atStartup = Snapper.screensaverQueryCount();
+  for(int i = 0; i < 10; ++i)
+    Snapper.snap();
+  ASSERT_EQ(10, screensaver->checks);
+  ASSERT_EQ(atStartup, Snapper.screensaverQueryCount());
+  Snapper.enableSnapping(wasEnabled);
+}
+
 TEST(SpeakerTests, SpeakerStartsUnmuted)
 {
   Speaker s(nullptr, "");
@@ -134,6 +1029,243 @@ TEST(SpeakerTests, SpeakerCanSpeak)
   s.speak("");
 }
 
+TEST(SpeakerTests, SpeakerMeasuresTimeToFirstAudio)
+{
+  Speaker s(nullptr, "");
+  ASSERT_EQ(-1, s.timeToFirstAudio());
+  s.speak("One. Two. Three");
+  s.finishSpeaking();
+  ASSERT_LE(0, s.timeToFirstAudio());
+}
+
+TEST(SpeakerTests, SpeakerMeasuresStartupLatency)
+{
+  Speaker s(nullptr, "");
+  ASSERT_EQ(-1, s.startupLatency());
+  s.speak("Hello");
+  s.finishSpeaking();
+  ASSERT_LE(0, s.startupLatency());
+}
+
+TEST(SpeakerTests, SpeakerMeasuresLatencyPerLane)
+{
+  Speaker s(nullptr, "");
+  s.speakWithPriority("Time is up", Speaker::Urgent);
+  s.speak("Hello");
+  s.finishSpeaking();
+  ASSERT_LE(0, s.laneLatency(Speaker::Urgent));
+  ASSERT_LE(0, s.laneLatency(Speaker::Normal));
+  ASSERT_EQ(-1, s.laneLatency(Speaker::Low));
+  ASSERT_EQ(-1, s.laneLatency(Speaker::PriorityCount));
+}
+
+TEST(SpeakerTests, SpeakerClampsPriorities)
+{
+  Speaker s(nullptr, "");
+  s.speakWithPriority("Hello", 99);
+  s.finishSpeaking();
+  ASSERT_LE(0, s.laneLatency(Speaker::Urgent));
+}
+
+TEST(SpeakerTests, SpeakerStartsWithAnEmptyCache)
+{
+  Speaker s(nullptr, "");
+  ASSERT_EQ(0, s.cacheHits());
+  ASSERT_EQ(0, s.cacheMisses());
+}
+
+#ifndef Q_OS_WIN
+TEST(SpeakerTests, SentenceCacheHitsTheSecondIdenticalSentence)
+{
+  ASSERT_EQ(SentenceCache::key("kal", "It is 3 o'clock"),
+            SentenceCache::key("kal", "  it IS 3   o'clock "));
+  ASSERT_NE(SentenceCache::key("kal", "Snap"),
+            SentenceCache::key("awb", "Snap"));
+  cst_wave *made = new_wave();
+  cst_wave_resize(made, 16000, 1);
+  const std::shared_ptr<Wave> wave(made, delete_wave);
+  ASSERT_EQ(31, SentenceCache::costKiB(wave.get()));
+
+  SentenceCache cache(48);
+  const QString key = SentenceCache::key("kal", "It is 3 o'clock");
+  ASSERT_FALSE(cache.find(key));
+  cache.countMiss();
+  cache.insert(key, wave);
+  ASSERT_EQ(wave, cache.find(SentenceCache::key("kal", "it is 3 O'CLOCK")));
+  ASSERT_EQ(1, cache.hitCount());
+  ASSERT_EQ(1, cache.missCount());
+
+  // A second sentence as long doesn't fit in the budget beside the first.
+  cache.insert(SentenceCache::key("kal", "Snap"), wave);
+  ASSERT_FALSE(cache.find(key));
+  ASSERT_EQ(wave, cache.find(SentenceCache::key("kal", "snap")));
+  ASSERT_EQ(2, cache.hitCount());
+}
+#endif
+
+static Utterance queuedUtterance(const QString &text, int priority,
+                                 std::chrono::steady_clock::time_point queued)
+{
+  Utterance u;
+  u.text = text;
+  u.priority = priority;
+  u.queued = queued;
+  return u;
+}
+
+TEST(SpeakerLanesTests, UrgentGoesBeforeLow)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SpeakerLanes lanes(std::chrono::seconds(30));
+  lanes.push(queuedUtterance("low", Speaker::Low, start));
+  lanes.push(queuedUtterance("normal", Speaker::Normal, start));
+  lanes.push(queuedUtterance("urgent", Speaker::Urgent, start));
+  ASSERT_EQ("urgent", lanes.take(start).text);
+  ASSERT_EQ("normal", lanes.take(start).text);
+  ASSERT_EQ("low", lanes.take(start).text);
+  ASSERT_TRUE(lanes.isEmpty());
+  ASSERT_TRUE(lanes.take(start).stop);
+}
+
+TEST(SpeakerLanesTests, AgingPromotesLowToNormal)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SpeakerLanes lanes(std::chrono::seconds(30));
+  lanes.push(queuedUtterance("low", Speaker::Low, start));
+  lanes.push(queuedUtterance("normal", Speaker::Normal,
+                             start + std::chrono::seconds(20)));
+  // Not waited long enough yet.
+  ASSERT_EQ("normal", lanes.take(start + std::chrono::seconds(29)).text);
+
+  lanes.push(queuedUtterance("normal", Speaker::Normal,
+                             start + std::chrono::seconds(29)));
+  // Aged into Normal, and queued before the Normal one.
+  ASSERT_EQ("low", lanes.take(start + std::chrono::seconds(30)).text);
+  ASSERT_EQ("normal", lanes.take(start + std::chrono::seconds(30)).text);
+}
+
+TEST(SpeakerLanesTests, AgingNeverReachesUrgent)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SpeakerLanes lanes(std::chrono::seconds(30));
+  lanes.push(queuedUtterance("low", Speaker::Low, start));
+  lanes.push(queuedUtterance("urgent", Speaker::Urgent,
+                             start + std::chrono::hours(1)));
+  ASSERT_EQ("urgent", lanes.take(start + std::chrono::hours(1)).text);
+}
+
+TEST(SpeakerLanesTests, TiesGoToTheFirstQueued)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SpeakerLanes lanes(std::chrono::seconds(0));
+  lanes.push(queuedUtterance("one", Speaker::Normal, start));
+  lanes.push(queuedUtterance("two", Speaker::Normal, start));
+  lanes.push(queuedUtterance("three", Speaker::Normal, start));
+  ASSERT_EQ("one", lanes.take(start).text);
+  ASSERT_EQ("two", lanes.take(start).text);
+  ASSERT_EQ("three", lanes.take(start).text);
+}
+
+TEST(SpeakerLanesTests, PutBackKeepsTheQueuedOrder)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SpeakerLanes lanes(std::chrono::seconds(30));
+  lanes.push(queuedUtterance("a", Speaker::Normal, start));
+  lanes.push(queuedUtterance("b", Speaker::Normal, start));
+  lanes.push(queuedUtterance("c", Speaker::Normal, start));
+  const Utterance a = lanes.take(start);
+  const Utterance b = lanes.take(start);
+  lanes.putBack(b);
+  lanes.putBack(a);
+  ASSERT_EQ("a", lanes.take(start).text);
+  ASSERT_EQ("b", lanes.take(start).text);
+  ASSERT_EQ("c", lanes.take(start).text);
+}
+
+TEST(SpeakerLanesTests, SentencesWaitForOlderOnesPutBack)
+{
+  const auto start = std::chrono::steady_clock::now();
+  SpeakerLanes lanes(std::chrono::seconds(30));
+  lanes.push(queuedUtterance("x", Speaker::Normal, start));
+  lanes.push(queuedUtterance("a", Speaker::Normal, start));
+  const Utterance x = lanes.take(start);
+  const Utterance a = lanes.take(start);
+  // An Urgent sentence arrives while x plays and a is rendered, and b is
+  // rendered behind it.
+  lanes.push(queuedUtterance("u", Speaker::Urgent, start));
+  lanes.push(queuedUtterance("b", Speaker::Normal, start));
+  const Utterance u = lanes.take(start);
+  const Utterance b = lanes.take(start);
+  ASSERT_FALSE(lanes.isBehind(b));
+  lanes.putBack(x);
+  lanes.putBack(a);
+  lanes.started(u);
+  ASSERT_FALSE(lanes.isBehind(u));
+  ASSERT_FALSE(lanes.isBehind(x));
+  ASSERT_TRUE(lanes.isBehind(b));
+  lanes.putBack(b);
+
+  const Utterance first = lanes.take(start);
+  ASSERT_EQ("x", first.text);
+  lanes.started(first);
+  // a is still ahead of b, though it left the lane.
+  const Utterance second = lanes.take(start);
+  ASSERT_EQ("a", second.text);
+  const Utterance third = lanes.take(start);
+  ASSERT_EQ("b", third.text);
+  ASSERT_TRUE(lanes.isBehind(third));
+  lanes.started(second);
+  ASSERT_FALSE(lanes.isBehind(third));
+}
+
+TEST(PhraseStoreTests, KeepsPhrasesBetweenRuns)
+{
+  QTemporaryDir dir;
+  const QString path = dir.path() + "/phrases.qps";
+  std::vector<short> snap(4000, 1234);
+  {
+    PhraseStore store(path, "kal", "2.1", 1 << 20);
+    ASSERT_TRUE(store.isOpen());
+    ASSERT_TRUE(store.add("kal\nsnap", snap.data(), 4000, 8000, 1));
+  }
+  PhraseStore reopened(path, "kal", "2.1", 1 << 20);
+  ASSERT_EQ(1, reopened.count());
+  PhraseAudio audio;
+  ASSERT_TRUE(reopened.find("kal\nsnap", audio));
+  ASSERT_EQ(4000, audio.sampleCount);
+  ASSERT_EQ(8000, audio.sampleRate);
+  ASSERT_EQ(1234, audio.samples[3999]);
+  ASSERT_FALSE(reopened.find("kal\nthe time is now", audio));
+
+  PhraseStore otherVersion(path, "kal", "2.2", 1 << 20);
+  ASSERT_TRUE(otherVersion.isOpen());
+  ASSERT_EQ(0, otherVersion.count());
+  // The first audio stays playable after its file was replaced.
+  ASSERT_EQ(1234, audio.samples[0]);
+}
+
+TEST(PhraseStoreTests, DropsTheLeastRecentlyUsedPhrases)
+{
+  QTemporaryDir dir;
+  std::vector<short> samples(1000, 7);
+  const qint64 record = PhraseStore::recordHeaderSize + 8 + 2000;
+  PhraseStore store(dir.path() + "/phrases.qps", "kal", "2.1",
+                    PhraseStore::headerSize + 4 * record);
+  ASSERT_TRUE(store.add("phrase 1", samples.data(), 1000, 8000, 1));
+  ASSERT_TRUE(store.add("phrase 2", samples.data(), 1000, 8000, 1));
+  ASSERT_TRUE(store.add("phrase 3", samples.data(), 1000, 8000, 1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  PhraseAudio audio;
+  ASSERT_TRUE(store.find("phrase 1", audio));
+  ASSERT_TRUE(store.add("phrase 4", samples.data(), 1000, 8000, 1));
+  ASSERT_TRUE(store.add("phrase 5", samples.data(), 1000, 8000, 1));
+  ASSERT_LE(store.size(), PhraseStore::headerSize + 4 * record);
+  ASSERT_TRUE(store.contains("phrase 1"));
+  ASSERT_TRUE(store.contains("phrase 5"));
+  ASSERT_FALSE(store.contains("phrase 2"));
+  ASSERT_EQ(7, audio.samples[999]);
+}
+
 TEST(WaiterCronOccuranceTests, CanDefaultConstructOccurance)
 {
   WaiterCronOccurance repeat;
@@ -0,0 +1,109 @@
+#include "capturebackend.h"
+#include <QApplication>
+#include <QDesktopWidget>
+#include <QPainter>
+#include <QPixmap>
+#if QT_VERSION >= 0x050000
+#include <QScreen>
+#endif
+#ifdef HAVE_XSHM
+#include "xshmcapture.h"
+#endif
+
+CaptureBackend::~CaptureBackend() {}
+
+/*!
+ * \brief Picks the fastest backend that works on this system.
+ * \details Shared memory capture is used on X11 when the server offers it,
+ * otherwise pictures are taken through Qt.
+ * \param pool Where the Qt backend copies pictures into, if given. The shared
+ * memory backend has its own buffers.
+ * \return A new backend, owned by the caller.
+ */
+CaptureBackend *CaptureBackend::create(FramePool *pool)
+{
+#ifdef HAVE_XSHM
+  if(QGuiApplication::platformName() == "xcb")
+  {
+    XShmCaptureBackend *shm = new XShmCaptureBackend();
+    if(shm->isAvailable())
+      return shm;
+    delete shm;
+  }
+#endif
+  return new QtCaptureBackend(pool);
+}
+
+/*!
+ * \brief Sets the unused top byte of every 32 bit pixel to 0xff.
+ * \details QImage::Format_RGB32 pixels are 0xffRRGGBB, which is what Qt's own
+ * captures hold, but window systems usually leave that byte at 0. Pictures
+ * are compared and hashed word for word, so every backend has to agree on it.
+ * \param bits The first pixel of the first row.
+ * \param width The width in pixels.
+ * \param height The height in pixels.
+ * \param bytesPerLine The number of bytes between the start of two rows.
+ */
+void CaptureBackend::setOpaque(uchar *bits, int width, int height,
+                               int bytesPerLine)
+{
+  for(int y = 0; y < height; ++y)
+  {
+    quint32 *row = reinterpret_cast<quint32 *>(bits + y * bytesPerLine);
+    for(int x = 0; x < width; ++x)
+      row[x] |= 0xff000000u;
+  }
+}
+
+/*!
+ * \brief Creates the backend.
+ * \param pool Where pictures are copied into, or nullptr for new images. The
+ * pool must outlive the backend.
+ */
+QtCaptureBackend::QtCaptureBackend(FramePool *pool) : pool(pool) {}
+
+namespace
+{
+/*!
+ * \brief Copies a screen's pixmap into a pooled picture.
+ * \details Falls back to QPixmap::toImage() without a pool.
+ */
+QImage pooledImage(FramePool *pool, const QPixmap &pixmap)
+{
+  QImage picture;
+  if(pool && !pixmap.isNull())
+    picture = pool->acquire(pixmap.width(), pixmap.height());
+  if(picture.isNull())
+    return pixmap.toImage();
+  QPainter painter(&picture);
+  painter.setCompositionMode(QPainter::CompositionMode_Source);
+  painter.drawPixmap(picture.rect(), pixmap, pixmap.rect());
+  painter.end();
+  return picture;
+}
+}
+
+/*!
+ * \brief Takes a picture of each screen through QPixmap.
+ * \details Qt 4 can only picture the whole desktop at once, so there it is
+ * treated as a single screen.
+ * \return A picture per screen, in the order Qt lists the screens.
+ */
+QList<QImage> QtCaptureBackend::grabScreens()
+{
+  QList<QImage> pictures;
+#if QT_VERSION < 0x050000
+  pictures.append(pooledImage(
+      pool, QPixmap::grabWindow(QApplication::desktop()->winId())));
+#else
+  for(QScreen *screen : QGuiApplication::screens())
+    pictures.append(pooledImage(pool, screen->grabWindow(0)));
+#endif
+  return pictures;
+}
+
+/*!
+ * \brief Gets the backend's name.
+ * \return "Qt"
+ */
+QString QtCaptureBackend::name() const { return "Qt"; }
@@ -0,0 +1,45 @@
+#ifndef CAPTUREBACKEND_H
+#define CAPTUREBACKEND_H
+#include <QImage>
+#include <QList>
+#include "framepool.h"
+
+/*!
+ * \brief Something that can take a picture of each screen.
+ * \details QSnapper takes its pictures through one of these, so faster ways of
+ * reading the screen can be swapped in where the system supports them.
+ */
+class CaptureBackend
+{
+public:
+  virtual ~CaptureBackend();
+  /*!
+   * \brief Takes a picture of each screen.
+   * \return A picture per screen, in the order Qt lists the screens. A
+   * picture may be null if that screen could not be read.
+   */
+  virtual QList<QImage> grabScreens() = 0;
+  ///\brief A short name for the backend, used in logs.
+  virtual QString name() const = 0;
+  static CaptureBackend *create(FramePool *pool = nullptr);
+  static void setOpaque(uchar *bits, int width, int height, int bytesPerLine);
+};
+
+/*!
+ * \brief Takes pictures the portable way, through QPixmap.
+ * \details Each picture is copied out of the window system into a QPixmap and
+ * then again into a QImage. Given a FramePool, the second copy goes into one
+ * of its buffers instead of a new image.
+ */
+class QtCaptureBackend : public CaptureBackend
+{
+  ///\brief Where pictures are copied into, or nullptr for new images.
+  FramePool *pool;
+
+public:
+  explicit QtCaptureBackend(FramePool *pool = nullptr);
+  virtual QList<QImage> grabScreens() override;
+  virtual QString name() const override;
+};
+
+#endif // CAPTUREBACKEND_H
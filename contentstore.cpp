@@ -0,0 +1,191 @@
+#include "contentstore.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+const int ContentStore::keySize;
+const int ContentStore::recordSize;
+
+/*!
+ * \brief Opens a store.
+ * \param directory The folder holding the store, created as pictures are
+ * added.
+ */
+ContentStore::ContentStore(const QString &directory) : directory(directory)
+{
+}
+
+/*!
+ * \brief Gets the key a picture is stored under.
+ * \details The SHA-1 of the size and the pixels, with every picture brought
+ * to RGB32 first so the same screen always gets the same key. Only the
+ * pixels of each row are hashed, not the padding after them.
+ * \param frame The picture.
+ * \return keySize bytes.
+ */
+QByteArray ContentStore::frameKey(const QImage &frame)
+{
+  const QImage normalized = frame.format() == QImage::Format_RGB32
+                                ? frame
+                                : frame.convertToFormat(QImage::Format_RGB32);
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  QByteArray size;
+  QDataStream stream(&size, QIODevice::WriteOnly);
+  stream << qint32(normalized.width()) << qint32(normalized.height());
+  hash.addData(size);
+  const int rowBytes = normalized.width() * 4;
+  for(int y = 0; y < normalized.height(); ++y)
+    hash.addData(reinterpret_cast<const char *>(normalized.constScanLine(y)),
+                 rowBytes);
+  return hash.result();
+}
+
+/*!
+ * \brief Gets where a picture is kept.
+ * \param key The picture's key.
+ * \return The path, whether or not the picture is there yet.
+ */
+QString ContentStore::objectPath(const QByteArray &key) const
+{
+  const QString hex = QString::fromLatin1(key.toHex());
+  return directory + "/objects/" + hex.left(2) + '/' + hex + ".jpg";
+}
+
+/*!
+ * \brief Gets where the index is kept.
+ * \return The path of index.qsi.
+ */
+QString ContentStore::indexPath() const { return directory + "/index.qsi"; }
+
+/*!
+ * \brief Checks if a picture is already stored.
+ * \param key The picture's key.
+ * \return True if the picture's file exists.
+ */
+bool ContentStore::contains(const QByteArray &key) const
+{
+  return QFile::exists(objectPath(key));
+}
+
+/*!
+ * \brief Stores a picture.
+ * \details Written to a temporary name and then renamed, so a half written
+ * file is never mistaken for a stored picture.
+ * \param key The picture's key.
+ * \param encoded The encoded picture.
+ * \return If the picture is now stored.
+ */
+bool ContentStore::addObject(const QByteArray &key,
+                             const QByteArray &encoded) const
+{
+  const QString path = objectPath(key);
+  if(!QDir().mkpath(QFileInfo(path).path()))
+    return false;
+  QFile file(path + ".part");
+  if(!file.open(QIODevice::WriteOnly) ||
+     file.write(encoded) != encoded.size())
+    return false;
+  file.close();
+  QFile::remove(path);
+  return file.rename(path);
+}
+
+/*!
+ * \brief Notes in the index that a picture was taken.
+ * \param taken When it was taken.
+ * \param screen Which screen it is of.
+ * \param key The picture's key.
+ * \return If the record was written.
+ */
+bool ContentStore::record(const QDateTime &taken, int screen,
+                          const QByteArray &key) const
+{
+  if(key.size() != keySize || !QDir().mkpath(directory))
+    return false;
+  QByteArray line;
+  QDataStream stream(&line, QIODevice::WriteOnly);
+  stream << qint64(taken.toMSecsSinceEpoch()) << qint32(screen);
+  line.append(key);
+  QFile index(indexPath());
+  return index.open(QIODevice::Append) &&
+         index.write(line) == recordSize;
+}
+
+/*!
+ * \brief Drops the oldest records from the index.
+ * \details The rest are written to a temporary name and renamed over the
+ * index, with the folder's SaveFolderLock held by the caller so record()
+ * can't write to the old one meanwhile. The pictures are left in place,
+ * deleting the ones no longer recorded is up to the caller.
+ * \param count How many records to drop from the start.
+ * \return If the index was rewritten.
+ */
+bool ContentStore::forget(int count) const
+{
+  QFile index(indexPath());
+  if(!index.open(QIODevice::ReadOnly))
+    return false;
+  const QByteArray data = index.readAll();
+  QFile file(indexPath() + ".part");
+  if(!file.open(QIODevice::WriteOnly))
+    return false;
+  // Whole records only, a crash can leave half of one at the end.
+  const int kept = count * recordSize;
+  const QByteArray records =
+      data.mid(kept, (data.size() - kept) / recordSize * recordSize);
+  if(file.write(records) != records.size())
+    return false;
+  index.close();
+  file.close();
+  QFile::remove(indexPath());
+  return file.rename(indexPath());
+}
+
+/*!
+ * \brief Reads the whole index.
+ * \details A record cut short at the end, from a crash while writing, is
+ * ignored.
+ * \return Every record, in the order they were written.
+ */
+QList<ContentStoreEntry> ContentStore::entries() const
+{
+  QList<ContentStoreEntry> result;
+  QFile index(indexPath());
+  if(!index.open(QIODevice::ReadOnly))
+    return result;
+  const QByteArray data = index.readAll();
+  for(int offset = 0; offset + recordSize <= data.size();
+      offset += recordSize)
+  {
+    QDataStream stream(data.mid(offset, recordSize));
+    qint64 msecs;
+    qint32 screen;
+    stream >> msecs >> screen;
+    ContentStoreEntry entry;
+    entry.taken = QDateTime::fromMSecsSinceEpoch(msecs);
+    entry.screen = screen;
+    entry.key = data.mid(offset + 12, keySize);
+    result.append(entry);
+  }
+  return result;
+}
+
+/*!
+ * \brief Finds the picture shown on a screen at a time.
+ * \param when The time to look up.
+ * \param screen Which screen to look up.
+ * \return The path of the last picture of that screen taken at or before
+ * when, or an empty string if there is none.
+ */
+QString ContentStore::frameAt(const QDateTime &when, int screen) const
+{
+  QString path;
+  for(const ContentStoreEntry &entry : entries())
+  {
+    if(entry.screen == screen && entry.taken <= when)
+      path = objectPath(entry.key);
+  }
+  return path;
+}
@@ -0,0 +1,54 @@
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+#include <QByteArray>
+#include <QDateTime>
+#include <QImage>
+#include <QList>
+#include <QString>
+
+///\brief One line of a ContentStore's index.
+struct ContentStoreEntry
+{
+  ///\brief When the picture was taken.
+  QDateTime taken;
+  ///\brief Which screen the picture is of.
+  int screen;
+  ///\brief The picture's key, see ContentStore::frameKey().
+  QByteArray key;
+};
+
+/*!
+ * \brief Stores each distinct screenshot once, named by a hash of its pixels.
+ * \details Pictures live under objects/, in a folder named by the first byte
+ * of their key, as objects/ab/abcdef....jpg. Every picture taken adds a
+ * fixed size record (the time, the screen and the key) to index.qsi, so a
+ * picture seen before only costs a record and not another file.
+ * A store is only a folder name, so one can be made wherever it is needed.
+ * Checking for a picture and adding one are safe from different threads;
+ * only one thread should append to the index, and forget() must not overlap
+ * it, both are done holding the folder's SaveFolderLock.
+ */
+class ContentStore
+{
+  ///\brief The folder holding objects/ and index.qsi.
+  QString directory;
+
+public:
+  ///\brief The length of a key, in bytes.
+  static const int keySize = 20;
+  ///\brief The length of an index record, in bytes.
+  static const int recordSize = 8 + 4 + keySize;
+  explicit ContentStore(const QString &directory);
+  static QByteArray frameKey(const QImage &frame);
+  QString objectPath(const QByteArray &key) const;
+  QString indexPath() const;
+  bool contains(const QByteArray &key) const;
+  bool addObject(const QByteArray &key, const QByteArray &encoded) const;
+  bool record(const QDateTime &taken, int screen,
+              const QByteArray &key) const;
+  bool forget(int count) const;
+  QList<ContentStoreEntry> entries() const;
+  QString frameAt(const QDateTime &when, int screen) const;
+};
+
+#endif // CONTENTSTORE_H
@@ -149,18 +149,127 @@ QsnapperAdaptor::~QsnapperAdaptor()
   // destructor
 }
 
+QString QsnapperAdaptor::burstStatus()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.burstStatus
+  QString out0;
+  QMetaObject::invokeMethod(parent(), "burstStatus",
+                            Q_RETURN_ARG(QString, out0));
+  return out0;
+}
+
+void QsnapperAdaptor::cancelCompaction()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.cancelCompaction
+  QMetaObject::invokeMethod(parent(), "cancelCompaction");
+}
+
+bool QsnapperAdaptor::compact()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.compact
+  bool out0;
+  QMetaObject::invokeMethod(parent(), "compact", Q_RETURN_ARG(bool, out0));
+  return out0;
+}
+
+QString QsnapperAdaptor::compactionStatus()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.compactionStatus
+  QString out0;
+  QMetaObject::invokeMethod(parent(), "compactionStatus",
+                            Q_RETURN_ARG(QString, out0));
+  return out0;
+}
+
+int QsnapperAdaptor::effectiveInterval()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.effectiveInterval
+  int out0;
+  QMetaObject::invokeMethod(parent(), "effectiveInterval",
+                            Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
 void QsnapperAdaptor::enableSnapping(bool enable)
 {
   // handle method call com.coderfrog.qcompanion.qsnapper.enableSnapping
   QMetaObject::invokeMethod(parent(), "enableSnapping", Q_ARG(bool, enable));
 }
 
+bool QsnapperAdaptor::exportArchivedFrame(const QString &when, int screen,
+                                          const QString &fileName)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.exportArchivedFrame
+  bool out0;
+  QMetaObject::invokeMethod(parent(), "exportArchivedFrame",
+                            Q_RETURN_ARG(bool, out0), Q_ARG(QString, when),
+                            Q_ARG(int, screen), Q_ARG(QString, fileName));
+  return out0;
+}
+
+QStringList QsnapperAdaptor::findSimilar(const QString &referenceImagePath,
+                                         int radius)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.findSimilar
+  QStringList out0;
+  QMetaObject::invokeMethod(parent(), "findSimilar",
+                            Q_RETURN_ARG(QStringList, out0),
+                            Q_ARG(QString, referenceImagePath),
+                            Q_ARG(int, radius));
+  return out0;
+}
+
+int QsnapperAdaptor::framePoolHighWaterMark()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.framePoolHighWaterMark
+  int out0;
+  QMetaObject::invokeMethod(parent(), "framePoolHighWaterMark",
+                            Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
+bool QsnapperAdaptor::rebuildTimeline()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.rebuildTimeline
+  bool out0;
+  QMetaObject::invokeMethod(parent(), "rebuildTimeline",
+                            Q_RETURN_ARG(bool, out0));
+  return out0;
+}
+
+int QsnapperAdaptor::screensaverQueryCount()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.screensaverQueryCount
+  int out0;
+  QMetaObject::invokeMethod(parent(), "screensaverQueryCount",
+                            Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
+void QsnapperAdaptor::setArchive(bool enable)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.setArchive
+  QMetaObject::invokeMethod(parent(), "setArchive", Q_ARG(bool, enable));
+}
+
+void QsnapperAdaptor::setContentStore(bool enable)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.setContentStore
+  QMetaObject::invokeMethod(parent(), "setContentStore", Q_ARG(bool, enable));
+}
+
 void QsnapperAdaptor::setDiff(bool enable)
 {
   // handle method call com.coderfrog.qcompanion.qsnapper.setDiff
   QMetaObject::invokeMethod(parent(), "setDiff", Q_ARG(bool, enable));
 }
 
+void QsnapperAdaptor::setDiffRegions(bool enable)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.setDiffRegions
+  QMetaObject::invokeMethod(parent(), "setDiffRegions", Q_ARG(bool, enable));
+}
+
 void QsnapperAdaptor::setLenient(bool isLenient)
 {
   // handle method call com.coderfrog.qcompanion.qsnapper.setLenient
@@ -174,6 +283,22 @@ void QsnapperAdaptor::setMuteSettings(bool shouldMute)
                             Q_ARG(bool, shouldMute));
 }
 
+void QsnapperAdaptor::setTileHashing(bool enable)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.setTileHashing
+  QMetaObject::invokeMethod(parent(), "setTileHashing", Q_ARG(bool, enable));
+}
+
+QString QsnapperAdaptor::similarityRebuildStatus()
+{
+  // handle method call
+  // com.coderfrog.qcompanion.qsnapper.similarityRebuildStatus
+  QString out0;
+  QMetaObject::invokeMethod(parent(), "similarityRebuildStatus",
+                            Q_RETURN_ARG(QString, out0));
+  return out0;
+}
+
 bool QsnapperAdaptor::snap()
 {
   // handle method call com.coderfrog.qcompanion.qsnapper.snap
@@ -182,6 +307,21 @@ bool QsnapperAdaptor::snap()
   return out0;
 }
 
+bool QsnapperAdaptor::startBurst(int framesPerSecond, int seconds)
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.startBurst
+  bool out0;
+  QMetaObject::invokeMethod(parent(), "startBurst", Q_RETURN_ARG(bool, out0),
+                            Q_ARG(int, framesPerSecond), Q_ARG(int, seconds));
+  return out0;
+}
+
+void QsnapperAdaptor::stopBurst()
+{
+  // handle method call com.coderfrog.qcompanion.qsnapper.stopBurst
+  QMetaObject::invokeMethod(parent(), "stopBurst");
+}
+
 /*
  * Implementation of adaptor class SpeakerAdaptor
  */
@@ -197,6 +337,22 @@ SpeakerAdaptor::~SpeakerAdaptor()
   // destructor
 }
 
+int SpeakerAdaptor::cacheHits()
+{
+  // handle method call com.coderfrog.qcompanion.speaker.cacheHits
+  int out0;
+  QMetaObject::invokeMethod(parent(), "cacheHits", Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
+int SpeakerAdaptor::cacheMisses()
+{
+  // handle method call com.coderfrog.qcompanion.speaker.cacheMisses
+  int out0;
+  QMetaObject::invokeMethod(parent(), "cacheMisses", Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
 bool SpeakerAdaptor::isNotificationsEnabled()
 {
   // handle method call com.coderfrog.qcompanion.speaker.isNotificationsEnabled
@@ -214,6 +370,15 @@ bool SpeakerAdaptor::isTTSEnabled()
   return out0;
 }
 
+int SpeakerAdaptor::laneLatency(int priority)
+{
+  // handle method call com.coderfrog.qcompanion.speaker.laneLatency
+  int out0;
+  QMetaObject::invokeMethod(parent(), "laneLatency", Q_RETURN_ARG(int, out0),
+                            Q_ARG(int, priority));
+  return out0;
+}
+
 void SpeakerAdaptor::setNotificationsEnabled(bool enable)
 {
   // handle method call com.coderfrog.qcompanion.speaker.setNotificationsEnabled
@@ -233,6 +398,31 @@ void SpeakerAdaptor::speak(const QString &speakMe)
   QMetaObject::invokeMethod(parent(), "speak", Q_ARG(QString, speakMe));
 }
 
+void SpeakerAdaptor::speakWithPriority(const QString &speakMe, int priority)
+{
+  // handle method call com.coderfrog.qcompanion.speaker.speakWithPriority
+  QMetaObject::invokeMethod(parent(), "speakWithPriority",
+                            Q_ARG(QString, speakMe), Q_ARG(int, priority));
+}
+
+int SpeakerAdaptor::startupLatency()
+{
+  // handle method call com.coderfrog.qcompanion.speaker.startupLatency
+  int out0;
+  QMetaObject::invokeMethod(parent(), "startupLatency",
+                            Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
+int SpeakerAdaptor::timeToFirstAudio()
+{
+  // handle method call com.coderfrog.qcompanion.speaker.timeToFirstAudio
+  int out0;
+  QMetaObject::invokeMethod(parent(), "timeToFirstAudio",
+                            Q_RETURN_ARG(int, out0));
+  return out0;
+}
+
 /*
  * Implementation of adaptor class WaiterAdaptor
  */
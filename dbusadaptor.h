@@ -126,6 +126,8 @@ class QsnapperAdaptor : public QDBusAbstractAdaptor
   Q_CLASSINFO("D-Bus Introspection",
               ""
               "  <interface name=\"com.coderfrog.qcompanion.qsnapper\">\n"
+              "    <!-- True once a picture is queued to be saved,\n"
+              "         not once it is on disk. -->\n"
               "    <method name=\"snap\">\n"
               "      <arg direction=\"out\" type=\"b\"/>\n"
               "    </method>\n"
@@ -141,6 +143,62 @@ class QsnapperAdaptor : public QDBusAbstractAdaptor
               "    <method name=\"setDiff\">\n"
               "      <arg direction=\"in\" type=\"b\" name=\"enable\"/>\n"
               "    </method>\n"
+              "    <method name=\"setDiffRegions\">\n"
+              "      <arg direction=\"in\" type=\"b\" name=\"enable\"/>\n"
+              "    </method>\n"
+              "    <method name=\"setContentStore\">\n"
+              "      <arg direction=\"in\" type=\"b\" name=\"enable\"/>\n"
+              "    </method>\n"
+              "    <method name=\"setTileHashing\">\n"
+              "      <arg direction=\"in\" type=\"b\" name=\"enable\"/>\n"
+              "    </method>\n"
+              "    <method name=\"setArchive\">\n"
+              "      <arg direction=\"in\" type=\"b\" name=\"enable\"/>\n"
+              "    </method>\n"
+              "    <method name=\"exportArchivedFrame\">\n"
+              "      <arg direction=\"out\" type=\"b\"/>\n"
+              "      <arg direction=\"in\" type=\"s\" name=\"when\"/>\n"
+              "      <arg direction=\"in\" type=\"i\" name=\"screen\"/>\n"
+              "      <arg direction=\"in\" type=\"s\" name=\"fileName\"/>\n"
+              "    </method>\n"
+              "    <method name=\"findSimilar\">\n"
+              "      <arg direction=\"out\" type=\"as\"/>\n"
+              "      <arg direction=\"in\" type=\"s\""
+              " name=\"referenceImagePath\"/>\n"
+              "      <arg direction=\"in\" type=\"i\" name=\"radius\"/>\n"
+              "    </method>\n"
+              "    <method name=\"effectiveInterval\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
+              "    <method name=\"screensaverQueryCount\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
+              "    <method name=\"compact\">\n"
+              "      <arg direction=\"out\" type=\"b\"/>\n"
+              "    </method>\n"
+              "    <method name=\"cancelCompaction\"/>\n"
+              "    <method name=\"rebuildTimeline\">\n"
+              "      <arg direction=\"out\" type=\"b\"/>\n"
+              "    </method>\n"
+              "    <method name=\"compactionStatus\">\n"
+              "      <arg direction=\"out\" type=\"s\"/>\n"
+              "    </method>\n"
+              "    <method name=\"similarityRebuildStatus\">\n"
+              "      <arg direction=\"out\" type=\"s\"/>\n"
+              "    </method>\n"
+              "    <method name=\"startBurst\">\n"
+              "      <arg direction=\"out\" type=\"b\"/>\n"
+              "      <arg direction=\"in\" type=\"i\""
+              " name=\"framesPerSecond\"/>\n"
+              "      <arg direction=\"in\" type=\"i\" name=\"seconds\"/>\n"
+              "    </method>\n"
+              "    <method name=\"stopBurst\"/>\n"
+              "    <method name=\"burstStatus\">\n"
+              "      <arg direction=\"out\" type=\"s\"/>\n"
+              "    </method>\n"
+              "    <method name=\"framePoolHighWaterMark\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
               "  </interface>\n"
               "")
 public:
@@ -149,11 +207,29 @@ public:
 
 public:         // PROPERTIES
 public Q_SLOTS: // METHODS
+  QString burstStatus();
+  void cancelCompaction();
+  bool compact();
+  QString compactionStatus();
+  int effectiveInterval();
   void enableSnapping(bool enable);
+  bool exportArchivedFrame(const QString &when, int screen,
+                           const QString &fileName);
+  QStringList findSimilar(const QString &referenceImagePath, int radius);
+  int framePoolHighWaterMark();
+  bool rebuildTimeline();
+  int screensaverQueryCount();
+  void setArchive(bool enable);
+  void setContentStore(bool enable);
   void setDiff(bool enable);
+  void setDiffRegions(bool enable);
   void setLenient(bool isLenient);
   void setMuteSettings(bool shouldMute);
+  void setTileHashing(bool enable);
+  QString similarityRebuildStatus();
   bool snap();
+  bool startBurst(int framesPerSecond, int seconds);
+  void stopBurst();
 Q_SIGNALS: // SIGNALS
 };
 
@@ -170,6 +246,10 @@ class SpeakerAdaptor : public QDBusAbstractAdaptor
               "    <method name=\"speak\">\n"
               "      <arg direction=\"in\" type=\"s\" name=\"speakMe\"/>\n"
               "    </method>\n"
+              "    <method name=\"speakWithPriority\">\n"
+              "      <arg direction=\"in\" type=\"s\" name=\"speakMe\"/>\n"
+              "      <arg direction=\"in\" type=\"i\" name=\"priority\"/>\n"
+              "    </method>\n"
               "    <method name=\"setNotificationsEnabled\">\n"
               "      <arg direction=\"in\" type=\"b\" name=\"enable\"/>\n"
               "    </method>\n"
@@ -182,6 +262,22 @@ class SpeakerAdaptor : public QDBusAbstractAdaptor
               "    <method name=\"isTTSEnabled\">\n"
               "      <arg direction=\"out\" type=\"b\"/>\n"
               "    </method>\n"
+              "    <method name=\"timeToFirstAudio\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
+              "    <method name=\"cacheHits\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
+              "    <method name=\"cacheMisses\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
+              "    <method name=\"startupLatency\">\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
+              "    <method name=\"laneLatency\">\n"
+              "      <arg direction=\"in\" type=\"i\" name=\"priority\"/>\n"
+              "      <arg direction=\"out\" type=\"i\"/>\n"
+              "    </method>\n"
               "  </interface>\n"
               "")
 public:
@@ -190,11 +286,17 @@ public:
 
 public:         // PROPERTIES
 public Q_SLOTS: // METHODS
+  int cacheHits();
+  int cacheMisses();
   bool isNotificationsEnabled();
   bool isTTSEnabled();
+  int laneLatency(int priority);
   void setNotificationsEnabled(bool enable);
   void setTTSEnabled(bool enable);
   void speak(const QString &speakMe);
+  void speakWithPriority(const QString &speakMe, int priority);
+  int startupLatency();
+  int timeToFirstAudio();
 Q_SIGNALS: // SIGNALS
 };
 
@@ -0,0 +1,406 @@
+#include "diffengine.h"
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/task_group.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIFFENGINE_X86_RUNTIME
+#define DIFFENGINE_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_M_X64)
+#define DIFFENGINE_SSE2_ONLY
+#define DIFFENGINE_TARGET(isa)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+///\brief The signature shared by every row kernel.
+typedef int (*RowKernel)(const std::uint32_t *, const std::uint32_t *, int);
+
+/*!
+ * \brief The plain C++ kernel, used on CPUs without SIMD and for row tails.
+ * \param a The first row.
+ * \param b The second row.
+ * \param width The number of pixels in each row.
+ * \return The number of pixels that differ.
+ */
+int countRowScalar(const std::uint32_t *a, const std::uint32_t *b, int width)
+{
+  int difference = 0;
+  for(int i = 0; i < width; ++i)
+    difference += a[i] != b[i];
+  return difference;
+}
+
+#if defined(DIFFENGINE_X86_RUNTIME) || defined(DIFFENGINE_SSE2_ONLY)
+/*!
+ * \brief Compares four pixels at a time.
+ * \details Equal lanes are -1 after the compare, so subtracting them from an
+ * accumulator counts equal pixels per lane without any branches.
+ */
+DIFFENGINE_TARGET("sse2") int
+countRowSSE2(const std::uint32_t *a, const std::uint32_t *b, int width)
+{
+  __m128i equal = _mm_setzero_si128();
+  int i = 0;
+  for(; i + 4 <= width; i += 4)
+  {
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    const __m128i y =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    equal = _mm_sub_epi32(equal, _mm_cmpeq_epi32(x, y));
+  }
+  alignas(16) std::int32_t lanes[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), equal);
+  const int sameCount = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return (i - sameCount) + countRowScalar(a + i, b + i, width - i);
+}
+#endif
+
+#ifdef DIFFENGINE_X86_RUNTIME
+/*!
+ * \brief Compares eight pixels at a time, same idea as countRowSSE2.
+ */
+DIFFENGINE_TARGET("avx2") int
+countRowAVX2(const std::uint32_t *a, const std::uint32_t *b, int width)
+{
+  __m256i equal = _mm256_setzero_si256();
+  int i = 0;
+  for(; i + 8 <= width; i += 8)
+  {
+    const __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    const __m256i y =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+    equal = _mm256_sub_epi32(equal, _mm256_cmpeq_epi32(x, y));
+  }
+  alignas(32) std::int32_t lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), equal);
+  int sameCount = 0;
+  for(int lane = 0; lane < 8; ++lane)
+    sameCount += lanes[lane];
+  return (i - sameCount) + countRowScalar(a + i, b + i, width - i);
+}
+#endif
+
+///\brief A kernel paired with the name reported by DiffEngine::kernelName.
+struct Kernel
+{
+  RowKernel function;
+  const char *name;
+};
+
+/*!
+ * \brief Picks the widest kernel this CPU can run. Evaluated once.
+ */
+const Kernel &bestKernel()
+{
+  static const Kernel kernel = []() -> Kernel
+  {
+#if defined(DIFFENGINE_X86_RUNTIME)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+      return {countRowAVX2, "AVX2"};
+    if(__builtin_cpu_supports("sse2"))
+      return {countRowSSE2, "SSE2"};
+#elif defined(DIFFENGINE_SSE2_ONLY)
+    return {countRowSSE2, "SSE2"};
+#endif
+    return {countRowScalar, "Scalar"};
+  }();
+  return kernel;
+}
+
+/*!
+ * \brief Mixes a cell and round into a well spread 32 bit number.
+ * \details Used to jitter the sample inside each cell, so every round looks
+ * at different pixels without keeping any random number state.
+ */
+std::uint32_t jitter(std::uint32_t cell, std::uint32_t round)
+{
+  std::uint32_t h = cell * 0x9E3779B1u ^ (round + 1) * 0x85EBCA77u;
+  h ^= h >> 15;
+  h *= 0x2C1B3C6Du;
+  h ^= h >> 12;
+  h *= 0x297A2D39u;
+  h ^= h >> 15;
+  return h;
+}
+
+/*!
+ * \brief The relative entropy between two coin flips, one landing heads with
+ * chance q and the other with chance p.
+ * \details By the Chernoff bound, the chance that n samples of a coin with
+ * chance p show a ratio of q or further from p is at most exp(-n * this).
+ */
+double bernoulliDivergence(double q, double p)
+{
+  double divergence = 0;
+  if(q > 0)
+    divergence += q * std::log(q / p);
+  if(q < 1)
+    divergence += (1 - q) * std::log((1 - q) / (1 - p));
+  return divergence;
+}
+
+/*!
+ * \brief Counts differing pixels at one jittered spot per cell of a grid laid
+ * over the frames.
+ * \param a The first frame.
+ * \param b The second frame.
+ * \param samples About how many pixels to look at.
+ * \param round Which round this is, picks the spot inside each cell.
+ * \param taken Set to how many pixels were looked at.
+ * \return The number of pixels looked at that differ.
+ */
+long long countSample(const FrameView &a, const FrameView &b, int samples,
+                      int round, long long &taken)
+{
+  const double aspect = double(a.width) / a.height;
+  const int columns = std::max(
+      1, std::min(a.width, int(std::ceil(std::sqrt(samples * aspect)))));
+  const int rows =
+      std::max(1, std::min(a.height, (samples + columns - 1) / columns));
+  taken = static_cast<long long>(columns) * rows;
+  return tbb::parallel_reduce(
+      tbb::blocked_range<int>(0, rows), 0LL,
+      [&](const tbb::blocked_range<int> &range, long long difference)
+      {
+        for(int row = range.begin(); row != range.end(); ++row)
+        {
+          const long long top = static_cast<long long>(row) * a.height / rows;
+          const long long bottom =
+              static_cast<long long>(row + 1) * a.height / rows;
+          for(int column = 0; column < columns; ++column)
+          {
+            const long long left =
+                static_cast<long long>(column) * a.width / columns;
+            const long long right =
+                static_cast<long long>(column + 1) * a.width / columns;
+            const std::uint32_t h =
+                jitter(std::uint32_t(row * columns + column), round);
+            const int x = int(left + (h & 0xFFFF) % (right - left));
+            const int y = int(top + (h >> 16) % (bottom - top));
+            difference += a.row(y)[x] != b.row(y)[x];
+          }
+        }
+        return difference;
+      },
+      [](long long x, long long y) { return x + y; });
+}
+}
+
+/*!
+ * \brief Counts the differing pixels in a single row.
+ * \param a The first row.
+ * \param b The second row.
+ * \param width The number of pixels in each row.
+ * \return The number of pixels that differ.
+ */
+int DiffEngine::countRow(const std::uint32_t *a, const std::uint32_t *b,
+                         int width)
+{
+  return bestKernel().function(a, b, width);
+}
+
+/*!
+ * \brief Checks if more than limit pixels differ between two frames.
+ * \details Rows are handed out to TBB workers. Each worker publishes its row's
+ * tally to a shared total, and as soon as the total crosses the limit the
+ * remaining work is cancelled.
+ * \param a The first frame.
+ * \param b The second frame, must be the same size as a.
+ * \param limit How many differing pixels are tolerated.
+ * \return True if more than limit pixels differ.
+ */
+bool DiffEngine::exceedsLimit(const FrameView &a, const FrameView &b,
+                              long long limit)
+{
+  const RowKernel kernel = bestKernel().function;
+  const int width = a.width;
+  std::atomic<long long> difference(0);
+  std::atomic<bool> exceeded(false);
+  tbb::task_group_context context;
+  tbb::parallel_for(tbb::blocked_range<int>(0, a.height),
+                    [&](const tbb::blocked_range<int> &range)
+                    {
+    for(int y = range.begin(); y != range.end(); ++y)
+    {
+      if(exceeded.load(std::memory_order_relaxed))
+        return;
+      const int rowDifference = kernel(a.row(y), b.row(y), width);
+      if(rowDifference != 0 && (difference += rowDifference) > limit)
+      {
+        exceeded = true;
+        context.cancel_group_execution();
+      }
+    }
+  },
+                    context);
+  return exceeded;
+}
+
+/*!
+ * \brief Checks if more than limit pixels differ between two frames, looking
+ * at a sample of pixels first.
+ * \details A jittered grid of pixels is compared, growing over up to three
+ * rounds while the budget of 1/128th of the frame allows. After each round
+ * the Chernoff bound tells how likely the sample's ratio of changed pixels
+ * would be if the true ratio were on the other side of the limit. Once that
+ * is below errorRate the answer is returned. If the sample can't tell, the
+ * frames are compared exactly with exceedsLimit().
+ * \param a The first frame.
+ * \param b The second frame, must be the same size as a.
+ * \param limit How many differing pixels are tolerated.
+ * \param errorRate The largest chance of a wrong answer that is tolerated.
+ * 0 always compares exactly.
+ * \param examined If set, receives how many pixels were sampled, or the
+ * whole frame if the exact comparison was needed.
+ * \return True if more than limit pixels differ, most likely.
+ */
+bool DiffEngine::sampledExceedsLimit(const FrameView &a, const FrameView &b,
+                                     long long limit, double errorRate,
+                                     long long *examined)
+{
+  const long long pixels = static_cast<long long>(a.width) * a.height;
+  const double limitRatio = double(limit) / pixels;
+  const long long budget = pixels / 128;
+  const int roundSamples[] = {1024, 4096, 16384};
+  const int rounds = sizeof(roundSamples) / sizeof(roundSamples[0]);
+  // Each round is a separate test, so they share the tolerated error.
+  const double threshold = std::log(rounds / std::max(errorRate, 1e-300));
+  long long taken = 0, difference = 0;
+  if(errorRate > 0 && limitRatio > 0 && limitRatio < 1)
+  {
+    for(int round = 0; round < rounds; ++round)
+    {
+      if(taken + roundSamples[round] > budget)
+        break;
+      long long roundTaken = 0;
+      difference += countSample(a, b, roundSamples[round], round, roundTaken);
+      taken += roundTaken;
+      const double ratio = double(difference) / taken;
+      if(taken * bernoulliDivergence(ratio, limitRatio) >= threshold)
+      {
+        if(examined)
+          *examined = taken;
+        return ratio > limitRatio;
+      }
+    }
+  }
+  if(examined)
+    *examined = pixels;
+  return exceedsLimit(a, b, limit);
+}
+
+/*!
+ * \brief Counts every differing pixel between two frames.
+ * \param a The first frame.
+ * \param b The second frame, must be the same size as a.
+ * \return The number of pixels that differ.
+ */
+long long DiffEngine::countDifferences(const FrameView &a, const FrameView &b)
+{
+  const RowKernel kernel = bestKernel().function;
+  const int width = a.width;
+  return tbb::parallel_reduce(
+      tbb::blocked_range<int>(0, a.height), 0LL,
+      [&](const tbb::blocked_range<int> &range, long long difference)
+      {
+        for(int y = range.begin(); y != range.end(); ++y)
+          difference += kernel(a.row(y), b.row(y), width);
+        return difference;
+      },
+      [](long long x, long long y) { return x + y; });
+}
+
+/*!
+ * \brief Finds the bounding rectangles of the areas that changed.
+ * \details The frames are split into cellSize x cellSize cells and each band
+ * of cells is checked by its own TBB task, writing only its own flags. Cells
+ * that changed and touch each other, including at corners, are then grouped,
+ * and each group becomes the rectangle around it.
+ * \param a The first frame.
+ * \param b The second frame, must be the same size as a.
+ * \param cellSize How finely changes are located, in pixels.
+ * \return The rectangles, clipped to the frame, in no particular order.
+ */
+std::vector<DiffRegion> DiffEngine::changedRegions(const FrameView &a,
+                                                   const FrameView &b,
+                                                   int cellSize)
+{
+  const RowKernel kernel = bestKernel().function;
+  const int columns = (a.width + cellSize - 1) / cellSize;
+  const int rows = (a.height + cellSize - 1) / cellSize;
+  std::vector<char> changed(static_cast<size_t>(columns) * rows, 0);
+  tbb::parallel_for(0, rows, [&](int cellRow)
+                    {
+    char *band = changed.data() + static_cast<size_t>(cellRow) * columns;
+    const int bottom = std::min((cellRow + 1) * cellSize, a.height);
+    for(int y = cellRow * cellSize; y < bottom; ++y)
+    {
+      const std::uint32_t *rowA = a.row(y);
+      const std::uint32_t *rowB = b.row(y);
+      for(int column = 0; column < columns; ++column)
+      {
+        const int left = column * cellSize;
+        if(!band[column] &&
+           kernel(rowA + left, rowB + left,
+                  std::min(cellSize, a.width - left)) != 0)
+          band[column] = 1;
+      }
+    }
+  });
+
+  std::vector<DiffRegion> regions;
+  std::vector<int> pending;
+  for(int start = 0; start < columns * rows; ++start)
+  {
+    if(changed[start] != 1)
+      continue;
+    int left = columns, top = rows, right = -1, bottom = -1;
+    changed[start] = 2;
+    pending.push_back(start);
+    while(!pending.empty())
+    {
+      const int cell = pending.back();
+      pending.pop_back();
+      const int column = cell % columns;
+      const int row = cell / columns;
+      left = std::min(left, column);
+      right = std::max(right, column);
+      top = std::min(top, row);
+      bottom = std::max(bottom, row);
+      for(int y = std::max(row - 1, 0); y <= std::min(row + 1, rows - 1); ++y)
+      {
+        for(int x = std::max(column - 1, 0);
+            x <= std::min(column + 1, columns - 1); ++x)
+        {
+          const int neighbour = y * columns + x;
+          if(changed[neighbour] == 1)
+          {
+            changed[neighbour] = 2;
+            pending.push_back(neighbour);
+          }
+        }
+      }
+    }
+    DiffRegion region;
+    region.x = left * cellSize;
+    region.y = top * cellSize;
+    region.width = std::min((right + 1) * cellSize, a.width) - region.x;
+    region.height = std::min((bottom + 1) * cellSize, a.height) - region.y;
+    regions.push_back(region);
+  }
+  return regions;
+}
+
+/*!
+ * \brief Gets the name of the kernel picked for this CPU.
+ * \return "AVX2", "SSE2" or "Scalar".
+ */
+const char *DiffEngine::kernelName() { return bestKernel().name; }
@@ -0,0 +1,69 @@
+#ifndef DIFFENGINE_H
+#define DIFFENGINE_H
+#include <cstdint>
+#include <vector>
+
+/*!
+ * \brief A read-only view of a 32 bit per pixel frame.
+ * \details Points at memory owned by someone else (a QImage, a shared memory
+ * segment, etc.) so the diff code never has to copy or convert a frame.
+ */
+struct FrameView
+{
+  ///\brief The first byte of the first row.
+  const std::uint8_t *bits;
+  ///\brief The frame's width in pixels.
+  int width;
+  ///\brief The frame's height in pixels.
+  int height;
+  ///\brief The number of bytes between the start of two rows.
+  int bytesPerLine;
+  ///\brief Returns the start of the given row as 32 bit pixels.
+  const std::uint32_t *row(int y) const
+  {
+    return reinterpret_cast<const std::uint32_t *>(bits + y * bytesPerLine);
+  }
+};
+
+///\brief A rectangle of a frame, in pixels.
+struct DiffRegion
+{
+  ///\brief The left edge.
+  int x;
+  ///\brief The top edge.
+  int y;
+  ///\brief The width.
+  int width;
+  ///\brief The height.
+  int height;
+};
+
+/*!
+ * \brief Counts the pixels that differ between two frames.
+ * \details Frames are walked row by row straight out of their scanline memory.
+ * Each row is compared with the widest vector kernel the CPU supports (AVX2,
+ * then SSE2, then plain C++), picked once at runtime. Rows are split between
+ * TBB workers, each keeping its own tally and only publishing it once per row,
+ * so the workers can stop early once the limit is crossed without contending
+ * on a shared counter for every pixel.
+ */
+class DiffEngine
+{
+  DiffEngine() = delete;
+
+public:
+  static int countRow(const std::uint32_t *a, const std::uint32_t *b,
+                      int width);
+  static bool exceedsLimit(const FrameView &a, const FrameView &b,
+                           long long limit);
+  static bool sampledExceedsLimit(const FrameView &a, const FrameView &b,
+                                  long long limit, double errorRate,
+                                  long long *examined = nullptr);
+  static long long countDifferences(const FrameView &a, const FrameView &b);
+  static std::vector<DiffRegion> changedRegions(const FrameView &a,
+                                                const FrameView &b,
+                                                int cellSize = 16);
+  static const char *kernelName();
+};
+
+#endif // DIFFENGINE_H
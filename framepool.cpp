@@ -0,0 +1,202 @@
+#include "framepool.h"
+#include <QMutexLocker>
+#include <cstdlib>
+
+///\brief One of the pool's buffers.
+struct FramePool::Buffer
+{
+  ///\brief What is using the buffer.
+  enum State
+  {
+    Free,    ///< Nothing, it can be handed out.
+    Busy,    ///< A picture points at it.
+    Orphaned ///< A picture points at it, and the pool is gone.
+  };
+  ///\brief The pixels.
+  uchar *bits;
+  ///\brief The width of the pictures it holds.
+  int width;
+  ///\brief The height of the pictures it holds.
+  int height;
+  ///\brief The format of the pictures it holds.
+  QImage::Format format;
+  ///\brief What is using the buffer, changed from any thread.
+  std::atomic<int> state;
+};
+
+/*!
+ * \brief Creates an empty pool. Buffers are allocated when first needed.
+ * \param capacity The most buffers the pool will own. A buffer is needed for
+ * the last picture of each screen, one for each picture waiting in the
+ * pipeline and one for a difference image.
+ */
+FramePool::FramePool(int capacity)
+    : capacity(capacity), highWater(0), allocated(0), missed(0)
+{
+}
+
+/*!
+ * \brief Frees the free buffers.
+ * \details A buffer a picture still points at is left for release() to free
+ * once the picture goes away.
+ */
+FramePool::~FramePool()
+{
+  for(Buffer *buffer : buffers)
+  {
+    if(buffer->state.exchange(Buffer::Orphaned) == Buffer::Free)
+    {
+      std::free(buffer->bits);
+      delete buffer;
+    }
+  }
+}
+
+/*!
+ * \brief Gets a picture to fill, backed by one of the pool's buffers.
+ * \details The picture's pixels are left as the last picture in the buffer
+ * had them. Free buffers of another size or format, left over from a
+ * resolution change, are freed to make room.
+ * \param width The picture's width.
+ * \param height The picture's height.
+ * \param format A 32 bit format.
+ * \return The picture, backed by the heap rather than the pool if every
+ * buffer is busy, or null for another format.
+ */
+QImage FramePool::acquire(int width, int height, QImage::Format format)
+{
+  if(format != QImage::Format_RGB32 && format != QImage::Format_ARGB32 &&
+     format != QImage::Format_ARGB32_Premultiplied)
+    return QImage();
+  QMutexLocker locker(&buffersMutex);
+  Buffer *found = nullptr;
+  for(size_t i = 0; i < buffers.size() && !found;)
+  {
+    Buffer *buffer = buffers[i];
+    int expected = Buffer::Free;
+    if(buffer->width == width && buffer->height == height &&
+       buffer->format == format &&
+       buffer->state.compare_exchange_strong(expected, Buffer::Busy))
+    {
+      found = buffer;
+      continue;
+    }
+    expected = Buffer::Free;
+    if(static_cast<int>(buffers.size()) >= capacity &&
+       buffer->state.compare_exchange_strong(expected, Buffer::Orphaned))
+    {
+      std::free(buffer->bits);
+      delete buffer;
+      buffers.erase(buffers.begin() + i);
+      continue;
+    }
+    ++i;
+  }
+  if(!found && static_cast<int>(buffers.size()) < capacity)
+  {
+    uchar *bits = static_cast<uchar *>(
+        std::malloc(static_cast<size_t>(width) * height * 4));
+    if(bits)
+    {
+      found = new Buffer;
+      found->bits = bits;
+      found->width = width;
+      found->height = height;
+      found->format = format;
+      found->state = Buffer::Busy;
+      buffers.push_back(found);
+      ++allocated;
+    }
+  }
+  if(!found)
+  {
+    ++missed;
+    return QImage(width, height, format);
+  }
+  const int busy = busyCount();
+  if(busy > highWater)
+    highWater = busy;
+  return QImage(found->bits, width, height, width * 4, format, release,
+                found);
+}
+
+/*!
+ * \brief Frees every buffer no picture points at, such as while the user is
+ * away and no pictures are taken.
+ */
+void FramePool::trim()
+{
+  QMutexLocker locker(&buffersMutex);
+  for(size_t i = 0; i < buffers.size();)
+  {
+    Buffer *buffer = buffers[i];
+    int expected = Buffer::Free;
+    if(buffer->state.compare_exchange_strong(expected, Buffer::Orphaned))
+    {
+      std::free(buffer->bits);
+      delete buffer;
+      buffers.erase(buffers.begin() + i);
+    }
+    else
+      ++i;
+  }
+}
+
+/*!
+ * \brief Called by Qt when the last picture pointing at a buffer goes away.
+ * \details May be called from any thread, and after the pool is destroyed,
+ * in which case the buffer is freed.
+ * \param buffer The buffer.
+ */
+void FramePool::release(void *buffer)
+{
+  Buffer *released = static_cast<Buffer *>(buffer);
+  if(released->state.exchange(Buffer::Free) == Buffer::Orphaned)
+  {
+    std::free(released->bits);
+    delete released;
+  }
+}
+
+/*!
+ * \brief Counts the busy buffers, with buffersMutex held.
+ */
+int FramePool::busyCount() const
+{
+  int busy = 0;
+  for(const Buffer *buffer : buffers)
+    busy += buffer->state == Buffer::Busy;
+  return busy;
+}
+
+/*!
+ * \brief Gets how many buffers pictures point at right now.
+ * \return The number of busy buffers.
+ */
+int FramePool::inUse() const
+{
+  QMutexLocker locker(&buffersMutex);
+  return busyCount();
+}
+
+/*!
+ * \brief Gets the most buffers pictures pointed at at once.
+ * \details If this reaches the capacity, pictures were falling back to the
+ * heap, see fallbacks().
+ * \return The high-water mark since the pool was made.
+ */
+int FramePool::highWaterMark() const { return highWater; }
+
+/*!
+ * \brief Gets how many buffers were allocated, including those freed by a
+ * resolution change or trim().
+ * \return The number of allocations.
+ */
+int FramePool::allocations() const { return allocated; }
+
+/*!
+ * \brief Gets how many pictures were given heap memory because every buffer
+ * was busy.
+ * \return The number of pictures.
+ */
+int FramePool::fallbacks() const { return missed; }
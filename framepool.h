@@ -0,0 +1,50 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+#include <QImage>
+#include <QMutex>
+#include <atomic>
+#include <vector>
+
+/*!
+ * \brief A fixed number of full screen picture buffers, reused from one
+ * capture to the next.
+ * \details A picture from acquire() points at one of the pool's buffers
+ * rather than memory of its own, and hands the buffer back when the last
+ * copy of it goes away, on whichever thread that happens. The same few
+ * buffers then hold every capture, instead of the heap being asked for tens
+ * of megabytes several times a minute and left fragmented after weeks.
+ * Only 32 bit formats are pooled, so the pictures never need converting
+ * before the DiffEngine reads them. When every buffer is busy, acquire()
+ * falls back to an ordinary QImage rather than waiting.
+ */
+class FramePool
+{
+  struct Buffer;
+  static void release(void *buffer);
+  ///\brief Every buffer the pool owns.
+  std::vector<Buffer *> buffers;
+  ///\brief Guards buffers.
+  mutable QMutex buffersMutex;
+  ///\brief The most buffers the pool will own.
+  int capacity;
+  int busyCount() const;
+  ///\brief The most buffers that were busy at once.
+  std::atomic<int> highWater;
+  ///\brief How many buffers were ever allocated.
+  std::atomic<int> allocated;
+  ///\brief How many pictures could not be given a buffer.
+  std::atomic<int> missed;
+
+public:
+  explicit FramePool(int capacity = 4);
+  ~FramePool();
+  QImage acquire(int width, int height,
+                 QImage::Format format = QImage::Format_RGB32);
+  void trim();
+  int inUse() const;
+  int highWaterMark() const;
+  int allocations() const;
+  int fallbacks() const;
+};
+
+#endif // FRAMEPOOL_H
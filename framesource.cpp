@@ -0,0 +1,129 @@
+#include "framesource.h"
+
+/*!
+ * \brief Loads the pictures to play back.
+ * \details Files that can't be read are skipped.
+ * \param files The pictures, in the order they should be returned.
+ */
+ReplayFrameSource::ReplayFrameSource(const QStringList &files) : next(0)
+{
+  for(const QString &file : files)
+  {
+    QImage frame(file);
+    if(!frame.isNull())
+      frames.append(frame.convertToFormat(QImage::Format_RGB32));
+  }
+}
+
+/*!
+ * \brief Gets how many pictures could be loaded.
+ * \return The number of pictures played back before starting over.
+ */
+int ReplayFrameSource::frameCount() const { return frames.size(); }
+
+/*!
+ * \brief Returns the next picture as a single screen.
+ * \return One picture, or no pictures if none could be loaded.
+ */
+QList<QImage> ReplayFrameSource::grabScreens()
+{
+  QList<QImage> pictures;
+  if(frames.isEmpty())
+    return pictures;
+  pictures.append(frames.at(next));
+  next = (next + 1) % frames.size();
+  return pictures;
+}
+
+/*!
+ * \brief Gets the backend's name.
+ * \return "Replay"
+ */
+QString ReplayFrameSource::name() const { return "Replay"; }
+
+/*!
+ * \brief Makes the first picture.
+ * \param size The size of every picture.
+ * \param changeRatio How much of each picture changes, from 0 to 1.
+ * \param pattern Where the changed pixels go.
+ * \param seed Picks which pixels change and how.
+ */
+SyntheticFrameSource::SyntheticFrameSource(QSize size, double changeRatio,
+                                           Pattern pattern, quint32 seed)
+    : current(size, QImage::Format_RGB32), changeRatio(changeRatio),
+      pattern(pattern), state(seed ? seed : 1)
+{
+  for(int y = 0; y < current.height(); ++y)
+  {
+    QRgb *row = reinterpret_cast<QRgb *>(current.scanLine(y));
+    for(int x = 0; x < current.width(); ++x)
+      row[x] = qRgb(x & 0xFF, y & 0xFF, random() & 0x1F);
+  }
+}
+
+/*!
+ * \brief A xorshift random number generator, fast enough to not skew
+ * benchmarks.
+ * \return The next random number.
+ */
+quint32 SyntheticFrameSource::random()
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/*!
+ * \brief Makes the next picture by changing part of the last one.
+ * \details Scattered changes may land on the same pixel twice, so slightly
+ * fewer than changeRatio of the pixels can end up different.
+ * \return The new picture.
+ */
+QImage SyntheticFrameSource::nextFrame()
+{
+  QImage frame = current.copy();
+  const int width = frame.width();
+  const int height = frame.height();
+  const qint64 changes =
+      static_cast<qint64>(changeRatio * static_cast<double>(width) * height);
+  if(pattern == Scattered)
+  {
+    for(qint64 i = 0; i < changes; ++i)
+    {
+      QRgb *row = reinterpret_cast<QRgb *>(frame.scanLine(random() % height));
+      row[random() % width] ^= 0x00FFFFFF;
+    }
+  }
+  else if(changes > 0)
+  {
+    const int rows = static_cast<int>((changes + width - 1) / width);
+    const int top = static_cast<int>(random() % (height - rows + 1));
+    qint64 left = changes;
+    for(int y = top; y < top + rows && left > 0; ++y)
+    {
+      QRgb *row = reinterpret_cast<QRgb *>(frame.scanLine(y));
+      for(int x = 0; x < width && left > 0; ++x, --left)
+        row[x] ^= 0x00FFFFFF;
+    }
+  }
+  current = frame;
+  return frame;
+}
+
+/*!
+ * \brief Returns the next picture as a single screen.
+ * \return One picture, see nextFrame().
+ */
+QList<QImage> SyntheticFrameSource::grabScreens()
+{
+  QList<QImage> pictures;
+  pictures.append(nextFrame());
+  return pictures;
+}
+
+/*!
+ * \brief Gets the backend's name.
+ * \return "Synthetic"
+ */
+QString SyntheticFrameSource::name() const { return "Synthetic"; }
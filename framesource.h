@@ -0,0 +1,62 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+#include "capturebackend.h"
+#include <QSize>
+#include <QStringList>
+
+/*!
+ * \brief A capture backend that plays back pictures from files.
+ * \details Each call returns the next file as a single screen, starting over
+ * after the last one. Used to run QSnapper against recorded screens without a
+ * display.
+ */
+class ReplayFrameSource : public CaptureBackend
+{
+  ///\brief The pictures, already decoded.
+  QList<QImage> frames;
+  ///\brief The picture the next grab returns.
+  int next;
+
+public:
+  explicit ReplayFrameSource(const QStringList &files);
+  int frameCount() const;
+  virtual QList<QImage> grabScreens() override;
+  virtual QString name() const override;
+};
+
+/*!
+ * \brief A capture backend that makes up pictures with a set amount of change.
+ * \details The first picture is a noisy gradient. Every picture after it has
+ * exactly changeRatio of its pixels changed from the one before, either
+ * scattered over the screen or as a single block, so the cost of comparing
+ * pictures can be measured at a known amount of change. The same seed always
+ * gives the same pictures.
+ */
+class SyntheticFrameSource : public CaptureBackend
+{
+public:
+  ///\brief Where the changed pixels go.
+  enum Pattern
+  {
+    Scattered, ///< Spread randomly over the picture.
+    Block      ///< Together, in a band starting at a random row.
+  };
+  SyntheticFrameSource(QSize size, double changeRatio,
+                       Pattern pattern = Scattered, quint32 seed = 1);
+  QImage nextFrame();
+  virtual QList<QImage> grabScreens() override;
+  virtual QString name() const override;
+
+private:
+  quint32 random();
+  ///\brief The last picture made.
+  QImage current;
+  ///\brief How much of each picture changes, from 0 to 1.
+  double changeRatio;
+  ///\brief Where the changed pixels go.
+  Pattern pattern;
+  ///\brief The random number generator's state.
+  quint32 state;
+};
+
+#endif // FRAMESOURCE_H
@@ -0,0 +1,69 @@
+#include "idlesource.h"
+#include <QGuiApplication>
+#ifdef Q_OS_WIN
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#ifdef HAVE_XSS
+#include "xssidlesource.h"
+#endif
+
+namespace
+{
+#ifdef Q_OS_WIN
+/*!
+ * \brief Reads the time since the last input from Windows.
+ */
+class WinIdleSource : public IdleSource
+{
+public:
+  virtual qint64 idleMsecs() override
+  {
+    LASTINPUTINFO info;
+    info.cbSize = sizeof(info);
+    if(!GetLastInputInfo(&info))
+      return -1;
+    return GetTickCount() - info.dwTime;
+  }
+  virtual QString name() const override { return "Windows"; }
+};
+#endif
+}
+
+IdleSource::~IdleSource() {}
+
+/*!
+ * \brief Picks a source that works on this system.
+ * \details The XScreenSaver extension's idle counter is used on X11, and
+ * GetLastInputInfo on Windows. Elsewhere the user is never treated as idle.
+ * \return A new source, owned by the caller.
+ */
+IdleSource *IdleSource::create()
+{
+#ifdef HAVE_XSS
+  if(QGuiApplication::platformName() == "xcb")
+  {
+    XssIdleSource *xss = new XssIdleSource();
+    if(xss->isAvailable())
+      return xss;
+    delete xss;
+  }
+#endif
+#ifdef Q_OS_WIN
+  return new WinIdleSource();
+#else
+  return new NoIdleSource();
+#endif
+}
+
+/*!
+ * \brief Never reports the user as idle.
+ * \return -1
+ */
+qint64 NoIdleSource::idleMsecs() { return -1; }
+
+/*!
+ * \brief Gets the source's name.
+ * \return "None"
+ */
+QString NoIdleSource::name() const { return "None"; }
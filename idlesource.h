@@ -0,0 +1,36 @@
+#ifndef IDLESOURCE_H
+#define IDLESOURCE_H
+#include <QString>
+
+/*!
+ * \brief Something that can tell how long the user has been away.
+ * \details QSnapper asks one of these before each timed picture, and stops
+ * taking pictures while nobody is at the keyboard. Tests can hand the snapper
+ * their own subclass.
+ */
+class IdleSource
+{
+public:
+  virtual ~IdleSource();
+  /*!
+   * \brief Gets how long it has been since the last keyboard or mouse input.
+   * \return The time in milliseconds, or -1 if it can't be told.
+   */
+  virtual qint64 idleMsecs() = 0;
+  ///\brief A short name for the source, used in logs.
+  virtual QString name() const = 0;
+  static IdleSource *create();
+};
+
+/*!
+ * \brief Used where the system can't tell how long the user has been away,
+ * never reports the user as idle.
+ */
+class NoIdleSource : public IdleSource
+{
+public:
+  virtual qint64 idleMsecs() override;
+  virtual QString name() const override;
+};
+
+#endif // IDLESOURCE_H
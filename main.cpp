@@ -11,7 +11,7 @@
 *do so.
 */
 // clang-format command: clang-format -i *.cpp *.h
-#ifndef TEST
+#if !defined(TEST) && !defined(BENCHMARK)
 #include "qcompanion.h"
 #include <QApplication>
 
@@ -0,0 +1,377 @@
+#include "phrasestore.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+///\brief The start of a phrase store.
+struct FileHeader
+{
+  ///\brief PhraseStore::magic.
+  quint32 magic;
+  ///\brief PhraseStore::version.
+  quint32 version;
+  ///\brief The voice's name, NUL padded.
+  char voice[60];
+  ///\brief The synthesizer's version, NUL padded.
+  char engine[60];
+};
+
+///\brief The fixed part of a phrase's record.
+struct RecordHeader
+{
+  ///\brief The whole record's size, a multiple of 8.
+  quint32 recordSize;
+  ///\brief The size of the UTF-8 key that follows.
+  quint32 keyBytes;
+  ///\brief The samples per second.
+  qint32 sampleRate;
+  ///\brief The number of channels.
+  qint32 channels;
+  ///\brief How many samples there are per channel.
+  qint32 sampleCount;
+  ///\brief Unused, 0.
+  quint32 reserved;
+  ///\brief When the phrase was last added or found, in ms since the epoch.
+  qint64 lastUsed;
+};
+
+static_assert(sizeof(FileHeader) == PhraseStore::headerSize,
+              "FileHeader must match PhraseStore::headerSize");
+static_assert(sizeof(RecordHeader) == PhraseStore::recordHeaderSize,
+              "RecordHeader must match PhraseStore::recordHeaderSize");
+
+/*!
+ * \brief Rounds a size up to a multiple of 8, so every record and sample
+ * array stays aligned in the mapping.
+ */
+qint64 padded(qint64 bytes) { return (bytes + 7) & ~qint64(7); }
+
+/*!
+ * \brief Gets the size of a record.
+ */
+qint64 recordBytes(qint64 keyBytes, qint64 sampleBytes)
+{
+  return PhraseStore::recordHeaderSize + padded(keyBytes) +
+         padded(sampleBytes);
+}
+
+/*!
+ * \brief Makes the header for a voice and synthesizer version.
+ */
+FileHeader makeHeader(const QByteArray &voice, const QByteArray &engine)
+{
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.magic = PhraseStore::magic;
+  header.version = PhraseStore::version;
+  std::memcpy(header.voice, voice.constData(),
+              qMin<size_t>(voice.size(), sizeof(header.voice) - 1));
+  std::memcpy(header.engine, engine.constData(),
+              qMin<size_t>(engine.size(), sizeof(header.engine) - 1));
+  return header;
+}
+}
+
+const quint32 PhraseStore::magic;
+const quint32 PhraseStore::version;
+const int PhraseStore::headerSize;
+const int PhraseStore::recordHeaderSize;
+
+/*!
+ * \brief Creates audio with no samples.
+ */
+PhraseAudio::PhraseAudio()
+    : samples(nullptr), sampleCount(0), sampleRate(0), channels(0)
+{
+}
+
+/*!
+ * \brief Opens a store, or starts a new one if it is missing, damaged, or
+ * for another voice or synthesizer version.
+ * \param filePath The file.
+ * \param voice The name of the voice phrases are rendered with.
+ * \param engine The synthesizer's version.
+ * \param budget The most bytes the file may take.
+ */
+PhraseStore::PhraseStore(const QString &filePath, const QString &voice,
+                         const QString &engine, qint64 budget)
+    : filePath(filePath), voice(voice.toUtf8()), engine(engine.toUtf8()),
+      budget(budget), mappedSize(0)
+{
+  if(!open())
+    startOver();
+}
+
+/*!
+ * \brief Checks if the store could be opened or made.
+ * \return If phrases can be found and added.
+ */
+bool PhraseStore::isOpen() const { return mapping != nullptr; }
+
+/*!
+ * \brief Checks if a phrase is stored.
+ * \param key The phrase's key.
+ * \return If it is stored.
+ */
+bool PhraseStore::contains(const QString &key) const
+{
+  return records.contains(key);
+}
+
+/*!
+ * \brief Finds a phrase, and marks it as just used.
+ * \param key The phrase's key.
+ * \param audio Set to the phrase's samples, in the mapping.
+ * \return If the phrase was found.
+ */
+bool PhraseStore::find(const QString &key, PhraseAudio &audio)
+{
+  const qint64 offset = records.value(key, -1);
+  if(offset < 0 || !mapping)
+    return false;
+  uchar *record = mapping.get() + offset;
+  RecordHeader *header = reinterpret_cast<RecordHeader *>(record);
+  header->lastUsed = QDateTime::currentMSecsSinceEpoch();
+  audio.mapping = mapping;
+  audio.samples = reinterpret_cast<const short *>(
+      record + recordHeaderSize + padded(header->keyBytes));
+  audio.sampleCount = header->sampleCount;
+  audio.sampleRate = header->sampleRate;
+  audio.channels = header->channels;
+  return true;
+}
+
+/*!
+ * \brief Adds a phrase to the end of the file.
+ * \details If the file would go over its budget, the least recently used
+ * phrases are dropped first, see compact().
+ * \param key The phrase's key.
+ * \param samples The 16 bit samples, interleaved by channel.
+ * \param sampleCount How many samples there are per channel.
+ * \param sampleRate The samples per second.
+ * \param channels The number of channels.
+ * \return If the phrase is stored, false if it is bigger than the budget or
+ * the file couldn't be written.
+ */
+bool PhraseStore::add(const QString &key, const short *samples,
+                      int sampleCount, int sampleRate, int channels)
+{
+  if(!mapping || key.isEmpty() || sampleCount < 0 || channels < 1)
+    return false;
+  if(records.contains(key))
+    return true;
+  const QByteArray keyBytes = key.toUtf8();
+  const qint64 sampleBytes =
+      static_cast<qint64>(sampleCount) * channels * sizeof(short);
+  const qint64 size = recordBytes(keyBytes.size(), sampleBytes);
+  if(headerSize + size > budget)
+    return false;
+  if(mappedSize + size > budget && !compact(size))
+    return false;
+
+  RecordHeader header;
+  std::memset(&header, 0, sizeof(header));
+  header.recordSize = static_cast<quint32>(size);
+  header.keyBytes = static_cast<quint32>(keyBytes.size());
+  header.sampleRate = sampleRate;
+  header.channels = channels;
+  header.sampleCount = sampleCount;
+  header.lastUsed = QDateTime::currentMSecsSinceEpoch();
+  const QByteArray padding(8, '\0');
+  QFile file(filePath);
+  if(!file.open(QIODevice::Append))
+    return false;
+  const qint64 offset = file.size();
+  if(file.write(reinterpret_cast<const char *>(&header), sizeof(header)) !=
+         sizeof(header) ||
+     file.write(keyBytes) != keyBytes.size() ||
+     file.write(padding.constData(),
+                padded(keyBytes.size()) - keyBytes.size()) < 0 ||
+     file.write(reinterpret_cast<const char *>(samples), sampleBytes) !=
+         sampleBytes ||
+     file.write(padding.constData(), padded(sampleBytes) - sampleBytes) < 0)
+  {
+    file.resize(offset);
+    return false;
+  }
+  file.close();
+  records.insert(key, offset);
+  return remap();
+}
+
+/*!
+ * \brief Counts the stored phrases.
+ * \return The number of phrases.
+ */
+int PhraseStore::count() const { return records.size(); }
+
+/*!
+ * \brief Gets the file's size.
+ * \return The size in bytes, 0 if the store isn't open.
+ */
+qint64 PhraseStore::size() const { return mappedSize; }
+
+/*!
+ * \brief Opens the file and indexes its records.
+ * \details A record cut short at the end, from a crash while adding, is cut
+ * off so the next phrase is added after the last whole one.
+ * \return If the file exists and was made for this voice and synthesizer.
+ */
+bool PhraseStore::open()
+{
+  QFile file(filePath);
+  if(!file.open(QIODevice::ReadOnly))
+    return false;
+  FileHeader header;
+  if(file.read(reinterpret_cast<char *>(&header), sizeof(header)) !=
+     sizeof(header))
+    return false;
+  const FileHeader expected = makeHeader(voice, engine);
+  if(std::memcmp(&header, &expected, sizeof(header)) != 0)
+    return false;
+  file.close();
+  if(!remap())
+    return false;
+  qint64 offset = headerSize;
+  while(offset + recordHeaderSize <= mappedSize)
+  {
+    RecordHeader record;
+    std::memcpy(&record, mapping.get() + offset, sizeof(record));
+    const qint64 sampleBytes =
+        static_cast<qint64>(record.sampleCount) * record.channels *
+        sizeof(short);
+    if(record.keyBytes == 0 || record.channels < 1 ||
+       record.sampleCount < 0 ||
+       record.recordSize != recordBytes(record.keyBytes, sampleBytes) ||
+       offset + record.recordSize > mappedSize)
+      break;
+    records.insert(
+        QString::fromUtf8(reinterpret_cast<const char *>(mapping.get()) +
+                              offset + recordHeaderSize,
+                          record.keyBytes),
+        offset);
+    offset += record.recordSize;
+  }
+  if(offset == mappedSize)
+    return true;
+  mapping.reset();
+  return QFile::resize(filePath, offset) && remap();
+}
+
+/*!
+ * \brief Maps the whole file again, after it grew or was replaced.
+ * \details The old mapping is only unmapped once no PhraseAudio points into
+ * it.
+ * \return If the file was mapped.
+ */
+bool PhraseStore::remap()
+{
+  mapping.reset();
+  mappedSize = 0;
+  QFile *file = new QFile(filePath);
+  uchar *base = nullptr;
+  if(file->open(QIODevice::ReadWrite))
+    base = file->map(0, file->size());
+  if(!base)
+  {
+    delete file;
+    return false;
+  }
+  mappedSize = file->size();
+  mapping = std::shared_ptr<uchar>(base, [file](uchar *mapped)
+                                   {
+    file->unmap(mapped);
+    delete file;
+  });
+  return true;
+}
+
+/*!
+ * \brief Drops the least recently used phrases.
+ * \details The rest are written to a new file, most recently used first,
+ * until it is three quarters of the budget, so compacting doesn't happen
+ * again on the very next phrase, and has room for the phrase being added.
+ * \param spaceNeeded The size of the record about to be added.
+ * \return If the new file replaced the old one.
+ */
+bool PhraseStore::compact(qint64 spaceNeeded)
+{
+  std::vector<std::pair<qint64, qint64>> byUse;
+  for(QHash<QString, qint64>::const_iterator record = records.constBegin();
+      record != records.constEnd(); ++record)
+  {
+    const RecordHeader *header =
+        reinterpret_cast<const RecordHeader *>(mapping.get() + record.value());
+    byUse.push_back(std::make_pair(header->lastUsed, record.value()));
+  }
+  std::sort(byUse.rbegin(), byUse.rend());
+
+  const QString partPath = filePath + ".part";
+  QFile part(partPath);
+  if(!part.open(QIODevice::WriteOnly))
+    return false;
+  const FileHeader header = makeHeader(voice, engine);
+  part.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  const qint64 target = qMin(budget * 3 / 4, budget - spaceNeeded);
+  QHash<QString, qint64> kept;
+  for(const std::pair<qint64, qint64> &use : byUse)
+  {
+    const uchar *record = mapping.get() + use.second;
+    const RecordHeader *recordHeader =
+        reinterpret_cast<const RecordHeader *>(record);
+    if(part.size() + recordHeader->recordSize > target)
+      break;
+    kept.insert(QString::fromUtf8(
+                    reinterpret_cast<const char *>(record) + recordHeaderSize,
+                    recordHeader->keyBytes),
+                part.size());
+    if(part.write(reinterpret_cast<const char *>(record),
+                  recordHeader->recordSize) != recordHeader->recordSize)
+      return false;
+  }
+  part.close();
+  if(!replaceWith(partPath))
+    return false;
+  records = kept;
+  return remap();
+}
+
+/*!
+ * \brief Replaces the file with an empty one for this voice and synthesizer.
+ * \return If the new file was made and mapped.
+ */
+bool PhraseStore::startOver()
+{
+  records.clear();
+  QDir().mkpath(QFileInfo(filePath).path());
+  const QString partPath = filePath + ".part";
+  QFile part(partPath);
+  const FileHeader header = makeHeader(voice, engine);
+  if(!part.open(QIODevice::WriteOnly) ||
+     part.write(reinterpret_cast<const char *>(&header), sizeof(header)) !=
+         sizeof(header))
+    return false;
+  part.close();
+  return replaceWith(partPath) && remap();
+}
+
+/*!
+ * \brief Moves a finished file over the store's file.
+ * \details The old file is unlinked rather than truncated, so mappings of it
+ * that are still playing keep their pages.
+ * \param partPath The finished file.
+ * \return If it replaced the old one.
+ */
+bool PhraseStore::replaceWith(const QString &partPath)
+{
+  mapping.reset();
+  mappedSize = 0;
+  QFile::remove(filePath);
+  return QFile::rename(partPath, filePath);
+}
@@ -0,0 +1,79 @@
+#ifndef PHRASESTORE_H
+#define PHRASESTORE_H
+#include <QHash>
+#include <QString>
+#include <memory>
+
+///\brief A phrase's audio, read straight out of a PhraseStore's mapping.
+struct PhraseAudio
+{
+  PhraseAudio();
+  ///\brief Keeps the mapping the samples are in alive.
+  std::shared_ptr<uchar> mapping;
+  ///\brief The 16 bit samples, interleaved by channel.
+  const short *samples;
+  ///\brief How many samples there are per channel.
+  int sampleCount;
+  ///\brief The samples per second.
+  int sampleRate;
+  ///\brief The number of channels.
+  int channels;
+};
+
+/*!
+ * \brief Rendered phrases kept on disk between runs, in one memory-mapped
+ * file.
+ * \details The file starts with a header naming the voice and synthesizer
+ * version it was made with. If either changed, the phrases would sound wrong,
+ * so the file is started again. Each record holds a phrase's key, format and
+ * samples, padded to 8 bytes, along with when it was last used. At startup
+ * the records are walked once to index the keys, and found phrases are played
+ * from the mapping without being copied.
+ * When adding a phrase would take the file over its budget, the least
+ * recently used phrases are dropped by writing a new file with the rest.
+ * Phrases still playing from the old file stay valid, since they keep its
+ * mapping.
+ */
+class PhraseStore
+{
+  bool open();
+  bool remap();
+  bool compact(qint64 spaceNeeded);
+  bool startOver();
+  bool replaceWith(const QString &partPath);
+  ///\brief The file.
+  QString filePath;
+  ///\brief The voice the phrases must have been rendered with.
+  QByteArray voice;
+  ///\brief The synthesizer version the phrases must have been rendered with.
+  QByteArray engine;
+  ///\brief The most bytes the file may take.
+  qint64 budget;
+  ///\brief The file's current mapping, or nullptr if there is none.
+  std::shared_ptr<uchar> mapping;
+  ///\brief How many bytes are mapped.
+  qint64 mappedSize;
+  ///\brief Where each phrase's record starts, by key.
+  QHash<QString, qint64> records;
+
+public:
+  ///\brief Identifies a file as a phrase store.
+  static const quint32 magic = 0x51535053;
+  ///\brief The format version written into new files.
+  static const quint32 version = 1;
+  ///\brief The size of the file's header.
+  static const int headerSize = 128;
+  ///\brief The size of a record's fixed part.
+  static const int recordHeaderSize = 32;
+  PhraseStore(const QString &filePath, const QString &voice,
+              const QString &engine, qint64 budget);
+  bool isOpen() const;
+  bool contains(const QString &key) const;
+  bool find(const QString &key, PhraseAudio &audio);
+  bool add(const QString &key, const short *samples, int sampleCount,
+           int sampleRate, int channels);
+  int count() const;
+  qint64 size() const;
+};
+
+#endif // PHRASESTORE_H
@@ -2,6 +2,7 @@
 #include <QTimer>
 #include <QClipboard>
 #include <QMenu>
+#include <QSettings>
 #include "qcompanion.h"
 #include "ui_qcompanion.h"
 #include "waitercomponent.h"
@@ -75,18 +76,24 @@ void QCompanion::quit() { QApplication::exit(0); }
  * \brief Loads all the components.
  * \details Loads all the plugins and adds them to the main menu.
  * Additionally it creates the timers for the screenshot logger and components.
+ * Each component speaks at its own Speaker::Priority, read from
+ * <Component>_SpeechPriority: QWaiter's alarms are urgent, and Qlipper's
+ * clipboard reads are low.
  * \return a menu with the component's options in it, to be added to the system
  * tray.
  */
 QMenu *QCompanion::loadPlugins()
 {
   QMenu *mainMenu = new QMenu(this);
+  QSettings settings;
 
   snapper = new QSnapper(this);
   QMenu *snapperMenu = new QMenu("QSnapper", this);
   snapperMenu->addActions(snapper->getMenuContents());
   plugins.push_back(snapper);
   mainMenu->addMenu(snapperMenu);
+  speechPriorities[snapper] =
+      settings.value("QSnapper_SpeechPriority", Speaker::Normal).toInt();
   connect(snapper, SIGNAL(wantsToSpeak(QString)), this,
           SLOT(sendToSpeaker(QString)));
 
@@ -95,6 +102,8 @@ QMenu *QCompanion::loadPlugins()
   hourMenu->addActions(hr->getMenuContents());
   plugins.push_back(hr);
   mainMenu->addMenu(hourMenu);
+  speechPriorities[hr] =
+      settings.value("HourReader_SpeechPriority", Speaker::Normal).toInt();
   connect(hr, SIGNAL(wantsToSpeak(QString)), this,
           SLOT(sendToSpeaker(QString)));
 
@@ -103,6 +112,8 @@ QMenu *QCompanion::loadPlugins()
   waiterMenu->addActions(waiter->getMenuContents());
   plugins.push_back(waiter);
   mainMenu->addMenu(waiterMenu);
+  speechPriorities[waiter] =
+      settings.value("QWaiter_SpeechPriority", Speaker::Urgent).toInt();
   connect(waiter, SIGNAL(wantsToSpeak(QString)), this,
           SLOT(sendToSpeaker(QString)));
 
@@ -111,6 +122,8 @@ QMenu *QCompanion::loadPlugins()
   qlipperMenu->addActions(qlipper->getMenuContents());
   plugins.push_back(qlipper);
   mainMenu->addMenu(qlipperMenu);
+  speechPriorities[qlipper] =
+      settings.value("Qlipper_SpeechPriority", Speaker::Low).toInt();
   connect(qlipper, SIGNAL(wantsToSpeak(QString)), this,
           SLOT(sendToSpeaker(QString)));
   return mainMenu;
@@ -123,7 +136,7 @@ void QCompanion::speakClipboard()
 {
   QClipboard *board = QApplication::clipboard();
   QString text = board->text();
-  speaker.speak(text.toUtf8());
+  speaker.speakWithPriority(text.toUtf8(), Speaker::Low);
 }
 
 /*!
@@ -162,14 +175,17 @@ void QCompanion::toggleTTS()
 
 /*!
  * \brief Sends text to the speaker
+ * \details Text from a component is queued at that component's priority,
+ * anything else, such as D-Bus calls, at Speaker::Normal.
  * \param sayMe What the speaker should say/notify.
  */
 void QCompanion::sendToSpeaker(QString sayMe)
 {
+  const int priority = speechPriorities.value(sender(), Speaker::Normal);
   if(!sayMe.isEmpty())
   {
     for(QString s : sayMe.split("\n"))
-      speaker.speak(s);
+      speaker.speakWithPriority(s, priority);
   }
 }
 
@@ -1,6 +1,7 @@
 #ifndef QCOMPANION_H
 #define QCOMPANION_H
 #include <QDialog>
+#include <QHash>
 #include <QSystemTrayIcon>
 #include "speaker.h"
 #include "qsnapper.h"
@@ -40,6 +41,8 @@ private:
   ///\brief A list of plugins, consisting of the component and when it wants to
   /// be read.
   std::vector<Component *> plugins;
+  ///\brief The Speaker::Priority each component speaks at.
+  QHash<QObject *, int> speechPriorities;
   ///\brief The class that manages interfacing with the text to speech and
   /// notification systems.
   Speaker speaker;
@@ -1,19 +1,24 @@
 #include "qsnapper.h"
+#include "diffengine.h"
+#include "tilehasher.h"
+#include "snaparchive.h"
+#include "capturebackend.h"
+#include "contentstore.h"
+#include "timelineindex.h"
+#include "similarityindex.h"
+#include "savefolderlock.h"
+#ifdef HAVE_LIBJPEG
+#include "stripjpegencoder.h"
+#endif
 #include <QFileDialog>
-#include <QPixmap>
-#include <QApplication>
-#include <QDesktopWidget>
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
 #include <tbb/parallel_for.h>
 #include <atomic>
-#include <mutex>
 #include <iostream>
-#if QT_VERSION >= 0x050000
-#include <QScreen>
-#endif
-#ifdef Q_OS_WIN
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-#else
+#ifndef Q_OS_WIN
 #include "dbusadaptor.h"
 #endif
 
@@ -27,11 +32,11 @@
  * Management.
  */
 QSnapper::QSnapper(QWidget *parent)
-    : Component(parent), nextWakeup(QDateTime::currentDateTime().addSecs(60))
-#ifndef Q_OS_WIN
-      ,
-      screensaver("org.freedesktop.ScreenSaver", "/ScreenSaver")
-#endif
+    : Component(parent), nextWakeup(QDateTime::currentDateTime().addSecs(60)),
+      similarFrames(nullptr), timelineDialog(nullptr), burstInterval(1000),
+      burstLength(0), burstStopped(0), burstTicks(0),
+      framePool(settings.value("QSnapper_FramePoolSize", 6).toInt()),
+      archiveFailures(0), seenArchiveFailures(0)
 {
   QVariant logSetting = settings.value("QSnapper_Enable", false);
   canSnap = logSetting.toBool();
@@ -50,18 +55,56 @@ QSnapper::QSnapper(QWidget *parent)
   lenientOption->setCheckable(true);
   lenient = lenientSetting.toBool();
   lenientOption->setChecked(lenient);
-  toggleDiffAction->setEnabled(lenient);
+
+  QVariant regionsSetting = settings.value("QSnapper_DiffRegions", false);
+  diffRegions = regionsSetting.toBool();
+
+  QVariant tileHashSetting = settings.value("QSnapper_TileHash", false);
+  tileHashing = tileHashSetting.toBool();
+
+  QVariant archiveSetting = settings.value("QSnapper_Archive", false);
+  archiving = archiveSetting.toBool();
+  keyframeInterval = settings.value("QSnapper_KeyframeInterval", 60).toInt();
+  contentStoring = settings.value("QSnapper_ContentStore", false).toBool();
+  jpegQuality = settings.value("QSnapper_JpegQuality", 75).toInt();
+  sampleErrorRate =
+      settings.value("QSnapper_SampleErrorRate", 0.001).toDouble();
+  toggleDiffAction->setEnabled(lenient && !tileHashing && !archiving);
 
   QVariant mutedSetting = settings.value("QSnapper_Muted", true);
   muted = mutedSetting.toBool();
   muteAction->setChecked(muted);
 
+  cadence.setBounds(
+      settings.value("QSnapper_MinInterval", 60).toInt() * 1000,
+      settings.value("QSnapper_MaxInterval", 1800).toInt() * 1000);
+  changedSinceTick = true;
   whenToSpeak.setSingleShot(false);
-  whenToSpeak.setInterval(60000);
+  whenToSpeak.setInterval(cadence.interval());
   connect(&whenToSpeak, SIGNAL(timeout()), this, SLOT(emitSpeak()));
+  connect(this, SIGNAL(frameChanged()), this, SLOT(recordChange()),
+          Qt::QueuedConnection);
+  idleSuspend = settings.value("QSnapper_IdleSuspend", 300).toLongLong() * 1000;
+  idle = IdleSource::create();
+  idlePoll.setInterval(1000);
+  connect(&idlePoll, SIGNAL(timeout()), this, SLOT(checkForInput()));
+  compactor = new SnapCompactor(this);
+  connect(compactor, SIGNAL(finished()), this, SLOT(reloadSimilarFrames()));
+  similarityRebuilder = new SimilarityRebuilder(this);
+  connect(similarityRebuilder, SIGNAL(finished()), this,
+          SLOT(reloadSimilarFrames()));
+  screensaver = ScreensaverSource::create(this);
   connect(muteAction, SIGNAL(triggered(bool)), this,
           SLOT(setMuteSettings(bool)));
   connect(toggleDiffAction, SIGNAL(triggered(bool)), this, SLOT(setDiff(bool)));
+  burstAction = new QAction("Record Burst", this);
+  burstAction->setCheckable(true);
+  connect(burstAction, SIGNAL(triggered(bool)), this, SLOT(setBurst(bool)));
+  burstTimer.setTimerType(Qt::PreciseTimer);
+  connect(&burstTimer, SIGNAL(timeout()), this, SLOT(burstTick()));
+  reportDifferences = false;
+  capture = CaptureBackend::create(&framePool);
+  pipeline = createPipeline();
   emitSpeak();
 #ifndef Q_OS_WIN
   new QsnapperAdaptor(this);
@@ -73,9 +116,34 @@ QSnapper::QSnapper(QWidget *parent)
 }
 
 /*!
- * \brief Destroys the QSnapper, does nothing interesting.
+ * \brief Destroys the QSnapper, after letting queued pictures finish saving.
+ * \details The pipeline's stages use this object's members, so it is stopped
+ * here rather than left to Qt's child cleanup. The kept pictures may point
+ * into the capture backend's memory, so they go before it does.
  */
-QSnapper::~QSnapper() {}
+QSnapper::~QSnapper()
+{
+  delete pipeline;
+  screens.clear();
+  delete capture;
+  delete idle;
+  delete similarFrames;
+}
+
+/*!
+ * \brief Starts a pipeline running this snapper's stages.
+ * \return The new pipeline, already connected to announceSave().
+ */
+SnapPipeline *QSnapper::createPipeline()
+{
+  SnapPipeline *newPipeline = new SnapPipeline(
+      this, [this](SnapJob &job) { return diffStage(job); },
+      [this](SnapJob &job) { return encodeStage(job); },
+      [this](SnapJob &job) { return writeStage(job); }, 4);
+  connect(newPipeline, SIGNAL(saved(QString, QDateTime)), this,
+          SLOT(announceSave(QDateTime)));
+  return newPipeline;
+}
 
 /*!
  * \brief Gets what to say aloud and notify
@@ -104,12 +172,17 @@ QList<QAction *> QSnapper::getMenuContents()
 
   actions.append(lenientOption);
   actions.append(toggleDiffAction);
+  actions.append(burstAction);
+
+  QAction *browseAction = new QAction("Browse Captures", this);
+  actions.append(browseAction);
 
   connect(changeFolderAction, SIGNAL(triggered()), this,
           SLOT(changeSaveFolder()));
   connect(enableLogging, SIGNAL(triggered(bool)), this,
           SLOT(enableSnapping(bool)));
   connect(lenientOption, SIGNAL(triggered(bool)), this, SLOT(setLenient(bool)));
+  connect(browseAction, SIGNAL(triggered()), this, SLOT(showTimeline()));
   return actions;
 }
 
@@ -119,6 +192,94 @@ QList<QAction *> QSnapper::getMenuContents()
  */
 bool QSnapper::isEnabled() { return canSnap; }
 
+/*!
+ * \brief Lets the pipeline save what it holds, then deletes it, keeping its
+ * counts in retiredCounts. A new one must be made before the next picture.
+ */
+void QSnapper::retirePipeline()
+{
+  pipeline->finish();
+  const SnapCounts counts = pipeline->counts();
+  retiredCounts.dropped += counts.dropped;
+  retiredCounts.skipped += counts.skipped;
+  retiredCounts.failed += counts.failed;
+  retiredCounts.saved += counts.saved;
+  delete pipeline;
+  pipeline = nullptr;
+}
+
+/*!
+ * \brief Counts what became of every picture since the snapper started,
+ * across every pipeline it made.
+ * \return The counts.
+ */
+SnapCounts QSnapper::frameCounts() const
+{
+  SnapCounts counts = pipeline->counts();
+  counts.dropped += retiredCounts.dropped;
+  counts.skipped += retiredCounts.skipped;
+  counts.failed += retiredCounts.failed;
+  counts.saved += retiredCounts.saved;
+  return counts;
+}
+
+/*!
+ * \brief Replaces where pictures come from, for example with a
+ * SyntheticFrameSource when there is no display.
+ * \details Waits for queued pictures to be saved first, and forgets the last
+ * picture of each screen, since it may point into the old backend's memory.
+ * \param backend The new backend, the snapper takes ownership of it.
+ */
+void QSnapper::setCaptureBackend(CaptureBackend *backend)
+{
+  retirePipeline();
+  screens.clear();
+  delete capture;
+  capture = backend;
+  pipeline = createPipeline();
+}
+
+/*!
+ * \brief Replaces what tells how long the user has been away, for example
+ * with a fake one in tests.
+ * \param source The new source, the snapper takes ownership of it.
+ */
+void QSnapper::setIdleSource(IdleSource *source)
+{
+  delete idle;
+  idle = source;
+}
+
+/*!
+ * \brief Replaces what tells if the screensaver is running, for example with
+ * a fake one in tests.
+ * \param source The new source, the snapper takes ownership of it.
+ */
+void QSnapper::setScreensaverSource(ScreensaverSource *source)
+{
+  delete screensaver;
+  screensaver = source;
+  screensaver->setParent(this);
+}
+
+/*!
+ * \brief Sets the folder pictures are saved to, for this run only.
+ * \details The save folder's indexes are read again when next needed.
+ * \param dir The folder.
+ */
+void QSnapper::setSaveDirectory(const QString &dir)
+{
+  saveDir = dir;
+  delete similarFrames;
+  similarFrames = nullptr;
+}
+
+/*!
+ * \brief Checks if timed pictures are stopped because the user is away.
+ * \return True while waiting for the user's return.
+ */
+bool QSnapper::isSuspendedForIdle() const { return idlePoll.isActive(); }
+
 /*!
  * \brief Prompts the user to pick which folder the screenshots should be logged
  *to.
@@ -131,20 +292,44 @@ void QSnapper::changeSaveFolder()
       this, "Open Directory", "~/Pictures", QFileDialog::ShowDirsOnly);
   if(!dir.isNull())
   {
-    saveDir = dir;
+    setSaveDirectory(dir);
     settings.setValue("QSnapper_Directory", dir);
   }
 }
 
+/*!
+ * \brief Shows the window for browsing the pictures in the save folder.
+ * \details The window is only built the first time, and picks up pictures
+ * taken since it was last shown.
+ */
+void QSnapper::showTimeline()
+{
+  if(!timelineDialog)
+  {
+    timelineDialog = new SnapTimelineDialog(saveDir, this);
+    timelineDialog->setWindowFlags(Qt::Window);
+  }
+  else
+  {
+    timelineDialog->setDirectory(saveDir);
+    timelineDialog->refresh();
+  }
+  timelineDialog->show();
+  timelineDialog->raise();
+}
+
 /*!
  * \brief Sets if pictures should be taken.
  * \details Sets if pictures should be taken and logs it in the global QSettings
+ * Enabling goes back to the shortest wait between pictures.
  * \param enable If taking pictures should be enabled.
  */
 void QSnapper::enableSnapping(bool enable)
 {
   canSnap = enable;
   settings.setValue("QSnapper_Enable", enable);
+  if(enable)
+    whenToSpeak.start(cadence.recordChanged());
 }
 
 /*!
@@ -155,7 +340,7 @@ void QSnapper::setLenient(bool isLenient)
 {
   lenient = isLenient;
   settings.setValue("QSnapper_Lenient", isLenient);
-  toggleDiffAction->setEnabled(lenient);
+  toggleDiffAction->setEnabled(lenient && !tileHashing && !archiving);
 }
 
 /*!
@@ -179,54 +364,147 @@ void QSnapper::setDiff(bool enable)
   saveDifferenceImage = enable;
 }
 
+/*!
+ * \brief Sets if difference images should only hold the changed areas, and
+ * stores it into settings.
+ * \param enable If only changed areas should be saved.
+ */
+void QSnapper::setDiffRegions(bool enable)
+{
+  settings.setValue("QSnapper_DiffRegions", enable);
+  diffRegions = enable;
+}
+
+/*!
+ * \brief Sets if only tile hashes of the last picture should be kept, and
+ * stores it into settings.
+ * \details Switching either way drops what was kept for the other mode, so
+ * the next picture is always treated as new. The switch takes effect from the
+ * next picture grabbed.
+ * \param enable If tile hashing should be used.
+ */
+void QSnapper::setTileHashing(bool enable)
+{
+  settings.setValue("QSnapper_TileHash", enable);
+  tileHashing = enable;
+  toggleDiffAction->setEnabled(lenient && !tileHashing && !archiving);
+}
+
+/*!
+ * \brief Sets if pictures should go into a daily archive of keyframes and
+ * changed tiles instead of a file each, and stores it into settings.
+ * \details Difference images are unavailable while archiving.
+ * \param enable If pictures should be archived.
+ */
+void QSnapper::setArchive(bool enable)
+{
+  settings.setValue("QSnapper_Archive", enable);
+  archiving = enable;
+  toggleDiffAction->setEnabled(lenient && !tileHashing && !archiving);
+}
+
+/*!
+ * \brief Sets if each distinct picture should only be saved once, and stores
+ * it into settings.
+ * \details Pictures go into a ContentStore in the save folder. Archiving
+ * takes precedence while it is on.
+ * \param enable If pictures should be kept in the content store.
+ */
+void QSnapper::setContentStore(bool enable)
+{
+  settings.setValue("QSnapper_ContentStore", enable);
+  contentStoring = enable;
+}
+
+/*!
+ * \brief Saves an archived picture as a plain image file.
+ * \param when The time to export, written like the picture file names
+ * (yyyyMMddhhmmss). The last picture taken at or before then is used.
+ * \param screen Which screen to export. When only one screen was being
+ * pictured its archive has no screen number, and screen 0 finds it.
+ * \param fileName Where to save it, the extension picks the format (.jpg,
+ * .png, etc).
+ * \return If a picture was found and saved.
+ */
+bool QSnapper::exportArchivedFrame(QString when, int screen,
+                                   QString fileName)
+{
+  const QDateTime time = QDateTime::fromString(when, "yyyyMMddhhmmss");
+  if(!time.isValid())
+    return false;
+  QString path = SnapArchiveWriter::archiveName(saveDir, time.date(),
+                                               '-' + QString::number(screen));
+  if(!QFile::exists(path) && screen == 0)
+    path = SnapArchiveWriter::archiveName(saveDir, time.date());
+  SnapArchiveReader reader(path);
+  return reader.isValid() && reader.exportFrame(time, fileName);
+}
+
+/*!
+ * \brief Brings two images to a shared 32 bit format so their scanlines can be
+ * compared word for word.
+ * \details Captures are normally already RGB32, in which case nothing is
+ * converted or copied.
+ * \param image The image to normalize.
+ * \param other The image it will be compared to.
+ * \return image, or a converted copy of it.
+ */
+static QImage normalizedFrame(const QImage &image, const QImage &other)
+{
+  const QImage::Format format = image.format();
+  if(format == other.format() &&
+     (format == QImage::Format_RGB32 || format == QImage::Format_ARGB32 ||
+      format == QImage::Format_ARGB32_Premultiplied))
+    return image;
+  return image.convertToFormat(QImage::Format_ARGB32);
+}
+
+/*!
+ * \brief Wraps a 32 bit image's pixel memory for the DiffEngine.
+ * \param image A normalized image, see normalizedFrame.
+ * \return A view of image's scanlines.
+ */
+static FrameView frameView(const QImage &image)
+{
+  return {image.constScanLine(0), image.width(), image.height(),
+          image.bytesPerLine()};
+}
+
 /*!
  * \brief Compares two images, and if they are different enough(1% of the
  * screen), returns true
- * \details Uses a loop through all the x pixels and the y pixels, and compares
- * them. The "X loop" is done in parallel using TBB.
+ * \details A sample of pixels is compared first, which settles most
+ * comparisons after looking at well under 1% of the screen. Only when the
+ * sample is too close to the limit to tell are both images walked row by row
+ * through their scanline memory using the DiffEngine, which spreads the rows
+ * across TBB workers and stops as soon as the limit is crossed.
  * \param oldImage the old image
  * \param newImage the new image, if this returns true, it will be saved.
+ * \param errorRate The chance of a wrong answer tolerated from the sample, 0
+ * to always compare every pixel.
  * \return True if the images differ.
  */
-bool QSnapper::imagesDiffer(const QImage oldImage, const QImage newImage)
+bool QSnapper::imagesDiffer(const QImage oldImage, const QImage newImage,
+                            double errorRate)
 {
-  bool exceedsDiffenceLimit = false;
-  if(oldImage.width() == newImage.width() &&
-     oldImage.height() == newImage.height())
-  {
-    std::atomic_int difference(0);
-    const int height = oldImage.height();
-    const int width = oldImage.width();
-    const int differenceLimit = (height * width) / 100;
-    tbb::parallel_for(tbb::blocked_range<int>(0, width),
-                      [&](const tbb::blocked_range<int> &range)
-                      {
-      for(int i = range.begin(); i != range.end(); ++i)
-      {
-        for(int j = 0; j < height; ++j)
-        {
-          if(exceedsDiffenceLimit)
-            return;
-          if(oldImage.pixel(i, j) != newImage.pixel(i, j))
-            ++difference;
-          if(difference > differenceLimit)
-          {
-            exceedsDiffenceLimit = true;
-          }
-        }
-      }
-    });
-  }
-  else
-  {
+  if(oldImage.width() != newImage.width() ||
+     oldImage.height() != newImage.height())
     return true;
-  }
-  return exceedsDiffenceLimit;
+  const QImage oldFrame = normalizedFrame(oldImage, newImage);
+  const QImage newFrame = normalizedFrame(newImage, oldImage);
+  const long long differenceLimit =
+      (static_cast<long long>(newFrame.height()) * newFrame.width()) / 100;
+  return DiffEngine::sampledExceedsLimit(
+      frameView(oldFrame), frameView(newFrame), differenceLimit, errorRate);
 }
 
 /*!
  * \brief Compares two images, and if they are different enough(1% of the
  * screen), returns true. Also saves a new image of where they differ.
+ * \details Rows are compared with the DiffEngine's row kernel first, so only
+ * rows that actually changed are walked pixel by pixel. Each TBB worker owns
+ * the rows it is given, writing them straight into the difference image's
+ * memory and keeping its own count, so no locks are needed.
  * \param oldImage the old image
  * \param newImage the new image, if this returns true, it will be saved.
  * \param filename the name of the generated difference file
@@ -238,45 +516,54 @@ bool QSnapper::imagesDiffer(const QImage oldImage, const QImage newImage,
   bool exceedsDiffenceLimit = true;
   const int height = oldImage.height();
   const int width = oldImage.width();
-  QImage diff(width, height, oldImage.format());
+  QImage diff;
   if(width == newImage.width() && height == newImage.height())
   {
-    exceedsDiffenceLimit = false;
-    std::atomic_int difference(0);
-    const int differenceLimit = (height * width) / 100;
-    std::mutex diffMutex;
+    const QImage oldFrame = normalizedFrame(oldImage, newImage);
+    const QImage newFrame = normalizedFrame(newImage, oldImage);
+    const FrameView oldView = frameView(oldFrame);
+    const FrameView newView = frameView(newFrame);
+    std::atomic<long long> difference(0);
+    const long long differenceLimit =
+        (static_cast<long long>(height) * width) / 100;
+    diff = framePool.acquire(width, height, newFrame.format());
     diff.fill(QColor(00, 0xF2, 0xFF));
-    tbb::parallel_for(tbb::blocked_range<int>(0, width),
+    uchar *diffBits = diff.bits();
+    const int diffBytesPerLine = diff.bytesPerLine();
+    tbb::parallel_for(tbb::blocked_range<int>(0, height),
                       [&](const tbb::blocked_range<int> &range)
                       {
-      for(int i = range.begin(); i != range.end(); ++i)
+      long long rangeDifference = 0;
+      for(int j = range.begin(); j != range.end(); ++j)
       {
-        for(int j = 0; j < height; ++j)
+        const quint32 *oldRow = oldView.row(j);
+        const quint32 *newRow = newView.row(j);
+        if(DiffEngine::countRow(oldRow, newRow, width) == 0)
+          continue;
+        quint32 *diffRow =
+            reinterpret_cast<quint32 *>(diffBits + j * diffBytesPerLine);
+        for(int i = 0; i < width; ++i)
         {
-          if(oldImage.pixel(i, j) != newImage.pixel(i, j))
+          if(oldRow[i] != newRow[i])
           {
-            ++difference;
-            QRgb pixel = newImage.pixel(i, j);
-            std::lock_guard<std::mutex> l(diffMutex);
-            diff.setPixel(i, j, pixel);
-          }
-          if(difference > differenceLimit)
-          {
-            exceedsDiffenceLimit = true;
+            ++rangeDifference;
+            diffRow[i] = newRow[i];
           }
         }
       }
+      difference += rangeDifference;
     });
-    if(!muted)
+    exceedsDiffenceLimit = difference > differenceLimit;
+    if(reportDifferences)
       std::cout << difference << std::endl;
   }
   else
   {
-    if(!muted)
+    if(reportDifferences)
       std::cout << "Different sizes" << std::endl;
     diff = newImage;
   }
-  if(!muted || exceedsDiffenceLimit)
+  if(reportDifferences || exceedsDiffenceLimit)
   {
     diff.save(filename);
   }
@@ -284,82 +571,702 @@ bool QSnapper::imagesDiffer(const QImage oldImage, const QImage newImage,
 }
 
 /*!
- * \brief Returns if the screensaver is running. This is OS-dependent.
+ * \brief Compares two images, and if they are different enough(1% of the
+ * screen), returns true. Also saves the areas where they differ.
+ * \details Rather than a whole difference image, only the bounding
+ * rectangles of the changed areas are saved, each with the new image's pixels
+ * inside it, see DiffEngine::changedRegions(). The file holds the image size
+ * followed by each rectangle and its pixels, written with QDataStream.
+ * \param oldImage the old image
+ * \param newImage the new image, if this returns true, it will be saved.
+ * \param filename the name of the generated regions file
+ * \return True if the images differ.
+ */
+bool QSnapper::regionsDiffer(const QImage oldImage, const QImage newImage,
+                             const QString filename)
+{
+  bool exceedsDiffenceLimit = true;
+  QList<QRect> rects;
+  if(oldImage.size() == newImage.size())
+  {
+    const QImage oldFrame = normalizedFrame(oldImage, newImage);
+    const QImage newFrame = normalizedFrame(newImage, oldImage);
+    const long long differenceLimit =
+        (static_cast<long long>(newFrame.height()) * newFrame.width()) / 100;
+    const long long difference = DiffEngine::countDifferences(
+        frameView(oldFrame), frameView(newFrame));
+    exceedsDiffenceLimit = difference > differenceLimit;
+    if(reportDifferences)
+      std::cout << difference << std::endl;
+    if(!reportDifferences && !exceedsDiffenceLimit)
+      return false;
+    for(const DiffRegion &region : DiffEngine::changedRegions(
+            frameView(oldFrame), frameView(newFrame)))
+      rects.append(QRect(region.x, region.y, region.width, region.height));
+  }
+  else
+  {
+    if(reportDifferences)
+      std::cout << "Different sizes" << std::endl;
+    rects.append(newImage.rect());
+  }
+  QFile file(filename);
+  if(file.open(QIODevice::WriteOnly))
+  {
+    QDataStream stream(&file);
+    stream << newImage.size() << quint32(rects.size());
+    for(const QRect &rect : rects)
+      stream << rect << newImage.copy(rect);
+  }
+  return exceedsDiffenceLimit;
+}
+
+/*!
+ * \brief Checks if a picture differs from the last one, using only the tile
+ * fingerprint of the last one.
+ * \details If lenient, more than 1% of the tiles must have changed, otherwise
+ * any changed tile counts. When the picture differs its fingerprint replaces
+ * the stored one.
+ * \param newImage the new image, if this returns true, it will be saved.
+ * \param isLenient if minor differences should be tolerated.
+ * \param state What is remembered about the picture's screen.
+ * \return True if the images differ.
+ */
+bool QSnapper::tilesDiffer(const QImage newImage, bool isLenient,
+                           SnapScreenState &state)
+{
+  const QImage newFrame = normalizedFrame(newImage, newImage);
+  std::vector<std::uint64_t> newHashes =
+      TileHasher::hashTiles(frameView(newFrame));
+  bool differs = true;
+  if(state.oldTileFrameSize == newFrame.size())
+  {
+    const int changed =
+        TileHasher::countChanged(state.oldTileHashes, newHashes);
+    differs = isLenient ? changed > static_cast<int>(newHashes.size()) / 100
+                      : changed > 0;
+  }
+  if(differs)
+  {
+    state.oldTileHashes.swap(newHashes);
+    state.oldTileFrameSize = newFrame.size();
+  }
+  return differs;
+}
+
+/*!
+ * \brief Returns if the screensaver is running, see ScreensaverSource.
  * \return If the screensaver is running.
  */
-bool QSnapper::screensaverIsActive()
+bool QSnapper::screensaverIsActive() { return screensaver->isActive(); }
+
+/*!
+ * \brief Starts compacting the save folder in the background, see
+ * SnapCompactor.
+ * \details The tiers come from QSnapper_FullResolutionDays (1, just today)
+ * and QSnapper_ReducedDays (7), and the quota from QSnapper_QuotaMB (4096, 0
+ * for no limit).
+ * \return False if there is no save folder, a pass is already running or
+ * the similarity index is being rebuilt.
+ */
+bool QSnapper::compact()
 {
-#ifdef Q_OS_WIN
-  bool isActive = false;
-  SystemParametersInfo(SPI_GETSCREENSAVEACTIVE, 0, &isActive, 0);
-  return isActive;
-#else
-  QDBusReply<bool> reply = screensaver.call("GetActive");
-  return reply.isValid() && reply.value();
-#endif
+  if(saveDir.isNull() || !QDir(saveDir).exists() ||
+     similarityRebuilder->isRunning())
+    return false;
+  SnapCompactor::Policy policy;
+  policy.quotaBytes =
+      settings.value("QSnapper_QuotaMB", 4096).toLongLong() * 1024 * 1024;
+  policy.fullDays = settings.value("QSnapper_FullResolutionDays", 1).toInt();
+  policy.reducedDays = settings.value("QSnapper_ReducedDays", 7).toInt();
+  policy.reducedQuality =
+      settings.value("QSnapper_ReducedQuality", 60).toInt();
+  return compactor->compact(saveDir, policy);
+}
+
+/*!
+ * \brief Stops compacting after the file being worked on.
+ */
+void QSnapper::cancelCompaction() { compactor->cancel(); }
+
+/*!
+ * \brief Describes what compacting is doing, or how it last ended.
+ * \return See SnapCompactor::status().
+ */
+QString QSnapper::compactionStatus() { return compactor->status(); }
+
+/*!
+ * \brief Reads the similarity index again when next searched, since
+ * compacting or rebuilding it rewrote it.
+ */
+void QSnapper::reloadSimilarFrames()
+{
+  delete similarFrames;
+  similarFrames = nullptr;
+}
+
+/*!
+ * \brief Makes the save folder's timeline index again from the files in it,
+ * and then starts making its similarity index from the timeline.
+ * \details Waits for queued pictures to be saved first, since the write
+ * stage appends to the timeline. Hashing every picture takes a while, so the
+ * similarity index is made in the background, see SimilarityRebuilder and
+ * similarityRebuildStatus(). Refused while compacting, which rewrites both
+ * indexes too.
+ * \return If the timeline was written and the similarity index started.
+ */
+bool QSnapper::rebuildTimeline()
+{
+  if(saveDir.isNull() || !QDir(saveDir).exists() ||
+     compactor->isRunning() || similarityRebuilder->isRunning())
+    return false;
+  retirePipeline();
+  const bool rebuilt = TimelineIndex(saveDir).rebuild();
+  pipeline = createPipeline();
+  return rebuilt && similarityRebuilder->rebuild(saveDir);
+}
+
+/*!
+ * \brief Describes what rebuilding the similarity index is doing, or how it
+ * last ended.
+ * \return See SimilarityRebuilder::status().
+ */
+QString QSnapper::similarityRebuildStatus()
+{
+  return similarityRebuilder->status();
+}
+
+/*!
+ * \brief Finds when something that looks like a picture was on screen.
+ * \details The picture is hashed like every saved picture is, and the save
+ * folder's SimilarityIndex is searched for hashes close to it. The index is
+ * kept in memory between calls, only reading pictures saved since the last.
+ * \param referenceImagePath The picture to look for, such as a screenshot of
+ * a dialog cropped to the screen's shape.
+ * \param radius The most bits a picture's hash may differ by, 0 to 64.
+ * \return The times (yyyyMMddhhmmss) of up to 100 of the closest pictures,
+ * the closest and then the newest first.
+ */
+QStringList QSnapper::findSimilar(QString referenceImagePath, int radius)
+{
+  QStringList times;
+  const QImage reference(referenceImagePath);
+  if(reference.isNull() || saveDir.isNull())
+    return times;
+  if(!similarFrames)
+    similarFrames = new SimilarityIndex(saveDir);
+  for(const SimilarFrame &frame :
+      similarFrames->find(SimilarityIndex::dHash(reference), radius))
+    times.append(frame.taken.toString("yyyyMMddhhmmss"));
+  return times;
 }
 
 /*!
  * \brief Takes a picture
  * \details Checks if it is allowed to check pictures, and if the save directory
- * exists, and if so takes a picture.
- * If the picture is different from the last one, it gets a name from
- * getNextFileName() and saves it.
+ * exists, and if so takes a picture of each screen, see queueScreens().
  * It then sets the next time another screen shot should occur.
- * If saveDifferenceImage is true, a difference between the current image and
- * the previous image is stored instead of a whole copy. This reduces size, and
- * makes changes more noticable.
- * \return If a picture was taken.
+ * The pictures are compared and saved later on the pipeline's threads, so
+ * this returns before anything is on disk, and a queued picture may still be
+ * dropped as unchanged or fail to save. announceSave() is called once one is
+ * saved.
+ * \return If any picture was taken and queued to be saved, not whether it
+ * was saved.
  */
 bool QSnapper::snap()
 {
   if(canSnap && !saveDir.isNull() && QDir(saveDir).exists() &&
      !screensaverIsActive())
   {
-    QString saveFileName = getNextFileName();
-#if QT_VERSION < 0x050000
-    QPixmap desktop = QPixmap::grabWindow(QApplication::desktop()->winId());
-#else
-    QPixmap desktop = QGuiApplication::primaryScreen()->grabWindow(
-        QApplication::desktop()->winId());
-#endif
-    QImage newImage = desktop.toImage();
-    nextWakeup = QDateTime::currentDateTime().addSecs(60);
-    if(lenient && saveDifferenceImage &&
-       imagesDiffer(oldImage, newImage, getNextFileName()))
+    const bool queued = queueScreens();
+    nextWakeup = QDateTime::currentDateTime().addMSecs(cadence.interval());
+    return queued;
+  }
+  return false;
+}
+
+/*!
+ * \brief Takes a picture of each screen through the capture backend.
+ * \details Each picture is handed to the pipeline on its own, along with a
+ * name from getNextFileName() and the current options. When there is more
+ * than one screen the names end in the screen's number. Comparing, encoding
+ * and saving it all happen on the pipeline's threads, see diffStage(),
+ * encodeStage() and writeStage().
+ * \return If any picture was queued to be saved, false if the pipeline was
+ * full.
+ */
+bool QSnapper::queueScreens()
+{
+  const QDateTime taken = QDateTime::currentDateTime();
+  const QList<QImage> pictures = capture->grabScreens();
+  bool queued = false;
+  for(int screen = 0; screen < pictures.size(); ++screen)
+  {
+    if(pictures[screen].isNull())
+      continue;
+    const QString suffix =
+        pictures.size() > 1 ? '-' + QString::number(screen) : QString();
+    SnapJob job;
+    job.screen = screen;
+    job.taken = taken;
+    job.archive = archiving;
+    job.contentStore = contentStoring && !archiving;
+    if(job.archive)
+      job.fileName =
+          SnapArchiveWriter::archiveName(saveDir, taken.date(), suffix);
+    else if(job.contentStore)
+      job.fileName = saveDir;
+    else
+      job.fileName = getNextFileName(suffix);
+    job.image = pictures[screen];
+    job.lenient = lenient;
+    job.sampleErrorRate = sampleErrorRate;
+    job.quality = jpegQuality;
+    job.saveDifference =
+        lenient && saveDifferenceImage && !tileHashing && !archiving;
+    job.diffRegions = diffRegions;
+    job.tileHashing = tileHashing;
+    job.verbose = !muted;
+    queued = pipeline->submit(job) || queued;
+  }
+  return queued;
+}
+
+/*!
+ * \brief Takes pictures at a fixed rate for a while, to record something
+ * happening on screen.
+ * \details Pictures are grabbed on this thread by a precise timer, and go
+ * through the same pipeline as snap()'s, so grabbing the next picture
+ * overlaps comparing, encoding and writing the ones before it. The
+ * pipeline's queues are bounded, so when saving falls behind, pictures are
+ * dropped rather than piling up in memory. burstStatus() counts them.
+ * Bursts ignore the Enabled option, since they are asked for explicitly,
+ * and "Snap" is not said for each picture.
+ * \param framesPerSecond How many pictures to take each second, 1 to 60.
+ * \param seconds How long to take them for, 1 to 3600.
+ * \return If the burst started. A running burst is replaced.
+ */
+bool QSnapper::startBurst(int framesPerSecond, int seconds)
+{
+  if(framesPerSecond < 1 || framesPerSecond > 60 || seconds < 1 ||
+     seconds > 3600 || saveDir.isNull() || !QDir(saveDir).exists())
+    return false;
+  burstInterval = 1000.0 / framesPerSecond;
+  burstLength = seconds * 1000LL;
+  burstTicks = 0;
+  burstBefore = frameCounts();
+  burstClock.start();
+  burstTimer.start(qMax(1, static_cast<int>(burstInterval)));
+  burstAction->setChecked(true);
+  burstTick();
+  return true;
+}
+
+/*!
+ * \brief Stops a burst early. Pictures already grabbed are still saved.
+ */
+void QSnapper::stopBurst()
+{
+  if(!burstTimer.isActive())
+    return;
+  burstStopped = burstClock.elapsed();
+  burstTimer.stop();
+  burstAction->setChecked(false);
+}
+
+/*!
+ * \brief Starts or stops a burst from the menu.
+ * \details The rate and length come from the QSnapper_BurstFps and
+ * QSnapper_BurstSeconds settings.
+ * \param enable If a burst should run.
+ */
+void QSnapper::setBurst(bool enable)
+{
+  if(!enable)
+    stopBurst();
+  else if(!startBurst(settings.value("QSnapper_BurstFps", 4).toInt(),
+                      settings.value("QSnapper_BurstSeconds", 30).toInt()))
+    burstAction->setChecked(false);
+}
+
+/*!
+ * \brief Describes the running burst, or the last one.
+ * \details Pictures are missed when grabbing itself falls behind the rate,
+ * dropped when the pipeline is full, unchanged when the diff stage found
+ * nothing new, and failed when they could not be encoded or written.
+ * Pictures taken by snap() during the burst are counted too.
+ * \return The counts, or "Idle" if no burst was started.
+ */
+QString QSnapper::burstStatus()
+{
+  if(!burstClock.isValid())
+    return "Idle";
+  const qint64 elapsed =
+      qMin(burstTimer.isActive() ? burstClock.elapsed() : burstStopped,
+           burstLength - 1);
+  const int expected = static_cast<int>(elapsed / burstInterval) + 1;
+  const SnapCounts counts = frameCounts();
+  return QString("%1: %2 grabbed, %3 missed, %4 dropped, %5 unchanged, "
+                 "%6 failed, %7 saved")
+      .arg(burstTimer.isActive() ? "Running" : "Finished")
+      .arg(burstTicks)
+      .arg(qMax(0, expected - burstTicks))
+      .arg(counts.dropped - burstBefore.dropped)
+      .arg(counts.skipped - burstBefore.skipped)
+      .arg(counts.failed - burstBefore.failed)
+      .arg(counts.saved - burstBefore.saved);
+}
+
+/*!
+ * \brief Takes one burst picture, or ends the burst once its time is up.
+ */
+void QSnapper::burstTick()
+{
+  burstStopped = burstClock.elapsed();
+  if(burstStopped >= burstLength)
+  {
+    stopBurst();
+    return;
+  }
+  ++burstTicks;
+  queueScreens();
+}
+
+/*!
+ * \brief The pipeline's first stage, decides if a picture should be saved.
+ * \details If the picture is different from the last one of the same screen,
+ * it is kept and becomes the one future pictures of that screen are compared
+ * to.
+ * If saveDifference is set, a difference between the current image and the
+ * previous image is stored instead of a whole copy. This reduces size, and
+ * makes changes more noticable. If diffRegions is also set, only the changed
+ * areas are stored, in a .regions file.
+ * If tileHashing is set, only the tile fingerprint of the last picture is
+ * compared against, see tilesDiffer().
+ * If archive is set, the tiles that changed since the last archived picture
+ * are found as well, see findArchiveTiles().
+ * Runs on the pipeline's diff thread, which is the only thread that touches
+ * the screens' last pictures or their fingerprints. Each comparison is itself
+ * spread across cores by TBB.
+ * \param job The picture to check.
+ * \return If the picture should be encoded and saved.
+ */
+bool QSnapper::diffStage(SnapJob &job)
+{
+  reportDifferences = job.verbose;
+  SnapScreenState &state = screens[job.screen];
+  bool keep = false;
+  if(job.tileHashing)
+  {
+    state.oldImage = QImage();
+    keep = tilesDiffer(job.image, job.lenient, state);
+  }
+  else
+  {
+    state.oldTileHashes.clear();
+    state.oldTileFrameSize = QSize();
+    if(job.saveDifference)
     {
-      oldImage = newImage;
+      const QFileInfo info(job.fileName);
+      const QString regionsName =
+          info.path() + '/' + info.completeBaseName() + ".regions";
+      if(job.diffRegions
+             ? regionsDiffer(state.oldImage, job.image, regionsName)
+             : imagesDiffer(state.oldImage, job.image, job.fileName))
+      {
+        state.oldImage = job.image;
+        Q_EMIT frameChanged();
+      }
+      return false;
+    }
+    if((!job.lenient && state.oldImage != job.image) ||
+       (job.lenient &&
+        imagesDiffer(state.oldImage, job.image, job.sampleErrorRate)))
+    {
+      state.oldImage = job.image;
+      keep = true;
+    }
+  }
+  if(keep)
+    Q_EMIT frameChanged();
+  if(keep && job.archive)
+    findArchiveTiles(job);
+  return keep;
+}
+
+/*!
+ * \brief Finds the tiles of a picture that changed since the last archived
+ * one, so only those go into the archive's delta record.
+ * \details Runs on the diff thread, which owns the screens' state.
+ * \param job The picture being archived, its changedTiles are filled in.
+ */
+void QSnapper::findArchiveTiles(SnapJob &job)
+{
+  SnapScreenState &state = screens[job.screen];
+  const QImage frame = normalizedFrame(job.image, job.image);
+  std::vector<std::uint64_t> hashes = TileHasher::hashTiles(frameView(frame));
+  job.changedTiles.clear();
+  const bool sameSize = state.archiveFrameSize == frame.size();
+  for(size_t i = 0; i < hashes.size(); ++i)
+  {
+    if(!sameSize || state.archiveTileHashes[i] != hashes[i])
+      job.changedTiles.push_back(static_cast<int>(i));
+  }
+  state.archiveTileHashes.swap(hashes);
+  state.archiveFrameSize = frame.size();
+}
+
+/*!
+ * \brief The pipeline's second stage, compresses the picture in memory.
+ * \details Archived pictures become a record built by their screen's archive
+ * writer. The writers are only used from this stage's thread. If a record
+ * failed to be written since the last picture, every writer starts again
+ * from a keyframe.
+ * Pictures for the content store get their key here, and are left unencoded
+ * if the store already has them.
+ * JPEGs are compressed a strip per core where libjpeg is available, see
+ * StripJpegEncoder.
+ * \param job The picture to encode, in the format its file name ends with.
+ * \return If the picture could be encoded.
+ */
+bool QSnapper::encodeStage(SnapJob &job)
+{
+  job.frameHash = SimilarityIndex::dHash(job.image);
+  if(job.archive)
+  {
+    const int failures = archiveFailures;
+    if(failures != seenArchiveFailures)
+    {
+      seenArchiveFailures = failures;
+      for(auto &writer : archiveWriters)
+        writer.second.restart();
     }
-    else if((!lenient && oldImage != newImage) ||
-            (lenient && imagesDiffer(oldImage, newImage)))
+    if(archiveWriters.find(job.screen) == archiveWriters.end())
+      archiveWriters.insert(
+          std::make_pair(job.screen, SnapArchiveWriter(keyframeInterval)));
+    SnapArchiveWriter &writer = archiveWriters.find(job.screen)->second;
+    job.encoded = writer.encode(job.fileName, job.image, job.taken,
+                                job.changedTiles);
+    return true;
+  }
+  if(job.contentStore)
+  {
+    job.contentKey = ContentStore::frameKey(job.image);
+    if(ContentStore(job.fileName).contains(job.contentKey))
+      return true;
+  }
+  const QByteArray format =
+      job.contentStore ? QByteArray("JPG")
+                       : QFileInfo(job.fileName).suffix().toLatin1();
+#ifdef HAVE_LIBJPEG
+  if(format.toLower() == "jpg" || format.toLower() == "jpeg")
+  {
+    const QImage frame = normalizedFrame(job.image, job.image);
+    std::vector<unsigned char> jpeg;
+    if(StripJpegEncoder::encode(frameView(frame), job.quality, jpeg))
     {
-      oldImage = newImage;
-      oldImage.save(saveFileName);
-      saveFileName = getNextFileName();
+      job.encoded = QByteArray(reinterpret_cast<const char *>(jpeg.data()),
+                               static_cast<int>(jpeg.size()));
       return true;
     }
   }
-  return false;
+#endif
+  QBuffer buffer(&job.encoded);
+  buffer.open(QIODevice::WriteOnly);
+  return job.image.save(&buffer, format.constData(), job.quality);
+}
+
+/*!
+ * \brief The pipeline's last stage, puts the encoded picture on disk.
+ * \details Archive records are appended to the day's archive, see
+ * SnapArchiveWriter::append(). Once a record fails, the deltas already
+ * encoded after it are dropped until a keyframe arrives, and the encode stage
+ * is told to make one. Pictures for the
+ * content store are stored if they are new, and noted in its index either
+ * way. Other pictures get a file of their own.
+ * Every picture written is then added to the save folder's TimelineIndex and
+ * SimilarityIndex. This is the only thread that appends to them, and it
+ * holds the folder's SaveFolderLock meanwhile, so SnapCompactor never
+ * rewrites them, or drops a stored picture, halfway through a picture.
+ * \param job The encoded picture.
+ * \return If the whole picture was written and added to both indexes.
+ */
+bool QSnapper::writeStage(SnapJob &job)
+{
+  TimelineEntry entry;
+  entry.taken = job.taken;
+  entry.screen = job.screen;
+  const QString directory =
+      job.contentStore ? job.fileName : QFileInfo(job.fileName).path();
+  QMutexLocker locker(SaveFolderLock::of(directory));
+  if(job.contentStore)
+  {
+    const ContentStore store(job.fileName);
+    if((!job.encoded.isEmpty() &&
+        !store.addObject(job.contentKey, job.encoded)) ||
+       !store.record(job.taken, job.screen, job.contentKey))
+      return false;
+    entry.hash = job.contentKey;
+    entry.fileName = QDir(directory).relativeFilePath(
+        store.objectPath(job.contentKey));
+  }
+  else
+  {
+    QFile file(job.fileName);
+    if(job.archive)
+    {
+      if(brokenArchives.count(job.screen) &&
+         !SnapArchiveWriter::isKeyframe(job.encoded))
+        return false;
+      entry.offset = file.open(QIODevice::Append)
+                         ? SnapArchiveWriter::append(file, job.encoded)
+                         : -1;
+      if(entry.offset < 0)
+      {
+        brokenArchives.insert(job.screen);
+        ++archiveFailures;
+        return false;
+      }
+      brokenArchives.erase(job.screen);
+      entry.changedTiles = static_cast<int>(job.changedTiles.size());
+    }
+    else if(!file.open(QIODevice::WriteOnly) ||
+            file.write(job.encoded) != job.encoded.size())
+      return false;
+    entry.fileName = QFileInfo(job.fileName).fileName();
+  }
+  const bool indexed = TimelineIndex(directory).append(entry);
+  return SimilarityIndex(directory).append(job.taken, job.screen,
+                                           job.frameHash) &&
+         indexed;
 }
 
 /*!
  * \brief Gets where the image should be saved next.
- * \return A QString comprosed of the path, the current time (yyyyMMddhhmmss)
- * and the extension (.jpg, to save space)
+ * \details If a name was already handed out for this second and suffix, or
+ * a file by that name exists, _2, _3 and so on are added after the suffix so
+ * no picture overwrites another.
+ * \param suffix Added after the time, used to tell screens apart.
+ * \return A QString comprosed of the path, the current time (yyyyMMddhhmmss),
+ * the suffix and the extension (.jpg, to save space)
  */
-QString QSnapper::getNextFileName()
+QString QSnapper::getNextFileName(const QString &suffix)
 {
-  return saveDir + '/' +
-         QDateTime::currentDateTime().toString("yyyyMMddhhmmss") + ".jpg";
+  const QString time =
+      QDateTime::currentDateTime().toString("yyyyMMddhhmmss");
+  if(time != lastNameTime)
+  {
+    lastNameTime = time;
+    namesThisSecond.clear();
+  }
+  const QString stem = saveDir + '/' + time + suffix;
+  int repeat = namesThisSecond.value(suffix, 0);
+  QString name;
+  do
+  {
+    ++repeat;
+    name = stem + (repeat > 1 ? '_' + QString::number(repeat) : QString()) +
+           ".jpg";
+  } while(QFile::exists(name));
+  namesThisSecond.insert(suffix, repeat);
+  return name;
 }
 
 /*!
- * \brief Takes a picture, and if unmuted says "Snap".
+ * \brief Takes a picture. Saying "Snap" waits until it is saved, see
+ * announceSave().
+ * \details If no screen changed since the last tick, the wait until the next
+ * one is doubled, see SnapCadence.
+ * If the user has been away for QSnapper_IdleSuspend seconds, no picture is
+ * taken and the timer stops until checkForInput() sees them return. The save
+ * folder is compacted in the meantime, and the free capture buffers are
+ * given back.
  */
 void QSnapper::emitSpeak()
 {
-  if(snap() && !muted)
+  if(idleSuspend > 0 && idle->idleMsecs() >= idleSuspend)
+  {
+    whenToSpeak.stop();
+    idlePoll.start();
+    compact();
+    framePool.trim();
+    return;
+  }
+  if(!changedSinceTick)
+    whenToSpeak.setInterval(cadence.recordUnchanged());
+  changedSinceTick = false;
+  snap();
+}
+
+/*!
+ * \brief Notes that a screen changed, going back to the shortest wait between
+ * pictures.
+ * \details Called through a queued connection from the pipeline's diff thread.
+ * If the wait had grown, the timer is restarted so the next picture comes
+ * after the shortest wait rather than the long one.
+ */
+void QSnapper::recordChange()
+{
+  changedSinceTick = true;
+  if(cadence.unchangedStreak() == 0)
+    return;
+  whenToSpeak.start(cadence.recordChanged());
+  nextWakeup = QDateTime::currentDateTime().addMSecs(cadence.interval());
+}
+
+/*!
+ * \brief Polled every second while the user is away, takes a picture and
+ * restarts the timer on their first input.
+ * \details The idle counter only goes down when there was input, so that is
+ * how the return is noticed. The screen was left alone until then, so the
+ * shortest wait is used again. Compacting stops so it doesn't compete with
+ * the user.
+ */
+void QSnapper::checkForInput()
+{
+  const qint64 idleTime = idle->idleMsecs();
+  if(idleTime >= 0 && idleTime >= idleSuspend)
+    return;
+  idlePoll.stop();
+  compactor->cancel();
+  changedSinceTick = true;
+  whenToSpeak.start(cadence.recordChanged());
+  snap();
+}
+
+/*!
+ * \brief Gets how long the snapper currently waits between pictures.
+ * \return The wait in seconds.
+ */
+int QSnapper::effectiveInterval() { return cadence.interval() / 1000; }
+
+/*!
+ * \brief Gets how many calls were made to the screensaver over D-Bus, which
+ * should stay at the one made at startup.
+ * \return See ScreensaverSource::queryCount().
+ */
+int QSnapper::screensaverQueryCount() { return screensaver->queryCount(); }
+
+/*!
+ * \brief Gets the most capture buffers that were in use at once.
+ * \details If this reaches QSnapper_FramePoolSize, some pictures were
+ * allocated outside the pool, and the pool should be made bigger.
+ * \return See FramePool::highWaterMark().
+ */
+int QSnapper::framePoolHighWaterMark() { return framePool.highWaterMark(); }
+
+/*!
+ * \brief Says "Snap" if unmuted, called once the pipeline has saved a picture.
+ * \details Each screen is saved on its own, so "Snap" is only said for the
+ * first picture saved from each grab, however many screens changed. Stays
+ * quiet during a burst.
+ * \param taken When the saved picture was grabbed.
+ */
+void QSnapper::announceSave(QDateTime taken)
+{
+  if(taken == lastAnnounced)
+    return;
+  lastAnnounced = taken;
+  if(!muted && !burstTimer.isActive())
     Q_EMIT wantsToSpeak(getText());
-  else
-    Q_EMIT wantsToSpeak("");
 }
@@ -1,18 +1,61 @@
 #ifndef QSNAPPER_H
 #define QSNAPPER_H
 #include "component.h"
+#include "snappipeline.h"
+#include "snaparchive.h"
+#include "capturebackend.h"
+#include "framepool.h"
+#include "snapcadence.h"
+#include "idlesource.h"
+#include "screensaversource.h"
+#include "snapcompactor.h"
+#include "snaptimelinedialog.h"
+#include "similarityindex.h"
+#include "similarityrebuilder.h"
 #include <QSettings>
+#include <QHash>
+#include <QStringList>
 #include <QImage>
 #include <QAction>
-#ifndef Q_OS_WIN
-#include <QtDBus/QDBusInterface>
-#include <QtDBus/QDBusReply>
-#endif
+#include <QElapsedTimer>
+#include <vector>
+#include <atomic>
+#include <map>
+#include <set>
+#include <cstdint>
+
+/*!
+ * \brief What the snapper remembers about one screen between pictures.
+ * \details Only touched from the pipeline's diff thread.
+ */
+struct SnapScreenState
+{
+  /*!
+   *\brief the image data of the last screenshot taken.
+   *\details Used to check if the screen has changed, to prevent duplicates.
+  */
+  QImage oldImage;
+  /*!
+   * \brief The tile fingerprint of the last screenshot taken, used instead of
+   * oldImage when tileHashing is on.
+   */
+  std::vector<std::uint64_t> oldTileHashes;
+  ///\brief The size of the frame oldTileHashes was taken from.
+  QSize oldTileFrameSize;
+  ///\brief The tile fingerprint of the last archived picture.
+  std::vector<std::uint64_t> archiveTileHashes;
+  ///\brief The size of the frame archiveTileHashes was taken from.
+  QSize archiveFrameSize;
+};
 
 /*!
  * \brief Provides screenshot logging.
  * \details Takes a picture every minute. If the picture is different from the
- * last one, it saves it with the time taken.
+ * last one, it saves it with the time taken. While nothing changes the wait
+ * between pictures grows, up to QSnapper_MaxInterval seconds, and drops back
+ * to QSnapper_MinInterval seconds (a minute by default) on the next change.
+ * Each screen is pictured, compared and saved on its own, so a change on one
+ * monitor does not re-save the others.
  * This has two enable functions. One which toggles taking pictures, the other
  * toggles speaking.
  * Additionally it defaults to muted, as the user likely doesn't want to hear
@@ -22,23 +65,112 @@ class QSnapper : public Component
 {
   Q_OBJECT
   Q_CLASSINFO("D-Bus Interface", "com.coderfrog.qcompanion.qsnapper")
+  friend class SnapperBenchmark;
   ///\brief The path where the images should be saved.
   QString saveDir;
-  QString getNextFileName();
-  bool imagesDiffer(const QImage oldImage, const QImage newImage);
+  ///\brief The second getNextFileName() last handed out a name for.
+  QString lastNameTime;
+  ///\brief How many names were handed out that second, by suffix.
+  QHash<QString, int> namesThisSecond;
+  QString getNextFileName(const QString &suffix = QString());
+  bool imagesDiffer(const QImage oldImage, const QImage newImage,
+                    double errorRate);
   bool imagesDiffer(const QImage oldImage, const QImage newImage,
                     const QString filename);
+  bool regionsDiffer(const QImage oldImage, const QImage newImage,
+                     const QString filename);
+  bool tilesDiffer(const QImage newImage, bool isLenient,
+                   SnapScreenState &state);
+  bool diffStage(SnapJob &job);
+  void findArchiveTiles(SnapJob &job);
+  bool encodeStage(SnapJob &job);
+  bool writeStage(SnapJob &job);
+  SnapPipeline *createPipeline();
+  void retirePipeline();
+  SnapCounts frameCounts() const;
+  bool queueScreens();
   bool screensaverIsActive();
   ///\brief When the next screenshot will occur, if enabled.
   QDateTime nextWakeup;
+  ///\brief How long to wait between screenshots.
+  SnapCadence cadence;
+  ///\brief If any screen changed since the timer last fired.
+  bool changedSinceTick;
+  ///\brief Tells how long the user has been away.
+  IdleSource *idle;
+  /*!
+   * \brief How long the user has to be away before pictures stop, in
+   * milliseconds. 0 never stops.
+   */
+  qint64 idleSuspend;
+  ///\brief Checks for the user's return while pictures are stopped.
+  QTimer idlePoll;
+  ///\brief Shrinks the save folder while the user is away.
+  SnapCompactor *compactor;
+  ///\brief Searches the save folder by likeness, made when first searched.
+  SimilarityIndex *similarFrames;
+  ///\brief Makes the save folder's similarity index again in the background.
+  SimilarityRebuilder *similarityRebuilder;
+  ///\brief The window for browsing pictures, built when first shown.
+  SnapTimelineDialog *timelineDialog;
+  ///\brief When the grab announceSave() last spoke for was taken.
+  QDateTime lastAnnounced;
+  ///\brief Fires for each picture of a burst.
+  QTimer burstTimer;
+  ///\brief Started when the last burst started.
+  QElapsedTimer burstClock;
+  ///\brief The time between burst pictures, in milliseconds.
+  double burstInterval;
+  ///\brief How long the last burst lasts, in milliseconds.
+  qint64 burstLength;
+  ///\brief When the last burst took its last picture or was stopped.
+  qint64 burstStopped;
+  ///\brief How many times the last burst grabbed the screens.
+  int burstTicks;
+  ///\brief frameCounts() when the last burst began.
+  SnapCounts burstBefore;
+  /*!
+   * \brief The counts of the pipelines replaced so far, so frameCounts()
+   * never goes back when the pipeline is made again.
+   */
+  SnapCounts retiredCounts;
   /*! \brief Global settings, used to check where images should be saved to,
    * andif they should be saved. */
   QSettings settings;
   /*!
-   *\brief the image data of the last screenshot taken.
-   *\details Used to check if the screen has changed, to prevent duplicates.
-  */
-  QImage oldImage;
+   * \brief The buffers pictures are captured into, and difference images
+   * drawn into. Outlives the capture backend and the pipeline.
+   */
+  FramePool framePool;
+  ///\brief What is remembered about each screen, by screen number.
+  std::map<int, SnapScreenState> screens;
+  /*!
+   * \brief Builds archive records for each screen, used only by the encode
+   * stage.
+   */
+  std::map<int, SnapArchiveWriter> archiveWriters;
+  /*!
+   * \brief How many archive records failed to be written. The encode stage
+   * restarts its writers when this changes.
+   */
+  std::atomic<int> archiveFailures;
+  ///\brief archiveFailures when the encode stage last looked.
+  int seenArchiveFailures;
+  /*!
+   * \brief The screens whose last archive record failed to be written. Their
+   * deltas are dropped until a keyframe is written. Only used by the write
+   * stage.
+   */
+  std::set<int> brokenArchives;
+  ///\brief The most deltas allowed between two archive keyframes.
+  int keyframeInterval;
+  ///\brief The quality pictures are saved with, 0 to 100.
+  int jpegQuality;
+  /*!
+   * \brief The chance of a wrong answer tolerated when lenient comparisons
+   * sample the pictures, see DiffEngine::sampledExceedsLimit().
+   */
+  double sampleErrorRate;
   ///\brief Indicated whether this component is on and taking pictures.
   bool canSnap;
   /*! \brief If true, tolerates a difference of 1% of the screen size between
@@ -50,25 +182,80 @@ class QSnapper : public Component
    * will be saved.
    */
   bool saveDifferenceImage;
+  /*! \brief If true, difference images only hold the bounding rectangles of
+   * the changed areas and their pixels, rather than the whole screen.
+   */
+  bool diffRegions;
+  /*! \brief If true, only a hash per tile of the last picture is kept, rather
+   * than the whole picture. Difference images need the whole picture, so they
+   * are unavailable in this mode.
+   */
+  bool tileHashing;
+  /*! \brief If true, pictures are appended to a daily archive of keyframes and
+   * changed tiles, rather than each saved as a file.
+   */
+  bool archiving;
+  /*! \brief If true, each distinct picture is saved once into a ContentStore,
+   * and pictures seen before only add a line to its index. Archiving takes
+   * precedence.
+   */
+  bool contentStoring;
+  /*! \brief If true, the diff stage prints how many pixels differ, and always
+   * saves difference images. Copied from the job being diffed.
+   */
+  bool reportDifferences;
+  ///\brief Compares, encodes and saves pictures off the GUI thread.
+  SnapPipeline *pipeline;
+  ///\brief Takes the pictures.
+  CaptureBackend *capture;
   ///\brief The menu option corrisponding to lenient
   QAction *lenientOption;
   /*! \brief A menu option that toggles if a seperate image of the difference
    * should be saved.
    */
   QAction *toggleDiffAction;
-#ifndef Q_OS_WIN
-  ///\brief The interface with the screensaver.
-  QDBusInterface screensaver;
-#endif
+  ///\brief A menu option that starts and stops a burst.
+  QAction *burstAction;
+  ///\brief Tells if the screensaver is running.
+  ScreensaverSource *screensaver;
+Q_SIGNALS:
+  ///\brief Emitted from the diff thread when a screen has changed.
+  void frameChanged();
 private Q_SLOTS:
   void emitSpeak();
   void changeSaveFolder();
+  void showTimeline();
+  void setBurst(bool enable);
+  void burstTick();
+  void announceSave(QDateTime taken);
+  void recordChange();
+  void checkForInput();
+  void reloadSimilarFrames();
 public Q_SLOTS:
   Q_SCRIPTABLE bool snap();
   Q_SCRIPTABLE void enableSnapping(bool enable);
   Q_SCRIPTABLE void setLenient(bool isLenient);
   Q_SCRIPTABLE void setMuteSettings(bool shouldMute);
   Q_SCRIPTABLE void setDiff(bool enable);
+  Q_SCRIPTABLE void setDiffRegions(bool enable);
+  Q_SCRIPTABLE void setTileHashing(bool enable);
+  Q_SCRIPTABLE void setArchive(bool enable);
+  Q_SCRIPTABLE void setContentStore(bool enable);
+  Q_SCRIPTABLE bool exportArchivedFrame(QString when, int screen,
+                                        QString fileName);
+  Q_SCRIPTABLE int effectiveInterval();
+  Q_SCRIPTABLE int screensaverQueryCount();
+  Q_SCRIPTABLE bool compact();
+  Q_SCRIPTABLE void cancelCompaction();
+  Q_SCRIPTABLE QString compactionStatus();
+  Q_SCRIPTABLE bool rebuildTimeline();
+  Q_SCRIPTABLE QString similarityRebuildStatus();
+  Q_SCRIPTABLE QStringList findSimilar(QString referenceImagePath,
+                                       int radius);
+  Q_SCRIPTABLE bool startBurst(int framesPerSecond, int seconds);
+  Q_SCRIPTABLE void stopBurst();
+  Q_SCRIPTABLE QString burstStatus();
+  Q_SCRIPTABLE int framePoolHighWaterMark();
 
 public:
   QSnapper(QWidget *parent);
@@ -77,6 +264,11 @@ public:
   QString getText();
   virtual QList<QAction *> getMenuContents() override;
   bool isEnabled();
+  void setCaptureBackend(CaptureBackend *backend);
+  void setIdleSource(IdleSource *source);
+  void setScreensaverSource(ScreensaverSource *source);
+  void setSaveDirectory(const QString &dir);
+  bool isSuspendedForIdle() const;
 };
 
 #endif // QSNAPPER_H
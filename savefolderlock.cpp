@@ -0,0 +1,23 @@
+#include "savefolderlock.h"
+#include <QDir>
+#include <QHash>
+#include <memory>
+
+/*!
+ * \brief Gets a folder's lock.
+ * \details Locks are made the first time a folder is asked for and kept for
+ * the rest of the run, there are only ever a few save folders.
+ * \param directory The save folder.
+ * \return The same lock for every name of the same folder.
+ */
+QMutex *SaveFolderLock::of(const QString &directory)
+{
+  static QMutex locksMutex;
+  static QHash<QString, std::shared_ptr<QMutex>> locks;
+  const QString path = QDir::cleanPath(QDir(directory).absolutePath());
+  QMutexLocker locker(&locksMutex);
+  std::shared_ptr<QMutex> &lock = locks[path];
+  if(!lock)
+    lock.reset(new QMutex());
+  return lock.get();
+}
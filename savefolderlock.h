@@ -0,0 +1,21 @@
+#ifndef SAVEFOLDERLOCK_H
+#define SAVEFOLDERLOCK_H
+#include <QMutex>
+#include <QString>
+
+/*!
+ * \brief Keeps a save folder's indexes from being rewritten while they are
+ * written to.
+ * \details timeline.qti, similarity.qph and index.qsi are appended to by the
+ * pipeline's write thread, and rewritten by SnapCompactor and
+ * SimilarityIndex::rebuild(). A record appended while a file is rewritten
+ * would be lost with the old file, so each thread holds the folder's lock
+ * for as long as it writes to them.
+ */
+class SaveFolderLock
+{
+public:
+  static QMutex *of(const QString &directory);
+};
+
+#endif // SAVEFOLDERLOCK_H
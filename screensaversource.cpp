@@ -0,0 +1,129 @@
+#include "screensaversource.h"
+#ifdef Q_OS_WIN
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusPendingReply>
+#endif
+
+namespace
+{
+#ifdef Q_OS_WIN
+/*!
+ * \brief Asks Windows about the screensaver.
+ */
+class WinScreensaverSource : public ScreensaverSource
+{
+public:
+  explicit WinScreensaverSource(QObject *parent) : ScreensaverSource(parent)
+  {
+  }
+  virtual bool isActive() override
+  {
+    BOOL isActive = FALSE;
+    SystemParametersInfo(SPI_GETSCREENSAVEACTIVE, 0, &isActive, 0);
+    return isActive != FALSE;
+  }
+  virtual QString name() const override { return "Windows"; }
+};
+#endif
+}
+
+/*!
+ * \brief Creates the source.
+ * \param parent Used for Qt's memory management.
+ */
+ScreensaverSource::ScreensaverSource(QObject *parent)
+    : QObject(parent), queries(0)
+{
+}
+
+ScreensaverSource::~ScreensaverSource() {}
+
+/*!
+ * \brief Gets how many calls were made to another process to find out if the
+ * screensaver is running, which should not grow with each picture.
+ * \return The number of calls made.
+ */
+int ScreensaverSource::queryCount() const { return queries; }
+
+/*!
+ * \brief Picks a source that works on this system.
+ * \details The freedesktop.org screensaver is followed over D-Bus, and
+ * Windows is asked directly.
+ * \param parent Used for Qt's memory management.
+ * \return A new source.
+ */
+ScreensaverSource *ScreensaverSource::create(QObject *parent)
+{
+#ifdef Q_OS_WIN
+  return new WinScreensaverSource(parent);
+#else
+  return new DBusScreensaverSource(parent);
+#endif
+}
+
+#ifndef Q_OS_WIN
+/*!
+ * \brief Starts following the screensaver.
+ * \details Connects to ActiveChanged before asking for the current state, so
+ * no change can fall between the two.
+ * \param parent Used for Qt's memory management.
+ */
+DBusScreensaverSource::DBusScreensaverSource(QObject *parent)
+    : ScreensaverSource(parent), active(false), signalled(false)
+{
+  QDBusConnection dbus = QDBusConnection::sessionBus();
+  dbus.connect("org.freedesktop.ScreenSaver", "/ScreenSaver",
+               "org.freedesktop.ScreenSaver", "ActiveChanged", this,
+               SLOT(setActive(bool)));
+  const QDBusMessage getActive = QDBusMessage::createMethodCall(
+      "org.freedesktop.ScreenSaver", "/ScreenSaver",
+      "org.freedesktop.ScreenSaver", "GetActive");
+  ++queries;
+  QDBusPendingCallWatcher *reply =
+      new QDBusPendingCallWatcher(dbus.asyncCall(getActive), this);
+  connect(reply, SIGNAL(finished(QDBusPendingCallWatcher *)), this,
+          SLOT(replied(QDBusPendingCallWatcher *)));
+}
+
+/*!
+ * \brief Remembers if the screensaver is running, connected to its
+ * ActiveChanged signal.
+ * \param isActive If the screensaver is running.
+ */
+void DBusScreensaverSource::setActive(bool isActive)
+{
+  active = isActive;
+  signalled = true;
+}
+
+/*!
+ * \brief Takes the screensaver's answer to the GetActive call made at
+ * startup.
+ * \details The answer is ignored if ActiveChanged came first, since the
+ * signal is newer than the state the answer was read from.
+ * \param call The finished call, deleted here.
+ */
+void DBusScreensaverSource::replied(QDBusPendingCallWatcher *call)
+{
+  QDBusPendingReply<bool> reply = *call;
+  if(reply.isValid() && !signalled)
+    active = reply.value();
+  call->deleteLater();
+}
+
+/*!
+ * \brief Gets the screensaver's state, as last announced.
+ * \return If the screensaver is running.
+ */
+bool DBusScreensaverSource::isActive() { return active; }
+
+/*!
+ * \brief Gets the source's name.
+ * \return "D-Bus"
+ */
+QString DBusScreensaverSource::name() const { return "D-Bus"; }
+#endif
@@ -0,0 +1,64 @@
+#ifndef SCREENSAVERSOURCE_H
+#define SCREENSAVERSOURCE_H
+#include <QObject>
+#include <QString>
+#ifndef Q_OS_WIN
+#include <QtDBus/QDBusPendingCallWatcher>
+#endif
+
+/*!
+ * \brief Something that can tell if the screensaver is running.
+ * \details QSnapper asks one of these before each picture, so it has to
+ * answer straight away, without waiting on another process. Tests can hand
+ * the snapper their own subclass.
+ */
+class ScreensaverSource : public QObject
+{
+  Q_OBJECT
+public:
+  explicit ScreensaverSource(QObject *parent = nullptr);
+  virtual ~ScreensaverSource();
+  /*!
+   * \brief Checks if the screensaver is running.
+   * \return True if it is, false if it isn't or it can't be told.
+   */
+  virtual bool isActive() = 0;
+  ///\brief A short name for the source, used in logs.
+  virtual QString name() const = 0;
+  int queryCount() const;
+  static ScreensaverSource *create(QObject *parent = nullptr);
+
+protected:
+  ///\brief How many calls were made to another process to find the state.
+  int queries;
+};
+
+#ifndef Q_OS_WIN
+/*!
+ * \brief Follows org.freedesktop.ScreenSaver over D-Bus.
+ * \details The state is asked for once, without waiting for the answer, and
+ * then kept up to date by the ActiveChanged signal, so isActive() never
+ * calls D-Bus. If there is no screensaver it is treated as not running.
+ */
+class DBusScreensaverSource : public ScreensaverSource
+{
+  Q_OBJECT
+  ///\brief If the screensaver is running, as last announced.
+  bool active;
+  /*!
+   * \brief If ActiveChanged was received, after which the answer to the
+   * first call is out of date.
+   */
+  bool signalled;
+private Q_SLOTS:
+  void setActive(bool isActive);
+  void replied(QDBusPendingCallWatcher *call);
+
+public:
+  explicit DBusScreensaverSource(QObject *parent = nullptr);
+  virtual bool isActive() override;
+  virtual QString name() const override;
+};
+#endif
+
+#endif // SCREENSAVERSOURCE_H
@@ -0,0 +1,401 @@
+#include "similarityindex.h"
+#include "timelineindex.h"
+#include "snaparchive.h"
+#include "savefolderlock.h"
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <algorithm>
+#include <map>
+#include <memory>
+
+const quint32 SimilarityIndex::magic;
+const quint32 SimilarityIndex::version;
+const int SimilarityIndex::headerSize;
+const int SimilarityIndex::recordSize;
+
+/*!
+ * \brief Adds a hash to the tree.
+ * \details Equal hashes are all kept, each as the child at distance 0 of the
+ * one before it.
+ * \param hash The hash.
+ * \param value What find() returns for it.
+ */
+void BkTree::insert(quint64 hash, qint64 value)
+{
+  Node added;
+  added.hash = hash;
+  added.value = value;
+  const int index = static_cast<int>(nodes.size());
+  if(nodes.empty())
+  {
+    nodes.push_back(added);
+    return;
+  }
+  int node = 0;
+  for(;;)
+  {
+    const int d = SimilarityIndex::distance(hash, nodes[node].hash);
+    std::vector<std::pair<int, int>> &children = nodes[node].children;
+    auto child = std::find_if(children.begin(), children.end(),
+                              [d](const std::pair<int, int> &edge)
+                              { return edge.first == d; });
+    if(child == children.end())
+    {
+      children.push_back(std::make_pair(d, index));
+      break;
+    }
+    node = child->second;
+  }
+  nodes.push_back(added);
+}
+
+/*!
+ * \brief Finds the hashes within a radius of another.
+ * \param hash The hash to search around.
+ * \param radius The most bits a found hash may differ by.
+ * \return Each found hash's (distance, value), in no particular order.
+ */
+std::vector<std::pair<int, qint64>> BkTree::find(quint64 hash,
+                                                 int radius) const
+{
+  std::vector<std::pair<int, qint64>> found;
+  if(nodes.empty())
+    return found;
+  std::vector<int> toVisit(1, 0);
+  while(!toVisit.empty())
+  {
+    const Node &node = nodes[toVisit.back()];
+    toVisit.pop_back();
+    const int d = SimilarityIndex::distance(hash, node.hash);
+    if(d <= radius)
+      found.push_back(std::make_pair(d, node.value));
+    for(const std::pair<int, int> &child : node.children)
+      if(child.first >= d - radius && child.first <= d + radius)
+        toVisit.push_back(child.second);
+  }
+  return found;
+}
+
+/*!
+ * \brief Counts the hashes in the tree.
+ * \return The number of hashes.
+ */
+int BkTree::size() const { return static_cast<int>(nodes.size()); }
+
+/*!
+ * \brief Removes every hash.
+ */
+void BkTree::clear() { nodes.clear(); }
+
+/*!
+ * \brief Opens the similarity index of a folder.
+ * \param directory The save folder, the index lives in it.
+ */
+SimilarityIndex::SimilarityIndex(const QString &directory)
+    : directory(directory)
+{
+}
+
+/*!
+ * \brief Computes a picture's difference hash.
+ * \details The picture is shrunk to 9x8 grey pixels, and each bit says if a
+ * pixel is brighter than the one to its right. Shrinking throws away the
+ * detail, and comparing neighbours throws away the overall brightness, so
+ * the same window at another resolution, quality or colour depth hashes to
+ * nearly the same bits.
+ * \param image The picture.
+ * \return The hash, 0 for a null picture.
+ */
+quint64 SimilarityIndex::dHash(const QImage &image)
+{
+  if(image.isNull())
+    return 0;
+  const QImage small =
+      image.scaled(9, 8, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+          .convertToFormat(QImage::Format_RGB32);
+  quint64 hash = 0;
+  for(int y = 0; y < 8; ++y)
+  {
+    const QRgb *row = reinterpret_cast<const QRgb *>(small.constScanLine(y));
+    for(int x = 0; x < 8; ++x)
+      hash = (hash << 1) | (qGray(row[x]) > qGray(row[x + 1]) ? 1 : 0);
+  }
+  return hash;
+}
+
+/*!
+ * \brief Counts the bits two hashes differ by.
+ * \param a A hash.
+ * \param b The other hash.
+ * \return The Hamming distance, 0 to 64.
+ */
+int SimilarityIndex::distance(quint64 a, quint64 b)
+{
+  quint64 bits = a ^ b;
+  int count = 0;
+  for(; bits; bits &= bits - 1)
+    ++count;
+  return count;
+}
+
+/*!
+ * \brief Gets where the index is kept.
+ * \return The path of similarity.qph.
+ */
+QString SimilarityIndex::path() const
+{
+  return directory + "/similarity.qph";
+}
+
+/*!
+ * \brief Adds a picture to the end of the index.
+ * \param taken When the picture was taken.
+ * \param screen Which screen the picture is of.
+ * \param hash The picture's dHash().
+ * \return If the record was written.
+ */
+bool SimilarityIndex::append(const QDateTime &taken, int screen,
+                             quint64 hash) const
+{
+  QFile file(path());
+  if(!file.open(QIODevice::Append))
+    return false;
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  if(file.size() == 0)
+    stream << magic << version;
+  stream << qint64(taken.toMSecsSinceEpoch()) << qint32(screen) << hash;
+  return file.write(data) == data.size();
+}
+
+/*!
+ * \brief Gets how many pictures are in the index.
+ * \return The number of whole records in the file.
+ */
+qint64 SimilarityIndex::count() const
+{
+  QFile file(path());
+  if(file.size() < headerSize)
+    return 0;
+  return (file.size() - headerSize) / recordSize;
+}
+
+/*!
+ * \brief Finds the pictures that look like one with a given hash.
+ * \details Records appended since the last search are read in first.
+ * \param hash The dHash() of the picture to look for.
+ * \param radius The most bits a found picture's hash may differ by. 10 or
+ * so still finds the same screen with a few things changed on it.
+ * \param limit The most pictures returned.
+ * \return The closest pictures, the closest and then the newest first.
+ */
+QList<SimilarFrame> SimilarityIndex::find(quint64 hash, int radius, int limit)
+{
+  QList<SimilarFrame> frames;
+  if(!load())
+    return frames;
+  std::vector<std::pair<int, qint64>> found = tree.find(hash, radius);
+  std::sort(found.begin(), found.end(),
+            [](const std::pair<int, qint64> &a,
+               const std::pair<int, qint64> &b)
+            { return a.first != b.first ? a.first < b.first
+                                        : a.second > b.second; });
+  for(const std::pair<int, qint64> &match : found)
+  {
+    if(frames.size() >= limit)
+      break;
+    SimilarFrame frame;
+    frame.taken = QDateTime::fromMSecsSinceEpoch(times[match.second]);
+    frame.screen = screens[match.second];
+    frame.distance = match.first;
+    frames.append(frame);
+  }
+  return frames;
+}
+
+/*!
+ * \brief Reads the records that aren't in the tree yet.
+ * \details A record cut short at the end is left for the next search, when
+ * the write thread will have finished it. If the file shrank, it was
+ * rebuilt, and everything is read again.
+ * \return If the index could be read, or doesn't exist yet.
+ */
+bool SimilarityIndex::load()
+{
+  QFile file(path());
+  if(!file.exists())
+  {
+    tree.clear();
+    times.clear();
+    screens.clear();
+    return true;
+  }
+  if(!file.open(QIODevice::ReadOnly))
+    return false;
+  QDataStream stream(&file);
+  quint32 fileMagic, fileVersion;
+  stream >> fileMagic >> fileVersion;
+  if(stream.status() != QDataStream::Ok || fileMagic != magic ||
+     fileVersion > version)
+    return false;
+  const qint64 records = (file.size() - headerSize) / recordSize;
+  if(records < static_cast<qint64>(times.size()))
+  {
+    tree.clear();
+    times.clear();
+    screens.clear();
+  }
+  file.seek(headerSize + static_cast<qint64>(times.size()) * recordSize);
+  while(static_cast<qint64>(times.size()) < records)
+  {
+    qint64 msecs;
+    qint32 screen;
+    quint64 hash;
+    stream >> msecs >> screen >> hash;
+    tree.insert(hash, static_cast<qint64>(times.size()));
+    times.push_back(msecs);
+    screens.push_back(screen);
+  }
+  return stream.status() == QDataStream::Ok;
+}
+
+/*!
+ * \brief Drops the records of pictures that were deleted.
+ * \details Pictures are told apart by their time and screen. The index is
+ * rewritten like TimelineIndex::forget() does, with the folder's
+ * SaveFolderLock held by the caller. Records no longer line up with a tree
+ * read before, so an index that was searched should be made again.
+ * \param pictures The deleted pictures, as TimelineIndex::forget() found
+ * them.
+ * \return If the index was rewritten, or there was nothing to drop.
+ */
+bool SimilarityIndex::forget(const QList<TimelineEntry> &pictures) const
+{
+  QFile index(path());
+  if(pictures.isEmpty() || !index.exists())
+    return true;
+  if(!index.open(QIODevice::ReadOnly))
+    return false;
+  QSet<QPair<qint64, int>> gone;
+  for(const TimelineEntry &picture : pictures)
+    gone.insert(qMakePair(picture.taken.toMSecsSinceEpoch(), picture.screen));
+  const QByteArray records = index.readAll();
+  QDataStream header(records);
+  quint32 fileMagic, fileVersion;
+  header >> fileMagic >> fileVersion;
+  if(header.status() != QDataStream::Ok || fileMagic != magic ||
+     fileVersion > version)
+    return false;
+  QByteArray data = records.left(headerSize);
+  int offset = headerSize;
+  for(; offset + recordSize <= records.size(); offset += recordSize)
+  {
+    const QByteArray record = records.mid(offset, recordSize);
+    QDataStream stream(record);
+    qint64 msecs;
+    qint32 screen;
+    stream >> msecs >> screen;
+    if(!gone.contains(qMakePair(msecs, int(screen))))
+      data += record;
+  }
+  QFile file(path() + ".part");
+  if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+    return false;
+  index.close();
+  file.close();
+  QFile::remove(path());
+  return file.rename(path());
+}
+
+/*!
+ * \brief Makes the index again from the save folder's TimelineIndex.
+ * \details Every picture in the timeline is decoded and hashed, which takes
+ * a while for a big folder, so it is only for folders saved before pictures
+ * were hashed, or whose index was lost, and is best run on a worker, see
+ * SimilarityRebuilder. Pictures saved meanwhile are appended to the old
+ * index by the write thread, and are copied over before the new one
+ * replaces it, holding the folder's SaveFolderLock so none is appended
+ * between the copy and the rename.
+ * \param progress If set, called before each picture with how many were
+ * done and how many there are. Returning false stops the rebuild, leaving
+ * the old index.
+ * \return If the new index was written.
+ */
+bool SimilarityIndex::rebuild(
+    const std::function<bool(qint64, qint64)> &progress)
+{
+  const qint64 appendedFrom =
+      qMax<qint64>(QFileInfo(path()).size(), headerSize);
+  const TimelineIndex timeline(directory);
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream << magic << version;
+  // The timeline is sorted by time, so the archives of different screens
+  // interleave. Each archive keeps its own reader, which goes on from the
+  // picture it rebuilt last, until the next day's archives are reached.
+  std::map<QString, std::unique_ptr<SnapArchiveReader>> archives;
+  QSet<QPair<qint64, int>> hashed;
+  const qint64 entries = timeline.count();
+  for(qint64 index = 0; index < entries; ++index)
+  {
+    if(progress && !progress(index, entries))
+      return false;
+    const TimelineEntry entry = timeline.at(index);
+    const QString file = directory + '/' + entry.fileName;
+    QImage frame;
+    if(entry.fileName.endsWith(".qsa"))
+    {
+      if(archives.find(file) == archives.end())
+      {
+        for(auto open = archives.begin(); open != archives.end();)
+        {
+          if(QFileInfo(open->first).fileName().left(8) !=
+             entry.fileName.left(8))
+            open = archives.erase(open);
+          else
+            ++open;
+        }
+        archives[file].reset(new SnapArchiveReader(file));
+      }
+      frame = archives[file]->frameAt(entry.taken);
+    }
+    else
+      frame.load(file);
+    if(frame.isNull())
+      continue;
+    const qint64 msecs = entry.taken.toMSecsSinceEpoch();
+    stream << msecs << qint32(entry.screen) << dHash(frame);
+    hashed.insert(qMakePair(msecs, entry.screen));
+  }
+  if(progress)
+    progress(entries, entries);
+  QFile file(path() + ".part");
+  if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+    return false;
+  // Pictures saved since the start may be in the timeline too.
+  QMutexLocker locker(SaveFolderLock::of(directory));
+  QFile old(path());
+  if(old.open(QIODevice::ReadOnly) && old.seek(appendedFrom))
+  {
+    for(QByteArray record = old.read(recordSize);
+        record.size() == recordSize; record = old.read(recordSize))
+    {
+      QDataStream recordStream(record);
+      qint64 msecs;
+      qint32 screen;
+      recordStream >> msecs >> screen;
+      if(!hashed.contains(qMakePair(msecs, int(screen))) &&
+         file.write(record) != recordSize)
+        return false;
+    }
+  }
+  old.close();
+  file.close();
+  QFile::remove(path());
+  tree.clear();
+  times.clear();
+  screens.clear();
+  return file.rename(path());
+}
@@ -0,0 +1,95 @@
+#ifndef SIMILARITYINDEX_H
+#define SIMILARITYINDEX_H
+#include <QDateTime>
+#include <QImage>
+#include <QList>
+#include <QString>
+#include "timelineindex.h"
+#include <functional>
+#include <vector>
+
+///\brief A screenshot found by SimilarityIndex::find().
+struct SimilarFrame
+{
+  ///\brief When the picture was taken.
+  QDateTime taken;
+  ///\brief Which screen the picture is of.
+  int screen;
+  ///\brief How many bits its hash differs from the one searched for by.
+  int distance;
+};
+
+/*!
+ * \brief A BK-tree of 64 bit hashes, under the Hamming distance.
+ * \details Each child hangs off its parent by its distance from it, so a
+ * search within a radius only has to visit the children whose distance is
+ * within the radius of the parent's, by the triangle inequality. For small
+ * radii that is a tiny part of the tree.
+ */
+class BkTree
+{
+  ///\brief A hash in the tree.
+  struct Node
+  {
+    ///\brief The hash.
+    quint64 hash;
+    ///\brief What the hash was added with.
+    qint64 value;
+    ///\brief The children, as (distance, node) pairs.
+    std::vector<std::pair<int, int>> children;
+  };
+  ///\brief Every node, the first being the root.
+  std::vector<Node> nodes;
+
+public:
+  void insert(quint64 hash, qint64 value);
+  std::vector<std::pair<int, qint64>> find(quint64 hash, int radius) const;
+  int size() const;
+  void clear();
+};
+
+/*!
+ * \brief A perceptual hash of every screenshot in a save folder, searchable
+ * by likeness.
+ * \details similarity.qph starts with a magic number and version, followed by
+ * a fixed size record per picture holding its time, screen and dHash, in the
+ * order they were saved. Records are only appended, by the pipeline's write
+ * thread, and dropped with forget() once their pictures are deleted, both
+ * holding the folder's SaveFolderLock. find()
+ * reads the records it hasn't seen yet into a BkTree kept in memory, so only
+ * the first search reads the whole file.
+ */
+class SimilarityIndex
+{
+  bool load();
+  ///\brief The folder the index describes.
+  QString directory;
+  ///\brief The hashes read so far, valued by record number.
+  BkTree tree;
+  ///\brief The time of each record read so far, in milliseconds.
+  std::vector<qint64> times;
+  ///\brief The screen of each record read so far.
+  std::vector<int> screens;
+
+public:
+  ///\brief Identifies a file as a similarity index.
+  static const quint32 magic = 0x51535048;
+  ///\brief The format version written into new indexes.
+  static const quint32 version = 1;
+  ///\brief The size of the magic number and version.
+  static const int headerSize = 8;
+  ///\brief The size of a record.
+  static const int recordSize = 20;
+  explicit SimilarityIndex(const QString &directory);
+  static quint64 dHash(const QImage &image);
+  static int distance(quint64 a, quint64 b);
+  QString path() const;
+  bool append(const QDateTime &taken, int screen, quint64 hash) const;
+  qint64 count() const;
+  QList<SimilarFrame> find(quint64 hash, int radius, int limit = 100);
+  bool forget(const QList<TimelineEntry> &pictures) const;
+  bool rebuild(const std::function<bool(qint64, qint64)> &progress =
+                   std::function<bool(qint64, qint64)>());
+};
+
+#endif // SIMILARITYINDEX_H
@@ -0,0 +1,90 @@
+#include "similarityrebuilder.h"
+#include "similarityindex.h"
+
+/*!
+ * \brief Creates a rebuilder, nothing runs until rebuild() is called.
+ * \param parent The owning object, used for Qt's memory management.
+ */
+SimilarityRebuilder::SimilarityRebuilder(QObject *parent)
+    : QThread(parent), cancelled(false), hashed(0), pictures(0)
+{
+}
+
+/*!
+ * \brief Stops a running rebuild, and waits for it to finish its current
+ * picture.
+ */
+SimilarityRebuilder::~SimilarityRebuilder()
+{
+  cancel();
+  wait();
+}
+
+/*!
+ * \brief Starts rebuilding at idle priority, unless a rebuild is already
+ * running.
+ * \param directory The save folder whose index is rebuilt.
+ * \return False if a rebuild was already running.
+ */
+bool SimilarityRebuilder::rebuild(const QString &directory)
+{
+  if(isRunning())
+    return false;
+  this->directory = directory;
+  cancelled = false;
+  hashed = 0;
+  pictures = 0;
+  start(QThread::IdlePriority);
+  return true;
+}
+
+/*!
+ * \brief Asks a running rebuild to stop after the picture it is on.
+ */
+void SimilarityRebuilder::cancel() { cancelled = true; }
+
+/*!
+ * \brief Describes what the rebuilder is doing, or how its last rebuild
+ * ended.
+ * \return "Idle", or "Running", "Finished", "Cancelled" or "Failed" with how
+ * many pictures were hashed.
+ */
+QString SimilarityRebuilder::status() const
+{
+  if(isRunning())
+    return "Running: " + counts();
+  QMutexLocker locker(&resultMutex);
+  return lastResult.isEmpty() ? QString("Idle") : lastResult;
+}
+
+/*!
+ * \brief Describes the current rebuild's progress.
+ * \return How many pictures were hashed, out of how many.
+ */
+QString SimilarityRebuilder::counts() const
+{
+  return QString("%1 of %2 pictures hashed")
+      .arg(hashed.load())
+      .arg(pictures.load());
+}
+
+/*!
+ * \brief The rebuild, see SimilarityIndex::rebuild().
+ */
+void SimilarityRebuilder::run()
+{
+  const bool rebuilt = SimilarityIndex(directory).rebuild(
+      [this](qint64 done, qint64 total)
+      {
+        hashed = done;
+        pictures = total;
+        return !cancelled;
+      });
+  QString result = "Failed: ";
+  if(rebuilt)
+    result = "Finished: ";
+  else if(cancelled)
+    result = "Cancelled: ";
+  QMutexLocker locker(&resultMutex);
+  lastResult = result + counts();
+}
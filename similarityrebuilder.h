@@ -0,0 +1,43 @@
+#ifndef SIMILARITYREBUILDER_H
+#define SIMILARITYREBUILDER_H
+#include <QThread>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+/*!
+ * \brief Makes a save folder's SimilarityIndex again in the background.
+ * \details Hashing every picture takes a while for a big folder, so it runs
+ * on its own thread at idle priority, see SimilarityIndex::rebuild(), and
+ * stops between pictures when cancelled, leaving the old index in place.
+ */
+class SimilarityRebuilder : public QThread
+{
+  Q_OBJECT
+public:
+  explicit SimilarityRebuilder(QObject *parent = nullptr);
+  virtual ~SimilarityRebuilder();
+  bool rebuild(const QString &directory);
+  void cancel();
+  QString status() const;
+
+protected:
+  virtual void run() override;
+
+private:
+  QString counts() const;
+  ///\brief The folder whose index is rebuilt.
+  QString directory;
+  ///\brief Set to stop the rebuild between pictures.
+  std::atomic<bool> cancelled;
+  ///\brief How many pictures were hashed so far.
+  std::atomic<qint64> hashed;
+  ///\brief How many pictures there are to hash.
+  std::atomic<qint64> pictures;
+  ///\brief Guards lastResult.
+  mutable QMutex resultMutex;
+  ///\brief How the last rebuild ended, empty if none has.
+  QString lastResult;
+};
+
+#endif // SIMILARITYREBUILDER_H
@@ -0,0 +1,357 @@
+#include "snaparchive.h"
+#include "tilehasher.h"
+#include <QBuffer>
+#include <QDataStream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/*!
+ * \brief Copies a tile's pixels between two RGB32 images.
+ * \details The copy is clipped to the smaller of the two images, so tiles on
+ * the right and bottom edges of a frame come out the right size.
+ * \param from The image to copy from.
+ * \param fromX The left edge of the tile in from.
+ * \param fromY The top edge of the tile in from.
+ * \param to The image to copy to.
+ * \param toX The left edge of the tile in to.
+ * \param toY The top edge of the tile in to.
+ */
+static void copyTile(const QImage &from, int fromX, int fromY, QImage &to,
+                     int toX, int toY)
+{
+  const int width = std::min(
+      {TileHasher::tileSize, from.width() - fromX, to.width() - toX});
+  const int height = std::min(
+      {TileHasher::tileSize, from.height() - fromY, to.height() - toY});
+  for(int y = 0; y < height; ++y)
+    std::memcpy(to.scanLine(toY + y) + toX * 4,
+                from.constScanLine(fromY + y) + fromX * 4, width * 4);
+}
+
+/*!
+ * \brief Creates a writer with no archive open yet.
+ * \param keyframeInterval The most deltas allowed between two keyframes.
+ */
+SnapArchiveWriter::SnapArchiveWriter(int keyframeInterval)
+    : sinceKeyframe(0), keyframeInterval(keyframeInterval)
+{
+}
+
+/*!
+ * \brief Sets how many deltas may follow a keyframe.
+ * \param interval The most deltas allowed between two keyframes.
+ */
+void SnapArchiveWriter::setKeyframeInterval(int interval)
+{
+  keyframeInterval = interval;
+}
+
+/*!
+ * \brief Makes the next record a keyframe, as if no record was built yet.
+ */
+void SnapArchiveWriter::restart()
+{
+  currentPath = QString();
+  currentSize = QSize();
+}
+
+/*!
+ * \brief Builds the record for a picture.
+ * \details If path is not the archive the last record was built for, a new
+ * run of records starts with a keyframe. The archive header is left to
+ * append(), which sees what is actually in the file.
+ * \param path The archive the record will be appended to.
+ * \param frame The picture.
+ * \param taken When the picture was taken.
+ * \param changedTiles The tiles that changed since the last picture given to
+ * this writer, in TileHasher order.
+ * \return The bytes to append to path.
+ */
+QByteArray SnapArchiveWriter::encode(const QString &path, const QImage &frame,
+                                     const QDateTime &taken,
+                                     const std::vector<int> &changedTiles)
+{
+  const QImage source = frame.format() == QImage::Format_RGB32
+                            ? frame
+                            : frame.convertToFormat(QImage::Format_RGB32);
+  const int columns = TileHasher::tileColumns(source.width());
+  const int tiles = columns * TileHasher::tileRows(source.height());
+
+  QByteArray record;
+  QDataStream stream(&record, QIODevice::WriteOnly);
+  if(path != currentPath)
+  {
+    currentPath = path;
+    currentSize = QSize();
+  }
+  const bool keyframe = source.size() != currentSize ||
+                        sinceKeyframe >= keyframeInterval ||
+                        static_cast<int>(changedTiles.size()) * 2 > tiles;
+
+  QByteArray payload;
+  QDataStream payloadStream(&payload, QIODevice::WriteOnly);
+  payloadStream << qint32(source.width()) << qint32(source.height());
+  QImage picture;
+  if(keyframe)
+  {
+    picture = source;
+    currentSize = source.size();
+    sinceKeyframe = 0;
+  }
+  else
+  {
+    const int count = static_cast<int>(changedTiles.size());
+    payloadStream << quint32(count);
+    if(count > 0)
+    {
+      const int mosaicColumns =
+          static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+      const int mosaicRows = (count + mosaicColumns - 1) / mosaicColumns;
+      picture = QImage(mosaicColumns * TileHasher::tileSize,
+                       mosaicRows * TileHasher::tileSize, QImage::Format_RGB32);
+      picture.fill(Qt::black);
+      for(int i = 0; i < count; ++i)
+      {
+        const int tile = changedTiles[i];
+        payloadStream << quint16(tile % columns) << quint16(tile / columns);
+        copyTile(source, (tile % columns) * TileHasher::tileSize,
+                 (tile / columns) * TileHasher::tileSize, picture,
+                 (i % mosaicColumns) * TileHasher::tileSize,
+                 (i / mosaicColumns) * TileHasher::tileSize);
+      }
+    }
+    ++sinceKeyframe;
+  }
+  QBuffer encoded;
+  encoded.open(QIODevice::WriteOnly);
+  if(!picture.isNull())
+    picture.save(&encoded, "JPG");
+  payloadStream << encoded.data();
+
+  stream << (keyframe ? keyframeRecord : deltaRecord)
+         << qint64(taken.toMSecsSinceEpoch()) << quint32(payload.size());
+  stream.writeRawData(payload.constData(), payload.size());
+  return record;
+}
+
+/*!
+ * \brief Checks if a record built by encode() holds a whole picture.
+ * \param record The record.
+ * \return True for a keyframe.
+ */
+bool SnapArchiveWriter::isKeyframe(const QByteArray &record)
+{
+  return !record.isEmpty() &&
+         static_cast<quint8>(record.at(0)) == keyframeRecord;
+}
+
+/*!
+ * \brief Appends a record built by encode() to an archive.
+ * \details The archive header goes first when the file is empty, whatever
+ * happened to earlier records. If the record can't be written in full, the
+ * file is cut back to where it was, so it always ends on a whole record.
+ * \param file The archive, open for appending.
+ * \param record The record.
+ * \return Where the record starts in the file, or -1 if it wasn't written.
+ */
+qint64 SnapArchiveWriter::append(QFile &file, const QByteArray &record)
+{
+  const qint64 start = file.size();
+  QByteArray bytes;
+  if(start == 0)
+  {
+    QDataStream stream(&bytes, QIODevice::WriteOnly);
+    stream << magic << version;
+  }
+  bytes += record;
+  if(file.write(bytes) != bytes.size() || !file.flush())
+  {
+    file.resize(start);
+    return -1;
+  }
+  return start + (bytes.size() - record.size());
+}
+
+/*!
+ * \brief Gets the archive a day's screenshots go into.
+ * \param dir The directory screenshots are saved to.
+ * \param date The day.
+ * \param suffix Added after the date, used to tell screens apart.
+ * \return The path of the day's archive, named yyyyMMdd[suffix].qsa
+ */
+QString SnapArchiveWriter::archiveName(const QString &dir, const QDate &date,
+                                       const QString &suffix)
+{
+  return dir + '/' + date.toString("yyyyMMdd") + suffix + ".qsa";
+}
+
+/*!
+ * \brief Opens an archive and reads where each record is.
+ * \details A record cut short at the end of the file, from a crash while it
+ * was being written, is ignored.
+ * \param path The archive to read.
+ */
+SnapArchiveReader::SnapArchiveReader(const QString &path)
+    : file(path), valid(false), decodedIndex(-1)
+{
+  if(!file.open(QIODevice::ReadOnly))
+    return;
+  QDataStream stream(&file);
+  quint32 fileMagic;
+  quint16 fileVersion;
+  stream >> fileMagic >> fileVersion;
+  valid = stream.status() == QDataStream::Ok &&
+          fileMagic == SnapArchiveWriter::magic &&
+          fileVersion <= SnapArchiveWriter::version;
+  while(valid && !stream.atEnd())
+  {
+    quint8 type;
+    Record record;
+    stream >> type >> record.msecs >> record.size;
+    record.keyframe = type == SnapArchiveWriter::keyframeRecord;
+    record.offset = file.pos();
+    if(stream.status() != QDataStream::Ok ||
+       record.offset + record.size > file.size())
+      break;
+    records.append(record);
+    file.seek(record.offset + record.size);
+  }
+}
+
+/*!
+ * \brief Checks if the file could be opened and is an archive.
+ * \return If pictures can be read from the archive.
+ */
+bool SnapArchiveReader::isValid() const { return valid; }
+
+/*!
+ * \brief Gets where each record in the archive starts.
+ * \return The offsets of the records' type bytes, in the order they were
+ * written.
+ */
+QList<qint64> SnapArchiveReader::recordOffsets() const
+{
+  QList<qint64> offsets;
+  for(const Record &record : records)
+    offsets.append(record.offset - SnapArchiveWriter::recordHeaderSize);
+  return offsets;
+}
+
+/*!
+ * \brief Gets when each picture in the archive was taken.
+ * \return The times, in the order they were written.
+ */
+QList<QDateTime> SnapArchiveReader::timestamps() const
+{
+  QList<QDateTime> times;
+  for(const Record &record : records)
+    times.append(QDateTime::fromMSecsSinceEpoch(record.msecs));
+  return times;
+}
+
+/*!
+ * \brief Paints one record onto a picture.
+ * \param record The record to apply.
+ * \param frame Replaced by a keyframe, or patched by a delta.
+ * \return False if the record could not be read, or a delta does not match
+ * the picture's size.
+ */
+bool SnapArchiveReader::applyRecord(const Record &record, QImage &frame)
+{
+  if(!file.seek(record.offset))
+    return false;
+  QDataStream stream(file.read(record.size));
+  qint32 width, height;
+  stream >> width >> height;
+  if(record.keyframe)
+  {
+    QByteArray jpeg;
+    stream >> jpeg;
+    frame = QImage::fromData(jpeg).convertToFormat(QImage::Format_RGB32);
+    return frame.width() == width && frame.height() == height;
+  }
+  if(frame.width() != width || frame.height() != height)
+    return false;
+  quint32 count;
+  stream >> count;
+  QVector<QPair<quint16, quint16>> tiles;
+  for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+  {
+    quint16 column, row;
+    stream >> column >> row;
+    tiles.append(qMakePair(column, row));
+  }
+  QByteArray jpeg;
+  stream >> jpeg;
+  if(stream.status() != QDataStream::Ok)
+    return false;
+  if(tiles.isEmpty())
+    return true;
+  const QImage mosaic =
+      QImage::fromData(jpeg).convertToFormat(QImage::Format_RGB32);
+  const int mosaicColumns = mosaic.width() / TileHasher::tileSize;
+  if(mosaicColumns == 0)
+    return false;
+  for(int i = 0; i < tiles.size(); ++i)
+  {
+    copyTile(mosaic, (i % mosaicColumns) * TileHasher::tileSize,
+             (i / mosaicColumns) * TileHasher::tileSize, frame,
+             tiles[i].first * TileHasher::tileSize,
+             tiles[i].second * TileHasher::tileSize);
+  }
+  return true;
+}
+
+/*!
+ * \brief Rebuilds the picture that was on screen at a given time.
+ * \details Starts from the last picture rebuilt instead of the keyframe, if
+ * that picture is between the two.
+ * \param when The time to rebuild.
+ * \return The last picture taken at or before when, or a null image if there
+ * is none or the archive is damaged.
+ */
+QImage SnapArchiveReader::frameAt(const QDateTime &when)
+{
+  const qint64 msecs = when.toMSecsSinceEpoch();
+  int target = -1;
+  for(int i = 0; i < records.size() && records[i].msecs <= msecs; ++i)
+    target = i;
+  int start = target;
+  while(start >= 0 && !records[start].keyframe)
+    --start;
+  if(start < 0)
+    return QImage();
+  QImage frame;
+  if(decodedIndex >= start && decodedIndex <= target)
+  {
+    frame = decoded;
+    start = decodedIndex + 1;
+  }
+  for(int i = start; i <= target; ++i)
+  {
+    if(!applyRecord(records[i], frame))
+    {
+      decodedIndex = -1;
+      decoded = QImage();
+      return QImage();
+    }
+  }
+  decodedIndex = target;
+  decoded = frame;
+  return frame;
+}
+
+/*!
+ * \brief Saves the picture that was on screen at a given time as a plain file.
+ * \param when The time to rebuild.
+ * \param fileName Where to save it, the extension picks the format (.jpg,
+ * .png, etc).
+ * \return If a picture was found and saved.
+ */
+bool SnapArchiveReader::exportFrame(const QDateTime &when,
+                                    const QString &fileName)
+{
+  const QImage frame = frameAt(when);
+  return !frame.isNull() && frame.save(fileName);
+}
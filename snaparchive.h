@@ -0,0 +1,102 @@
+#ifndef SNAPARCHIVE_H
+#define SNAPARCHIVE_H
+#include <QDateTime>
+#include <QFile>
+#include <QImage>
+#include <QVector>
+#include <vector>
+
+/*!
+ * \brief Builds the records of a screenshot archive.
+ * \details An archive holds a day of screenshots as a sequence of records.
+ * A keyframe record holds a whole picture, and a delta record holds only the
+ * tiles (see TileHasher) that changed since the record before it, packed into
+ * a single mosaic picture along with their positions.
+ * A keyframe is written at the start of every file and session, whenever the
+ * screen size changes, when more than half the tiles changed, and otherwise
+ * every keyframeInterval records, so rebuilding a picture never has to replay
+ * too many deltas.
+ * Records are built ahead of being written, so a writer's idea of the file
+ * can run ahead of the file itself. The caller appends them to the file named
+ * by archiveName() with append(), and calls restart() if one couldn't be
+ * written, since the deltas built after it have nothing to apply to.
+ */
+class SnapArchiveWriter
+{
+  ///\brief The archive the last record was built for.
+  QString currentPath;
+  ///\brief The size of the pictures in the current run of records.
+  QSize currentSize;
+  ///\brief How many deltas were built since the last keyframe.
+  int sinceKeyframe;
+  ///\brief The most deltas allowed between two keyframes.
+  int keyframeInterval;
+
+public:
+  ///\brief Identifies a file as a screenshot archive.
+  static const quint32 magic = 0x51534E41;
+  ///\brief The format version written into new archives.
+  static const quint16 version = 1;
+  ///\brief Marks a record holding a whole picture.
+  static const quint8 keyframeRecord = 0;
+  ///\brief Marks a record holding only changed tiles.
+  static const quint8 deltaRecord = 1;
+  ///\brief The size of the magic number and version at the start of a file.
+  static const int headerSize = 6;
+  ///\brief The size of a record's type, time and payload size.
+  static const int recordHeaderSize = 13;
+  explicit SnapArchiveWriter(int keyframeInterval = 60);
+  void setKeyframeInterval(int interval);
+  void restart();
+  QByteArray encode(const QString &path, const QImage &frame,
+                    const QDateTime &taken,
+                    const std::vector<int> &changedTiles);
+  static bool isKeyframe(const QByteArray &record);
+  static qint64 append(QFile &file, const QByteArray &record);
+  static QString archiveName(const QString &dir, const QDate &date,
+                             const QString &suffix = QString());
+};
+
+/*!
+ * \brief Reads pictures back out of a screenshot archive.
+ * \details Opening an archive only reads the record headers. Rebuilding a
+ * picture decodes the keyframe before it and paints the deltas after that
+ * keyframe on top. The last picture rebuilt is kept, so reading pictures in
+ * the order they were taken only decodes each record once.
+ */
+class SnapArchiveReader
+{
+  ///\brief Where a record is in the file.
+  struct Record
+  {
+    ///\brief When the record's picture was taken.
+    qint64 msecs;
+    ///\brief If the record holds a whole picture.
+    bool keyframe;
+    ///\brief Where the record's payload starts.
+    qint64 offset;
+    ///\brief The size of the record's payload.
+    quint32 size;
+  };
+  ///\brief The archive.
+  QFile file;
+  ///\brief Every complete record, in the order they were written.
+  QVector<Record> records;
+  ///\brief If the file is an archive this version can read.
+  bool valid;
+  ///\brief The record decoded is the picture of, -1 if none.
+  int decodedIndex;
+  ///\brief The last picture rebuilt.
+  QImage decoded;
+  bool applyRecord(const Record &record, QImage &frame);
+
+public:
+  explicit SnapArchiveReader(const QString &path);
+  bool isValid() const;
+  QList<QDateTime> timestamps() const;
+  QList<qint64> recordOffsets() const;
+  QImage frameAt(const QDateTime &when);
+  bool exportFrame(const QDateTime &when, const QString &fileName);
+};
+
+#endif // SNAPARCHIVE_H
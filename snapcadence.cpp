@@ -0,0 +1,60 @@
+#include "snapcadence.h"
+#include <algorithm>
+
+/*!
+ * \brief Creates a cadence waiting the minimum interval.
+ * \param minimumInterval The wait while the screen is changing.
+ * \param maximumInterval The longest the wait may grow to.
+ */
+SnapCadence::SnapCadence(int minimumInterval, int maximumInterval)
+{
+  setBounds(minimumInterval, maximumInterval);
+}
+
+/*!
+ * \brief Changes the bounds, and goes back to waiting the minimum interval.
+ * \details The minimum is at least one second, and the maximum is never less
+ * than the minimum.
+ * \param minimumInterval The wait while the screen is changing.
+ * \param maximumInterval The longest the wait may grow to.
+ */
+void SnapCadence::setBounds(int minimumInterval, int maximumInterval)
+{
+  minimum = std::max(minimumInterval, 1000);
+  maximum = std::max(maximumInterval, minimum);
+  recordChanged();
+}
+
+/*!
+ * \brief Gets how long to wait before the next screenshot.
+ * \return The wait in milliseconds.
+ */
+int SnapCadence::interval() const { return current; }
+
+/*!
+ * \brief Gets how many periods in a row passed without a change.
+ * \return The number of unchanged periods since the last change.
+ */
+int SnapCadence::unchangedStreak() const { return streak; }
+
+/*!
+ * \brief Notes that the screen changed, going back to the minimum interval.
+ * \return The new interval.
+ */
+int SnapCadence::recordChanged()
+{
+  current = minimum;
+  streak = 0;
+  return current;
+}
+
+/*!
+ * \brief Notes that a period passed without a change, doubling the interval.
+ * \return The new interval, at most the maximum.
+ */
+int SnapCadence::recordUnchanged()
+{
+  ++streak;
+  current = current > maximum / 2 ? maximum : current * 2;
+  return current;
+}
@@ -0,0 +1,32 @@
+#ifndef SNAPCADENCE_H
+#define SNAPCADENCE_H
+
+/*!
+ * \brief Decides how long to wait between screenshots.
+ * \details Starts at the minimum interval. Every period without a change
+ * doubles the wait, up to the maximum, so a screen left alone overnight is
+ * only pictured a few times an hour. As soon as a change is seen the wait
+ * drops straight back to the minimum.
+ * All intervals are in milliseconds.
+ */
+class SnapCadence
+{
+  ///\brief The wait while the screen is changing.
+  int minimum;
+  ///\brief The longest the wait may grow to.
+  int maximum;
+  ///\brief The current wait.
+  int current;
+  ///\brief How many periods in a row passed without a change.
+  int streak;
+
+public:
+  SnapCadence(int minimumInterval = 60000, int maximumInterval = 1800000);
+  void setBounds(int minimumInterval, int maximumInterval);
+  int interval() const;
+  int unchangedStreak() const;
+  int recordChanged();
+  int recordUnchanged();
+};
+
+#endif // SNAPCADENCE_H
@@ -0,0 +1,462 @@
+#include "snapcompactor.h"
+#include "contentstore.h"
+#include "savefolderlock.h"
+#include "similarityindex.h"
+#include "timelineindex.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QImage>
+#include <QRegularExpression>
+#include <QTextStream>
+
+/*!
+ * \brief Keeps today as taken and every picture of the last week, with no
+ * quota.
+ */
+SnapCompactor::Policy::Policy()
+    : quotaBytes(0), fullDays(1), reducedDays(7), reducedQuality(60)
+{
+}
+
+/*!
+ * \brief Creates a compactor, no pass runs until compact() is called.
+ * \param parent The owning object, used for Qt's memory management.
+ */
+SnapCompactor::SnapCompactor(QObject *parent)
+    : QThread(parent), cancelled(false), reduced(0), removed(0), freed(0)
+{
+}
+
+/*!
+ * \brief Stops a running pass, and waits for it to finish its current file.
+ */
+SnapCompactor::~SnapCompactor()
+{
+  cancel();
+  wait();
+}
+
+/*!
+ * \brief Starts a pass at idle priority, unless one is already running.
+ * \param directory The save folder to compact.
+ * \param policy How hard to compact.
+ * \param today The day ages are counted from.
+ * \return False if a pass was already running.
+ */
+bool SnapCompactor::compact(const QString &directory, const Policy &policy,
+                            const QDate &today)
+{
+  if(isRunning())
+    return false;
+  this->directory = directory;
+  this->policy = policy;
+  this->today = today;
+  cancelled = false;
+  reduced = 0;
+  removed = 0;
+  freed = 0;
+  removedNames.clear();
+  droppedRecords.clear();
+  start(QThread::IdlePriority);
+  return true;
+}
+
+/*!
+ * \brief Asks a running pass to stop after the file it is on.
+ */
+void SnapCompactor::cancel() { cancelled = true; }
+
+/*!
+ * \brief Describes what the compactor is doing, or how its last pass ended.
+ * \return "Idle", or "Running", "Finished" or "Cancelled" with how many files
+ * were reduced and removed and how much space was freed.
+ */
+QString SnapCompactor::status() const
+{
+  if(isRunning())
+    return "Running: " + counts();
+  QMutexLocker locker(&resultMutex);
+  return lastResult.isEmpty() ? QString("Idle") : lastResult;
+}
+
+/*!
+ * \brief Describes the current pass's progress.
+ * \return How many files were reduced and removed, and the space freed.
+ */
+QString SnapCompactor::counts() const
+{
+  return QString("%1 reduced, %2 removed, %3 KiB freed")
+      .arg(reduced.load())
+      .arg(removed.load())
+      .arg(freed.load() / 1024);
+}
+
+/*!
+ * \brief Gets how many pictures were saved smaller by the last pass.
+ * \return The number of pictures.
+ */
+int SnapCompactor::reducedFiles() const { return reduced; }
+
+/*!
+ * \brief Gets how many files the last pass deleted.
+ * \return The number of files.
+ */
+int SnapCompactor::removedFiles() const { return removed; }
+
+/*!
+ * \brief Gets how much space the last pass freed.
+ * \return The number of bytes.
+ */
+qint64 SnapCompactor::freedBytes() const { return freed; }
+
+/*!
+ * \brief One pass over the save folder, see the class description.
+ * \details Picture names start with the time they were taken, so listing
+ * them by name walks them oldest first. Pictures named _2, _3, etc. after
+ * their screen number were taken in the same second as the one before.
+ */
+void SnapCompactor::run()
+{
+  const QDir dir(directory);
+  QSet<QString> manifest;
+  QFile manifestFile(dir.filePath(".compacted"));
+  if(manifestFile.open(QIODevice::ReadOnly))
+  {
+    QTextStream stream(&manifestFile);
+    while(!stream.atEnd())
+      manifest.insert(stream.readLine());
+    manifestFile.close();
+  }
+  QSet<QString> hoursKept;
+  for(const QFileInfo &info : dir.entryInfoList(QStringList() << "*.jpg",
+                                                QDir::Files, QDir::Name))
+  {
+    if(cancelled)
+      break;
+    const QString base = info.completeBaseName();
+    const QDateTime taken =
+        QDateTime::fromString(base.left(14), "yyyyMMddhhmmss");
+    if(!taken.isValid())
+      continue;
+    const qint64 age = taken.date().daysTo(today);
+    if(age < policy.fullDays)
+      continue;
+    if(age >= policy.reducedDays)
+    {
+      const QString hour = base.left(10) + base.mid(14).section('_', 0, 0);
+      if(hoursKept.contains(hour))
+      {
+        removePicture(info.fileName());
+        continue;
+      }
+      hoursKept.insert(hour);
+    }
+    if(!manifest.contains(info.fileName()))
+    {
+      reduce(info.filePath());
+      manifest.insert(info.fileName());
+      if(manifestFile.open(QIODevice::Append))
+      {
+        manifestFile.write(info.fileName().toUtf8() + '\n');
+        manifestFile.close();
+      }
+    }
+  }
+  if(!cancelled)
+    pruneThumbnails();
+  if(!cancelled && policy.quotaBytes > 0)
+    enforceQuota();
+  if(!cancelled)
+    pruneManifest(manifest);
+  const bool indexed = forgetRemoved();
+  QMutexLocker locker(&resultMutex);
+  lastResult = (cancelled ? "Cancelled: " : "Finished: ") + counts() +
+               (indexed ? "" : ", the indexes need rebuilding");
+}
+
+/*!
+ * \brief Saves a picture again at half the size and the reduced quality.
+ * \details Written to a temporary name first, so a cancelled or crashed
+ * pass never leaves half a picture behind.
+ * \param path The picture.
+ */
+void SnapCompactor::reduce(const QString &path)
+{
+  const QImage image(path);
+  if(image.width() < 2 || image.height() < 2)
+    return;
+  const qint64 before = QFileInfo(path).size();
+  const QString temporary = path + ".part";
+  if(!image.scaled(image.size() / 2, Qt::IgnoreAspectRatio,
+                   Qt::SmoothTransformation)
+          .save(temporary, "JPG", policy.reducedQuality))
+  {
+    QFile::remove(temporary);
+    return;
+  }
+  QFile::remove(path);
+  QFile::rename(temporary, path);
+  freed += before - QFileInfo(path).size();
+  ++reduced;
+}
+
+/*!
+ * \brief Deletes a file, counting the space freed.
+ * \param path The file.
+ * \return How many bytes were freed, 0 if the file wasn't deleted.
+ */
+qint64 SnapCompactor::remove(const QString &path)
+{
+  const qint64 size = QFileInfo(path).size();
+  if(!QFile::remove(path))
+    return 0;
+  freed += size;
+  ++removed;
+  return size;
+}
+
+/*!
+ * \brief Finds a picture's thumbnails, see ThumbnailLoader.
+ * \details A picture on its own has one thumbnail of the same name under
+ * .thumbs/. An archive has one per picture in it, named after the archive
+ * with the time the picture was taken added.
+ * \param fileName The picture, relative to the save folder.
+ * \return The thumbnails that exist.
+ */
+QStringList SnapCompactor::thumbnailsOf(const QString &fileName) const
+{
+  const QDir thumbs(directory + "/.thumbs");
+  QStringList paths;
+  if(!fileName.endsWith(".qsa"))
+  {
+    if(QFile::exists(thumbs.filePath(fileName)))
+      paths.append(thumbs.filePath(fileName));
+    return paths;
+  }
+  const QString base = fileName.left(fileName.size() - 4);
+  const QRegularExpression name('^' + QRegularExpression::escape(base) +
+                                "-\\d+\\.jpg$");
+  for(const QString &thumbnail :
+      thumbs.entryList(QStringList() << base + "-*.jpg", QDir::Files))
+  {
+    if(name.match(thumbnail).hasMatch())
+      paths.append(thumbs.filePath(thumbnail));
+  }
+  return paths;
+}
+
+/*!
+ * \brief Gets how much space deleting a picture would free.
+ * \param fileName The picture, relative to the save folder.
+ * \return The bytes of the picture and its thumbnails.
+ */
+qint64 SnapCompactor::pictureSize(const QString &fileName) const
+{
+  qint64 size = QFileInfo(directory + '/' + fileName).size();
+  for(const QString &thumbnail : thumbnailsOf(fileName))
+    size += QFileInfo(thumbnail).size();
+  return size;
+}
+
+/*!
+ * \brief Deletes a picture and its thumbnails, counting the space freed.
+ * \details Only the picture counts as a removed file.
+ * \param fileName The picture, relative to the save folder.
+ */
+void SnapCompactor::removePicture(const QString &fileName)
+{
+  for(const QString &thumbnail : thumbnailsOf(fileName))
+  {
+    const qint64 size = QFileInfo(thumbnail).size();
+    if(QFile::remove(thumbnail))
+      freed += size;
+  }
+  if(remove(directory + '/' + fileName) > 0)
+    removedNames.insert(fileName);
+}
+
+/*!
+ * \brief Deletes the thumbnails whose picture is gone.
+ * \details A thumbnail named like a picture is kept while the picture is
+ * there, one named like an archive with a time added while the archive is.
+ */
+void SnapCompactor::pruneThumbnails()
+{
+  const QDir dir(directory);
+  const QDir thumbs(dir.filePath(".thumbs"));
+  QDirIterator it(thumbs.path(), QDir::Files, QDirIterator::Subdirectories);
+  while(it.hasNext() && !cancelled)
+  {
+    const QString path = it.next();
+    const QString fileName = thumbs.relativeFilePath(path);
+    if(dir.exists(fileName))
+      continue;
+    const QString archive = fileName.section('-', 0, -2) + ".qsa";
+    if(fileName.contains('-') && dir.exists(archive))
+      continue;
+    const qint64 size = QFileInfo(path).size();
+    if(QFile::remove(path))
+      freed += size;
+  }
+}
+
+/*!
+ * \brief Drops the names of pictures that are gone from .compacted.
+ * \details Written to a temporary name first, like reduced pictures.
+ * \param manifest The names in .compacted.
+ */
+void SnapCompactor::pruneManifest(const QSet<QString> &manifest)
+{
+  const QDir dir(directory);
+  QByteArray kept;
+  bool changed = false;
+  for(const QString &fileName : manifest)
+  {
+    if(dir.exists(fileName))
+      kept += fileName.toUtf8() + '\n';
+    else
+      changed = true;
+  }
+  if(!changed)
+    return;
+  const QString path = dir.filePath(".compacted");
+  QFile file(path + ".part");
+  if(!file.open(QIODevice::WriteOnly) || file.write(kept) != kept.size())
+  {
+    file.remove();
+    return;
+  }
+  file.close();
+  QFile::remove(path);
+  file.rename(path);
+}
+
+/*!
+ * \brief Deletes the oldest pictures until the folder fits the quota, never
+ * touching today's.
+ * \details Pictures on their own and archives are walked by name, the
+ * ContentStore's index by record, whichever is older first. A dropped record
+ * frees its bytes in the index, and its picture once no record is left that
+ * points to it. The index is rewritten once at the end, and only then are
+ * those pictures deleted, checking the index again in case the same screen
+ * was stored meanwhile. The folder's SaveFolderLock is held from the rewrite
+ * to the last deletion, so the write thread can't store a picture that is
+ * about to be deleted.
+ */
+void SnapCompactor::enforceQuota()
+{
+  const QDir dir(directory);
+  qint64 total = 0;
+  for(const QString &folder : {QString("objects"), QString(".thumbs")})
+  {
+    QDirIterator it(dir.filePath(folder), QDir::Files,
+                    QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+      it.next();
+      total += it.fileInfo().size();
+    }
+  }
+  QList<QPair<QDateTime, QString>> files;
+  for(const QFileInfo &info :
+      dir.entryInfoList(QStringList() << "*.jpg" << "*.qsa", QDir::Files,
+                        QDir::Name))
+  {
+    total += info.size();
+    const QString base = info.completeBaseName();
+    const QDate day = QDate::fromString(base.left(8), "yyyyMMdd");
+    if(!day.isValid() || day >= today)
+      continue;
+    const QDateTime taken =
+        QDateTime::fromString(base.left(14), "yyyyMMddhhmmss");
+    files.append(
+        qMakePair(taken.isValid() ? taken : QDateTime(day, QTime(0, 0)),
+                  info.fileName()));
+  }
+  const ContentStore store(directory);
+  total += QFileInfo(store.indexPath()).size();
+  const QList<ContentStoreEntry> records = store.entries();
+  QHash<QByteArray, int> references;
+  for(const ContentStoreEntry &record : records)
+    ++references[record.key];
+  int droppable = 0;
+  while(droppable < records.size() &&
+        records[droppable].taken.date() < today)
+    ++droppable;
+
+  QList<QByteArray> unreferenced;
+  QSet<QPair<qint64, int>> forgotten;
+  int next = 0;
+  int dropped = 0;
+  while(total > policy.quotaBytes && !cancelled &&
+        (next < files.size() || dropped < droppable))
+  {
+    if(dropped < droppable &&
+       (next == files.size() || records[dropped].taken < files[next].first))
+    {
+      const ContentStoreEntry &record = records[dropped++];
+      const QByteArray &key = record.key;
+      forgotten.insert(
+          qMakePair(record.taken.toMSecsSinceEpoch(), record.screen));
+      total -= ContentStore::recordSize;
+      if(--references[key] == 0)
+      {
+        total -= pictureSize(dir.relativeFilePath(store.objectPath(key)));
+        unreferenced.append(key);
+      }
+      continue;
+    }
+    const QString fileName = files[next++].second;
+    total -= pictureSize(fileName);
+    removePicture(fileName);
+  }
+  if(dropped == 0)
+    return;
+  QMutexLocker locker(SaveFolderLock::of(directory));
+  if(!store.forget(dropped))
+    return;
+  freed += qint64(dropped) * ContentStore::recordSize;
+  droppedRecords += forgotten;
+  QSet<QByteArray> recorded;
+  for(const ContentStoreEntry &record : store.entries())
+    recorded.insert(record.key);
+  for(const QByteArray &key : unreferenced)
+  {
+    if(recorded.contains(key))
+      continue;
+    const QString path = store.objectPath(key);
+    removePicture(dir.relativeFilePath(path));
+    dir.rmdir(QFileInfo(path).path());
+  }
+}
+
+/*!
+ * \brief Drops the pictures deleted in this pass from the folder's indexes.
+ * \details Pictures on their own and archives are dropped by name, and
+ * ContentStore pictures by the records dropped, since a stored picture can
+ * outlive some of its records. Done even if the pass was cancelled, so no
+ * deleted picture is left in them, holding the folder's SaveFolderLock so
+ * the write thread waits rather than appending to an index being rewritten.
+ * \return If both indexes were rewritten, or nothing was deleted.
+ */
+bool SnapCompactor::forgetRemoved()
+{
+  if(removedNames.isEmpty() && droppedRecords.isEmpty())
+    return true;
+  QMutexLocker locker(SaveFolderLock::of(directory));
+  QList<TimelineEntry> forgotten;
+  return TimelineIndex(directory).forget(
+             [this](const TimelineEntry &entry)
+             {
+               return entry.hash.isEmpty()
+                          ? removedNames.contains(entry.fileName)
+                          : droppedRecords.contains(qMakePair(
+                                entry.taken.toMSecsSinceEpoch(),
+                                entry.screen));
+             },
+             &forgotten) &&
+         SimilarityIndex(directory).forget(forgotten);
+}
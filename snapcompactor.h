@@ -0,0 +1,95 @@
+#ifndef SNAPCOMPACTOR_H
+#define SNAPCOMPACTOR_H
+#include <QThread>
+#include <QDate>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+
+/*!
+ * \brief Shrinks the save folder in the background.
+ * \details Works on the pictures QSnapper saves a file each for, named
+ * yyyyMMddhhmmss[-screen].jpg, in tiers by age:
+ * - Pictures from the last fullDays days are left alone.
+ * - Older ones, up to reducedDays days, are saved again at half the size and
+ * reducedQuality. Each is only done once, the names are kept in .compacted.
+ * - Older still, only the first picture of each hour of each screen is kept.
+ * Last, if the folder still holds more than quotaBytes of pictures,
+ * archives, ContentStore pictures and its index, and thumbnails, the oldest
+ * pictures are deleted until it fits. Today's pictures are never deleted.
+ * A deleted picture's thumbnails go with it, as do thumbnails whose picture
+ * is gone, and .compacted only keeps the names of pictures still there.
+ * The deleted pictures are then dropped from the TimelineIndex and the
+ * SimilarityIndex.
+ * A pass runs on its own thread at idle priority and stops between files
+ * when cancelled.
+ */
+class SnapCompactor : public QThread
+{
+  Q_OBJECT
+public:
+  ///\brief How hard to compact.
+  struct Policy
+  {
+    Policy();
+    ///\brief The most bytes of pictures to keep, 0 for no limit.
+    qint64 quotaBytes;
+    ///\brief How many days, counting today, are kept as taken.
+    int fullDays;
+    ///\brief How many days, counting today, keep every picture.
+    int reducedDays;
+    ///\brief The JPEG quality reduced pictures are saved with.
+    int reducedQuality;
+  };
+  explicit SnapCompactor(QObject *parent = nullptr);
+  virtual ~SnapCompactor();
+  bool compact(const QString &directory, const Policy &policy,
+               const QDate &today = QDate::currentDate());
+  void cancel();
+  QString status() const;
+  int reducedFiles() const;
+  int removedFiles() const;
+  qint64 freedBytes() const;
+
+protected:
+  virtual void run() override;
+
+private:
+  QString counts() const;
+  void reduce(const QString &path);
+  qint64 remove(const QString &path);
+  QStringList thumbnailsOf(const QString &fileName) const;
+  qint64 pictureSize(const QString &fileName) const;
+  void removePicture(const QString &fileName);
+  void pruneThumbnails();
+  void pruneManifest(const QSet<QString> &manifest);
+  void enforceQuota();
+  bool forgetRemoved();
+  ///\brief The folder being compacted.
+  QString directory;
+  ///\brief How hard to compact.
+  Policy policy;
+  ///\brief The day pictures' ages are counted from.
+  QDate today;
+  ///\brief Set to stop the pass between files.
+  std::atomic<bool> cancelled;
+  ///\brief How many pictures were saved smaller in this pass.
+  std::atomic<int> reduced;
+  ///\brief How many files were deleted in this pass.
+  std::atomic<int> removed;
+  ///\brief How many bytes this pass saved.
+  std::atomic<qint64> freed;
+  ///\brief The pictures deleted in this pass, relative to the folder.
+  QSet<QString> removedNames;
+  ///\brief The time and screen of the ContentStore records dropped.
+  QSet<QPair<qint64, int>> droppedRecords;
+  ///\brief Guards lastResult.
+  mutable QMutex resultMutex;
+  ///\brief How the last pass ended, empty if none has.
+  QString lastResult;
+};
+
+#endif // SNAPCOMPACTOR_H
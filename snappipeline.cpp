@@ -0,0 +1,158 @@
+#include "snappipeline.h"
+
+/*!
+ * \brief Creates an empty job, with every option off.
+ */
+SnapJob::SnapJob()
+    : screen(0), quality(75), lenient(false), sampleErrorRate(0),
+      saveDifference(false), diffRegions(false), tileHashing(false),
+      archive(false), contentStore(false), frameHash(0), verbose(false),
+      stop(false)
+{
+}
+
+/*!
+ * \brief Starts every count at 0.
+ */
+SnapCounts::SnapCounts() : dropped(0), skipped(0), failed(0), saved(0) {}
+
+/*!
+ * \brief Starts a thread for each stage.
+ * \param parent The owning object, used for Qt's memory management.
+ * \param diff Decides if a picture is worth keeping.
+ * \param encode Fills in SnapJob::encoded.
+ * \param write Puts the encoded picture on disk.
+ * \param capacity How many jobs may wait in front of each stage.
+ */
+SnapPipeline::SnapPipeline(QObject *parent, Stage diff, Stage encode,
+                           Stage write, int capacity)
+    : QObject(parent), dropped(0), skipped(0), failed(0), written(0),
+      finished(false)
+{
+  toDiff.set_capacity(capacity);
+  toEncode.set_capacity(capacity);
+  toWrite.set_capacity(capacity);
+  diffThread =
+      std::thread([=]() { runStage(diff, &toDiff, &toEncode, &skipped); });
+  encodeThread = std::thread(
+      [=]() { runStage(encode, &toEncode, &toWrite, &failed); });
+  writeThread =
+      std::thread([=]() { runStage(write, &toWrite, nullptr, &failed); });
+}
+
+/*!
+ * \brief Lets every queued picture finish, then stops the threads.
+ */
+SnapPipeline::~SnapPipeline() { finish(); }
+
+/*!
+ * \brief Hands a picture to the pipeline without waiting.
+ * \param job The picture and the options it should be handled with.
+ * \return False if the pipeline was full or finished, and the picture was
+ * dropped.
+ */
+bool SnapPipeline::submit(const SnapJob &job)
+{
+  if(!finished && toDiff.try_push(job))
+    return true;
+  ++dropped;
+  return false;
+}
+
+/*!
+ * \brief Lets every queued picture finish, then stops the threads.
+ * \details Afterwards the counts are final, and pictures submitted are
+ * dropped.
+ */
+void SnapPipeline::finish()
+{
+  if(finished)
+    return;
+  finished = true;
+  SnapJob stopJob;
+  stopJob.stop = true;
+  toDiff.push(stopJob);
+  diffThread.join();
+  encodeThread.join();
+  writeThread.join();
+}
+
+/*!
+ * \brief Gets how many pictures were dropped because the pipeline was full.
+ * \return The number of dropped pictures since the pipeline started.
+ */
+int SnapPipeline::droppedFrames() const { return dropped; }
+
+/*!
+ * \brief Gets how many pictures the diff stage dropped as unchanged.
+ * \return The number of skipped pictures since the pipeline started.
+ */
+int SnapPipeline::skippedFrames() const { return skipped; }
+
+/*!
+ * \brief Gets how many pictures could not be encoded or written.
+ * \return The number of failed pictures since the pipeline started.
+ */
+int SnapPipeline::failedFrames() const { return failed; }
+
+/*!
+ * \brief Gets how many pictures were saved.
+ * \return The number of pictures the last stage kept since the pipeline
+ * started.
+ */
+int SnapPipeline::savedFrames() const { return written; }
+
+/*!
+ * \brief Gets every count at once.
+ * \return What became of the pictures since the pipeline started.
+ */
+SnapCounts SnapPipeline::counts() const
+{
+  SnapCounts counts;
+  counts.dropped = dropped;
+  counts.skipped = skipped;
+  counts.failed = failed;
+  counts.saved = written;
+  return counts;
+}
+
+/*!
+ * \brief The loop run by each stage's thread.
+ * \details Pops a job, runs the stage on it, and passes it on if the stage
+ * kept it. Passing on blocks when the next queue is full, which slows the
+ * stages in front down instead of letting memory grow. The last stage
+ * announces the saved file instead.
+ * \param stage The work to do on each job.
+ * \param input Where jobs come from.
+ * \param output Where kept jobs go, or nullptr for the last stage.
+ * \param rejected Counts the jobs the stage drops.
+ */
+void SnapPipeline::runStage(Stage stage,
+                            tbb::concurrent_bounded_queue<SnapJob> *input,
+                            tbb::concurrent_bounded_queue<SnapJob> *output,
+                            std::atomic<int> *rejected)
+{
+  while(true)
+  {
+    SnapJob job;
+    input->pop(job);
+    if(job.stop)
+    {
+      if(output)
+        output->push(job);
+      return;
+    }
+    if(!stage(job))
+    {
+      ++*rejected;
+      continue;
+    }
+    if(output)
+      output->push(job);
+    else
+    {
+      ++written;
+      Q_EMIT saved(job.fileName, job.taken);
+    }
+  }
+}
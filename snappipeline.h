@@ -0,0 +1,145 @@
+#ifndef SNAPPIPELINE_H
+#define SNAPPIPELINE_H
+#include <QObject>
+#include <QImage>
+#include <QDateTime>
+#include <tbb/concurrent_queue.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/*!
+ * \brief A single screenshot travelling through the SnapPipeline.
+ * \details Everything a stage needs is copied in when the picture is grabbed,
+ * so the worker threads never have to read the snapper's settings while the
+ * user is changing them.
+ */
+struct SnapJob
+{
+  SnapJob();
+  ///\brief The grabbed picture.
+  QImage image;
+  ///\brief Which screen the picture is of.
+  int screen;
+  ///\brief Where the picture will be written.
+  QString fileName;
+  ///\brief When the picture was grabbed.
+  QDateTime taken;
+  ///\brief The picture after the encode stage.
+  QByteArray encoded;
+  ///\brief The quality to encode the picture with, 0 to 100.
+  int quality;
+  ///\brief If minor differences should be tolerated.
+  bool lenient;
+  /*!
+   * \brief The chance of a wrong answer tolerated when a lenient comparison
+   * only samples the picture, 0 to always compare every pixel.
+   */
+  double sampleErrorRate;
+  ///\brief If a difference image should be saved instead of the picture.
+  bool saveDifference;
+  ///\brief If the difference should only hold the changed areas.
+  bool diffRegions;
+  ///\brief If tile fingerprints should be compared instead of pictures.
+  bool tileHashing;
+  ///\brief If the picture should be appended to an archive at fileName.
+  bool archive;
+  /*!
+   * \brief If the picture should go into a ContentStore in the folder
+   * fileName.
+   */
+  bool contentStore;
+  ///\brief The picture's ContentStore key, filled in by the encode stage.
+  QByteArray contentKey;
+  ///\brief The picture's SimilarityIndex::dHash(), from the encode stage.
+  quint64 frameHash;
+  /*!
+   * \brief The tiles that changed since the last archived picture, filled in
+   * by the diff stage when archiving.
+   */
+  std::vector<int> changedTiles;
+  ///\brief If the number of differences should be printed.
+  bool verbose;
+  ///\brief Set on the job that tells each stage to finish.
+  bool stop;
+};
+
+///\brief What became of the pictures handed to a SnapPipeline.
+struct SnapCounts
+{
+  SnapCounts();
+  ///\brief Dropped because the pipeline was full.
+  int dropped;
+  ///\brief Dropped by the diff stage, because they had not changed.
+  int skipped;
+  ///\brief Dropped by the encode or write stage, because they failed.
+  int failed;
+  ///\brief Made it through every stage.
+  int saved;
+};
+
+/*!
+ * \brief Runs the diff, encode and write steps of taking a screenshot on their
+ * own threads.
+ * \details Each stage is a worker thread fed by a bounded queue, so the thread
+ * that grabs the screen only has to hand the picture over. A stage returns
+ * false to drop a job. The diff stage does so when the picture has not
+ * changed, which is counted as skipped; the later stages when they fail,
+ * which is counted as failed. If the
+ * first queue is full the picture is dropped rather than making the grabbing
+ * thread wait.
+ */
+class SnapPipeline : public QObject
+{
+  Q_OBJECT
+public:
+  ///\brief A step of the pipeline, returns false to drop the job.
+  typedef std::function<bool(SnapJob &)> Stage;
+  SnapPipeline(QObject *parent, Stage diff, Stage encode, Stage write,
+               int capacity = 2);
+  virtual ~SnapPipeline();
+  bool submit(const SnapJob &job);
+  void finish();
+  int droppedFrames() const;
+  int skippedFrames() const;
+  int failedFrames() const;
+  int savedFrames() const;
+  SnapCounts counts() const;
+Q_SIGNALS:
+  /*!
+   * \brief Emitted from the write thread once a picture is on disk.
+   * \param fileName Where it was written.
+   * \param taken When it was grabbed, shared by every screen of a grab.
+   */
+  void saved(QString fileName, QDateTime taken);
+
+private:
+  void runStage(Stage stage, tbb::concurrent_bounded_queue<SnapJob> *input,
+                tbb::concurrent_bounded_queue<SnapJob> *output,
+                std::atomic<int> *rejected);
+  ///\brief Pictures waiting to be compared with the last one.
+  tbb::concurrent_bounded_queue<SnapJob> toDiff;
+  ///\brief Changed pictures waiting to be encoded.
+  tbb::concurrent_bounded_queue<SnapJob> toEncode;
+  ///\brief Encoded pictures waiting to be written.
+  tbb::concurrent_bounded_queue<SnapJob> toWrite;
+  ///\brief How many pictures were dropped because the pipeline was full.
+  std::atomic<int> dropped;
+  ///\brief How many pictures the diff stage decided not to keep.
+  std::atomic<int> skipped;
+  ///\brief How many pictures the encode or write stage failed on.
+  std::atomic<int> failed;
+  ///\brief How many pictures made it through every stage.
+  std::atomic<int> written;
+  ///\brief Set once finish() has stopped the threads.
+  bool finished;
+  ///\brief The thread running the diff stage.
+  std::thread diffThread;
+  ///\brief The thread running the encode stage.
+  std::thread encodeThread;
+  ///\brief The thread running the write stage.
+  std::thread writeThread;
+};
+
+#endif // SNAPPIPELINE_H
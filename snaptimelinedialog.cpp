@@ -0,0 +1,77 @@
+#include "snaptimelinedialog.h"
+#include "snaparchive.h"
+#include <QDesktopServices>
+#include <QDir>
+#include <QPushButton>
+#include <QUrl>
+#include <QVBoxLayout>
+
+/*!
+ * \brief Builds the window.
+ * \param directory The save folder to show.
+ * \param parent The owning widget, used for Qt's memory management.
+ */
+SnapTimelineDialog::SnapTimelineDialog(const QString &directory,
+                                       QWidget *parent)
+    : QDialog(parent), model(nullptr)
+{
+  setWindowTitle("QSnapper Captures");
+  view = new QListView(this);
+  view->setIconSize(QSize(thumbnailWidth, thumbnailHeight));
+  // Every row is the same height, so the view never measures rows that are
+  // off screen, which would decode their thumbnails.
+  view->setUniformItemSizes(true);
+  view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  QPushButton *refreshButton = new QPushButton("Refresh", this);
+  QVBoxLayout *layout = new QVBoxLayout(this);
+  layout->addWidget(view);
+  layout->addWidget(refreshButton);
+  resize(480, 640);
+  connect(refreshButton, SIGNAL(clicked()), this, SLOT(refresh()));
+  connect(view, SIGNAL(doubleClicked(QModelIndex)), this,
+          SLOT(openFrame(QModelIndex)));
+  setDirectory(directory);
+}
+
+/*!
+ * \brief Shows another save folder.
+ * \param directory The folder.
+ */
+void SnapTimelineDialog::setDirectory(const QString &directory)
+{
+  if(model && directory == this->directory)
+    return;
+  this->directory = directory;
+  SnapTimelineModel *old = model;
+  model = new SnapTimelineModel(
+      directory, QSize(thumbnailWidth, thumbnailHeight), this);
+  view->setModel(model);
+  delete old;
+}
+
+/*!
+ * \brief Adds the pictures taken since the window was last refreshed.
+ */
+void SnapTimelineDialog::refresh() { model->refresh(); }
+
+/*!
+ * \brief Opens a picture in the desktop's viewer.
+ * \details Pictures in an archive are first exported to the temporary folder.
+ * \param index The picture's row.
+ */
+void SnapTimelineDialog::openFrame(const QModelIndex &index)
+{
+  QString path = directory + '/' +
+                 index.data(SnapTimelineModel::FileNameRole).toString();
+  if(path.endsWith(".qsa"))
+  {
+    const QDateTime taken =
+        index.data(SnapTimelineModel::TakenRole).toDateTime();
+    const QImage frame = SnapArchiveReader(path).frameAt(taken);
+    path = QDir::temp().filePath(
+        "qsnapper-" + QString::number(taken.toMSecsSinceEpoch()) + ".png");
+    if(frame.isNull() || !frame.save(path))
+      return;
+  }
+  QDesktopServices::openUrl(QUrl::fromLocalFile(path));
+}
@@ -0,0 +1,36 @@
+#ifndef SNAPTIMELINEDIALOG_H
+#define SNAPTIMELINEDIALOG_H
+#include <QDialog>
+#include <QListView>
+#include "snaptimelinemodel.h"
+
+/*!
+ * \brief A window for browsing the screenshots QSnapper has taken.
+ * \details Shows the save folder's timeline newest first, each picture with
+ * its thumbnail. Double clicking a picture opens it in the desktop's viewer.
+ */
+class SnapTimelineDialog : public QDialog
+{
+  Q_OBJECT
+  ///\brief The list of pictures.
+  QListView *view;
+  ///\brief The pictures in the folder being shown.
+  SnapTimelineModel *model;
+  ///\brief The folder being shown.
+  QString directory;
+private Q_SLOTS:
+  void openFrame(const QModelIndex &index);
+
+public:
+  ///\brief The largest width of a thumbnail.
+  static const int thumbnailWidth = 160;
+  ///\brief The largest height of a thumbnail.
+  static const int thumbnailHeight = 120;
+  explicit SnapTimelineDialog(const QString &directory,
+                              QWidget *parent = nullptr);
+  void setDirectory(const QString &directory);
+public Q_SLOTS:
+  void refresh();
+};
+
+#endif // SNAPTIMELINEDIALOG_H
@@ -0,0 +1,112 @@
+#include "snaptimelinemodel.h"
+#include <QPixmap>
+
+/*!
+ * \brief Creates a model of a save folder.
+ * \param directory The save folder.
+ * \param thumbnailSize The largest size of a thumbnail.
+ * \param parent The owning object, used for Qt's memory management.
+ */
+SnapTimelineModel::SnapTimelineModel(const QString &directory,
+                                     const QSize &thumbnailSize,
+                                     QObject *parent)
+    : QAbstractListModel(parent), index(directory),
+      loader(directory, thumbnailSize), rows(0), entries(1024)
+{
+  connect(&loader, SIGNAL(loaded(QString)), this,
+          SLOT(thumbnailLoaded(QString)));
+  refresh();
+}
+
+/*!
+ * \brief Counts the pictures.
+ * \param parent Unused, the model is a flat list.
+ * \return How many pictures there were when last refreshed.
+ */
+int SnapTimelineModel::rowCount(const QModelIndex &parent) const
+{
+  return parent.isValid() ? 0 : rows;
+}
+
+/*!
+ * \brief Describes a picture.
+ * \details The decoration is the thumbnail, which is queued to be made the
+ * first time it is asked for, and announced with dataChanged() once it is.
+ * \param index Which picture.
+ * \param role What to describe.
+ * \return The description, or an invalid QVariant.
+ */
+QVariant SnapTimelineModel::data(const QModelIndex &index, int role) const
+{
+  if(!index.isValid() || index.row() >= rows)
+    return QVariant();
+  const TimelineEntry entry = entryAt(index.row());
+  switch(role)
+  {
+  case Qt::DisplayRole:
+    return entry.taken.toString("yyyy-MM-dd hh:mm:ss") + "  screen " +
+           QString::number(entry.screen);
+  case Qt::ToolTipRole:
+  case FileNameRole:
+    return entry.fileName;
+  case TakenRole:
+    return entry.taken;
+  case Qt::DecorationRole:
+  {
+    const QImage thumbnail = loader.thumbnail(entry.fileName, entry.taken);
+    if(!thumbnail.isNull())
+      return QPixmap::fromImage(thumbnail);
+    loadingRows.insert(ThumbnailLoader::keyFor(entry.fileName, entry.taken),
+                       index.row());
+    return QVariant();
+  }
+  }
+  return QVariant();
+}
+
+/*!
+ * \brief Picks up pictures taken since the last refresh.
+ * \details Rows count back from the newest picture, so new pictures shift
+ * every row and the model is reset.
+ */
+void SnapTimelineModel::refresh()
+{
+  beginResetModel();
+  rows = int(qMin<qint64>(index.count(), INT_MAX));
+  entries.clear();
+  loadingRows.clear();
+  endResetModel();
+}
+
+/*!
+ * \brief Gets the thumbnail loader, used to wait for it in tests.
+ * \return The loader.
+ */
+ThumbnailLoader *SnapTimelineModel::thumbnails() { return &loader; }
+
+/*!
+ * \brief Reads a row's record, from the cache if it was read recently.
+ * \param row The row, 0 being the newest picture.
+ * \return The record.
+ */
+TimelineEntry SnapTimelineModel::entryAt(int row) const
+{
+  if(TimelineEntry *cached = entries.object(row))
+    return *cached;
+  TimelineEntry *entry = new TimelineEntry(index.at(rows - 1 - row));
+  entries.insert(row, entry);
+  return *entry;
+}
+
+/*!
+ * \brief Redraws the row whose thumbnail was made.
+ * \param key The thumbnail's key.
+ */
+void SnapTimelineModel::thumbnailLoaded(QString key)
+{
+  if(!loadingRows.contains(key))
+    return;
+  const QModelIndex changed = createIndex(loadingRows.take(key), 0);
+  Q_EMIT dataChanged(changed, changed,
+                     QVector<int>() << Qt::DecorationRole);
+}
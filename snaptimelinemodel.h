@@ -0,0 +1,48 @@
+#ifndef SNAPTIMELINEMODEL_H
+#define SNAPTIMELINEMODEL_H
+#include <QAbstractListModel>
+#include <QCache>
+#include <QHash>
+#include "thumbnailloader.h"
+#include "timelineindex.h"
+
+/*!
+ * \brief Lists the screenshots in a save folder, newest first.
+ * \details Rows are read out of the folder's TimelineIndex only when a view
+ * asks for them, and a row's thumbnail is only made once it is drawn, so a
+ * view only pays for the rows on screen no matter how many pictures there
+ * are.
+ */
+class SnapTimelineModel : public QAbstractListModel
+{
+  Q_OBJECT
+  TimelineEntry entryAt(int row) const;
+  ///\brief The folder's index.
+  TimelineIndex index;
+  ///\brief Makes the thumbnails, asked for while drawing.
+  mutable ThumbnailLoader loader;
+  ///\brief How many pictures the index held when last refreshed.
+  int rows;
+  ///\brief Recently read index records, by row.
+  mutable QCache<int, TimelineEntry> entries;
+  ///\brief The row of each thumbnail still being made.
+  mutable QHash<QString, int> loadingRows;
+private Q_SLOTS:
+  void thumbnailLoaded(QString key);
+
+public:
+  ///\brief The role holding a row's TimelineEntry::fileName.
+  static const int FileNameRole = Qt::UserRole;
+  ///\brief The role holding a row's TimelineEntry::taken.
+  static const int TakenRole = Qt::UserRole + 1;
+  SnapTimelineModel(const QString &directory, const QSize &thumbnailSize,
+                    QObject *parent = nullptr);
+  virtual int rowCount(const QModelIndex &parent = QModelIndex()) const
+      override;
+  virtual QVariant data(const QModelIndex &index,
+                        int role = Qt::DisplayRole) const override;
+  void refresh();
+  ThumbnailLoader *thumbnails();
+};
+
+#endif // SNAPTIMELINEMODEL_H
@@ -1,28 +1,273 @@
+#include <algorithm>
+#include <QSettings>
+#include <QStandardPaths>
 #include <QStringList>
 #include "speaker.h"
 #ifndef Q_OS_WIN
 #include "dbusadaptor.h"
+#include <flite/flite_version.h>
+#ifndef FLITE_PROJECT_VERSION
+#error "flite_version.h does not define FLITE_PROJECT_VERSION"
 #endif
+#endif
+
+/*!
+ * \brief Creates an utterance with nothing to say.
+ */
+Utterance::Utterance()
+    : priority(Speaker::Normal), sequence(0), first(false), played(false),
+      stop(false)
+{
+}
+
+const int SpeakerLanes::laneCount;
+
+/*!
+ * \brief Creates empty lanes.
+ * \param agingStep How long a sentence waits before it moves up a lane, 0
+ * for never.
+ */
+SpeakerLanes::SpeakerLanes(std::chrono::seconds agingStep)
+    : nextSequence(0), agingStep(agingStep)
+{
+}
+
+/*!
+ * \brief Changes how long a sentence waits before it moves up a lane.
+ * \param step The wait, 0 for never.
+ */
+void SpeakerLanes::setAgingStep(std::chrono::seconds step)
+{
+  agingStep = step;
+}
+
+/*!
+ * \brief Queues a sentence at the back of its lane.
+ * \param sentence The sentence, Utterance::priority picks the lane and
+ * Utterance::queued is when it started waiting. Its sequence is set here.
+ */
+void SpeakerLanes::push(Utterance sentence)
+{
+  sentence.sequence = nextSequence++;
+  lanes[sentence.priority].push_back(sentence);
+}
+
+/*!
+ * \brief Returns a sentence taken earlier to its place in its lane.
+ * \details The place is found by sequence, so sentences put back in any
+ * order end up in the order they were first queued. Until the sentence is
+ * started(), the ones queued after it in its lane are isBehind() it.
+ * \param sentence The sentence, as take() returned it.
+ */
+void SpeakerLanes::putBack(const Utterance &sentence)
+{
+  returned[sentence.priority].insert(sentence.sequence);
+  std::deque<Utterance> &lane = lanes[sentence.priority];
+  auto place = std::upper_bound(lane.begin(), lane.end(), sentence,
+                                [](const Utterance &a, const Utterance &b)
+                                { return a.sequence < b.sequence; });
+  lane.insert(place, sentence);
+}
+
+/*!
+ * \brief Records that a sentence started playing, so the ones after it no
+ * longer wait for it, see isBehind().
+ * \param sentence The sentence.
+ */
+void SpeakerLanes::started(const Utterance &sentence)
+{
+  returned[sentence.priority].erase(sentence.sequence);
+}
+
+/*!
+ * \brief Checks if a sentence would play before one queued ahead of it in
+ * its lane.
+ * \details That happens when the one ahead was put back while this one was
+ * already taken, and is either back in the lane or on its way to play again.
+ * \param sentence The sentence, as take() returned it.
+ * \return true if a sentence put back ahead of it has not started again.
+ */
+bool SpeakerLanes::isBehind(const Utterance &sentence) const
+{
+  const std::set<quint64> &lane = returned[sentence.priority];
+  return !lane.empty() && *lane.begin() < sentence.sequence;
+}
+
+/*!
+ * \brief Checks if any sentence is waiting.
+ * \return true if every lane is empty.
+ */
+bool SpeakerLanes::isEmpty() const
+{
+  for(const std::deque<Utterance> &lane : lanes)
+    if(!lane.empty())
+      return false;
+  return true;
+}
+
+/*!
+ * \brief Takes the sentence that should go next out of its lane, see the
+ * class description.
+ * \param now The time waits are measured to.
+ * \return The sentence, or one with Utterance::stop set if every lane is
+ * empty.
+ */
+Utterance SpeakerLanes::take(std::chrono::steady_clock::time_point now)
+{
+  const int top = laneCount - 1;
+  int best = -1;
+  long long bestRank = -1;
+  for(int lane = 0; lane < laneCount; ++lane)
+  {
+    if(lanes[lane].empty())
+      continue;
+    const Utterance &front = lanes[lane].front();
+    long long rank = lane;
+    if(lane < top && agingStep.count() > 0)
+      rank = qMin<long long>(top - 1, lane + (now - front.queued) / agingStep);
+    if(best < 0 || rank > bestRank ||
+       (rank == bestRank && front.sequence < lanes[best].front().sequence))
+    {
+      best = lane;
+      bestRank = rank;
+    }
+  }
+  Utterance next;
+  if(best < 0)
+  {
+    next.stop = true;
+    return next;
+  }
+  next = lanes[best].front();
+  lanes[best].pop_front();
+  return next;
+}
+
+/*!
+ * \brief Creates an empty cache.
+ * \param budgetKiB The most KiB of audio kept.
+ */
+SentenceCache::SentenceCache(int budgetKiB)
+    : waves(budgetKiB), hits(0), misses(0)
+{
+}
+
+/*!
+ * \brief Names a sentence in the cache.
+ * \details Case and runs of spaces don't change how a sentence sounds, so
+ * they are normalized away. The voice's name is included, so another voice
+ * never plays this one's audio.
+ * \param voiceName The voice the sentence is said in.
+ * \param text The sentence.
+ * \return The key.
+ */
+QString SentenceCache::key(const QString &voiceName, const QString &text)
+{
+  return voiceName + '\n' + text.simplified().toLower();
+}
+
+/*!
+ * \brief Measures a rendered sentence for the cache's budget.
+ * \param wave The sentence.
+ * \return Its samples' size in KiB, at least 1.
+ */
+int SentenceCache::costKiB(const Wave *wave)
+{
+#ifndef Q_OS_WIN
+  const qint64 bytes = static_cast<qint64>(cst_wave_num_samples(wave)) *
+                       cst_wave_num_channels(wave) * sizeof(short);
+  return static_cast<int>(qMax<qint64>(1, bytes / 1024));
+#else
+  Q_UNUSED(wave);
+  return 1;
+#endif
+}
+
+/*!
+ * \brief Looks a sentence up, counting a hit if it is there.
+ * \param key The sentence's key().
+ * \return Its audio, or nullptr if it isn't cached.
+ */
+std::shared_ptr<Wave> SentenceCache::find(const QString &key)
+{
+  std::shared_ptr<Wave> *cached = waves.object(key);
+  if(!cached)
+    return std::shared_ptr<Wave>();
+  ++hits;
+  return *cached;
+}
+
+/*!
+ * \brief Keeps a sentence, dropping the least recently used ones if the
+ * budget is exceeded. A sentence bigger than the whole budget isn't kept.
+ * \param key The sentence's key().
+ * \param wave Its audio.
+ */
+void SentenceCache::insert(const QString &key,
+                           const std::shared_ptr<Wave> &wave)
+{
+  waves.insert(key, new std::shared_ptr<Wave>(wave), costKiB(wave.get()));
+}
+
+/*!
+ * \brief Counts a sentence found elsewhere, such as in a PhraseStore.
+ */
+void SentenceCache::countHit() { ++hits; }
+
+/*!
+ * \brief Counts a sentence that had to be rendered.
+ */
+void SentenceCache::countMiss() { ++misses; }
+
+/*!
+ * \brief Gets how many sentences didn't have to be rendered.
+ * \return The number of hits since the cache was made.
+ */
+int SentenceCache::hitCount() const { return hits; }
+
+/*!
+ * \brief Gets how many sentences had to be rendered.
+ * \return The number of misses since the cache was made.
+ */
+int SentenceCache::missCount() const { return misses; }
 
 /*!
  * \brief The constructor for Speaker. Starts flite's \link Speaker::readLoop
- * readLoop\endlink
+ * readLoop\endlink and the \link Speaker::playLoop playLoop\endlink.
+ * \details Nothing slow happens here: the voice is loaded by readLoop(), and
+ * playLoop() waits for the notification service and the audio device, so
+ * strings can be queued straight away.
  * \param parent The parent widget, used for Qt's parent/child memory
  * management.
  * \param iconLocation Where the icon used for notifications is located.
  */
 Speaker::Speaker(QObject *parent, QString iconLocation)
-    : QObject(parent), stopReading(false), canSendNotifications(true),
-      canSpeak(true), iconLocation(iconLocation), flite([&]()
-                                                        { readLoop(); })
+    : QObject(parent), urgentWaiting(0),
+      canSendNotifications(true), canSpeak(true),
+      iconLocation(iconLocation), voice(nullptr),
+      sentences(QSettings().value("Speaker_CacheKiB", 8192).toInt()),
+      firstAudioDelay(-1), startedAt(std::chrono::steady_clock::now()),
+      startupDelay(-1), stopping(false)
 {
+  QSettings settings;
+  lanes.setAgingStep(
+      std::chrono::seconds(settings.value("Speaker_AgingSeconds", 30).toInt()));
+  canPreempt = settings.value("Speaker_Preempt", true).toBool();
+  for(int lane = 0; lane < PriorityCount; ++lane)
+  {
+    laneDelays[lane] = 0;
+    laneStarts[lane] = 0;
+  }
+  // Enough to render the next sentence while one plays, without rendering
+  // minutes of clipboard ahead.
+  rendered.set_capacity(2);
 #ifndef Q_OS_WIN
-  flite_init();
-  voice = register_cmu_us_kal(NULL);
   new SpeakerAdaptor(this);
   QDBusConnection dbus = QDBusConnection::sessionBus();
   dbus.registerObject("/Speaker", this);
 #endif
+  flite = std::thread([this]() { readLoop(); });
+  player = std::thread([this]() { playLoop(); });
 }
 
 /*!
@@ -36,12 +281,19 @@ Speaker::~Speaker()
 
 /*!
  * \brief Waits for everything to be read, and stops reading.
+ * \details If playLoop() is still waiting for the notification service or
+ * the audio device, it gives up straight away rather than holding up
+ * shutdown.
  */
 void Speaker::finishSpeaking()
 {
-  stopReading = true;
-  queue.push("Stopping");
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    stopping = true;
+  }
+  wakeUp.notify_all();
   flite.join();
+  player.join();
 }
 
 /*!
@@ -75,6 +327,140 @@ bool Speaker::isNotificationsEnabled() { return canSendNotifications; }
  */
 bool Speaker::isTTSEnabled() { return canSpeak; }
 
+/*!
+ * \brief Gets how long the last speak() call took to be heard.
+ * \details Measured from the call to the moment its first sentence started
+ * playing, so it includes waiting behind earlier sentences and rendering.
+ * \return The delay in milliseconds, or -1 if nothing was spoken yet.
+ */
+int Speaker::timeToFirstAudio() { return firstAudioDelay; }
+
+/*!
+ * \brief Gets how many sentences were played from the cache rather than
+ * rendered.
+ * \return The number of cache hits since the speaker started.
+ */
+int Speaker::cacheHits() { return sentences.hitCount(); }
+
+/*!
+ * \brief Gets how many sentences had to be rendered.
+ * \return The number of cache misses since the speaker started.
+ */
+int Speaker::cacheMisses() { return sentences.missCount(); }
+
+/*!
+ * \brief Gets how long the speaker took to start talking.
+ * \details Measured from construction to the moment the first sentence
+ * started playing, so it includes loading the voice and waiting for the
+ * notification service and the audio device.
+ * \return The delay in milliseconds, or -1 if nothing was spoken yet.
+ */
+int Speaker::startupLatency() { return startupDelay; }
+
+/*!
+ * \brief Gets how long strings of a priority wait to be heard.
+ * \details Measured like timeToFirstAudio(), from the speak() call to the
+ * moment its first sentence started playing.
+ * \param priority The lane, a Priority.
+ * \return The mean delay in milliseconds, or -1 if nothing was spoken from
+ * that lane yet.
+ */
+int Speaker::laneLatency(int priority)
+{
+  if(priority < 0 || priority >= PriorityCount)
+    return -1;
+  const int starts = laneStarts[priority];
+  if(starts == 0)
+    return -1;
+  return static_cast<int>(laneDelays[priority] / starts);
+}
+
+/*!
+ * \brief Sleeps, unless finishSpeaking() is called first.
+ * \param delay How long to sleep.
+ * \return false if the speaker is stopping.
+ */
+bool Speaker::waitUnlessStopping(std::chrono::milliseconds delay)
+{
+  std::unique_lock<std::mutex> lock(wakeMutex);
+  return !wakeUp.wait_for(lock, delay, [this]() { return stopping; });
+}
+
+/*!
+ * \brief Checks if notifications can be sent.
+ * \return true once org.freedesktop.Notifications is on the session bus, or
+ * if notifications are disabled, or on Windows, where the tray shows them.
+ */
+bool Speaker::isNotifierReady() const
+{
+#ifndef Q_OS_WIN
+  if(!canSendNotifications)
+    return true;
+  QDBusConnectionInterface *bus = QDBusConnection::sessionBus().interface();
+  return bus && bus->isServiceRegistered("org.freedesktop.Notifications");
+#else
+  return true;
+#endif
+}
+
+/*!
+ * \brief Checks if sound can be played, by briefly opening the audio device.
+ * \return true if it opened, or if speech is disabled, or on Windows, where
+ * SAPI waits for the device itself.
+ */
+bool Speaker::isAudioReady() const
+{
+#ifndef Q_OS_WIN
+  if(!canSpeak)
+    return true;
+  cst_audiodev *device = audio_open(16000, 1, CST_AUDIO_LINEAR16);
+  if(!device)
+    return false;
+  audio_close(device);
+#endif
+  return true;
+}
+
+/*!
+ * \brief Waits for the notification service and the audio device, which may
+ * still be starting along with the desktop session.
+ * \details Checks Speaker_StartupAttempts times (8 by default), waiting
+ * between checks with a doubling delay, from a quarter second up to eight
+ * seconds, which is about 24 seconds in all. The last check comes after the
+ * last wait. After that, strings are spoken anyway, and whatever isn't ready
+ * yet just fails. Returns early if finishSpeaking() is called.
+ */
+void Speaker::waitUntilReady()
+{
+  const int attempts =
+      QSettings().value("Speaker_StartupAttempts", 8).toInt();
+  std::chrono::milliseconds delay(250);
+  for(int attempt = 1; attempt <= attempts; ++attempt)
+  {
+    if(isNotifierReady() && isAudioReady())
+      return;
+    if(attempt == attempts || !waitUnlessStopping(delay))
+      return;
+    delay = std::min(delay * 2, std::chrono::milliseconds(8000));
+  }
+}
+
+/*!
+ * \brief Names a sentence in the cache, in the current voice, see
+ * SentenceCache::key().
+ * \param text The sentence.
+ * \return The key.
+ */
+QString Speaker::cacheKey(const QString &text) const
+{
+  QString voiceName;
+#ifndef Q_OS_WIN
+  if(voice && voice->name)
+    voiceName = QString::fromUtf8(voice->name);
+#endif
+  return SentenceCache::key(voiceName, text);
+}
+
 /*!
  * \brief Enqueues a const char * to be spoken on the next run of
  * Speaker::readLoop.
@@ -83,39 +469,277 @@ bool Speaker::isTTSEnabled() { return canSpeak; }
  * notifications are split into individual sentences.
  * \param speakMe The string to be read aloud, and/or notified.
  */
-void Speaker::speak(QString speakMe)
+void Speaker::speak(QString speakMe) { speakWithPriority(speakMe, Normal); }
+
+/*!
+ * \brief Enqueues a string in the lane for its priority, see speak().
+ * \param speakMe The string to be read aloud, and/or notified.
+ * \param priority A Priority. Out of range values are clamped.
+ */
+void Speaker::speakWithPriority(QString speakMe, int priority)
 {
   QStringList split = speakMe.split(".");
-  for(QString addMe : split)
-    queue.push(addMe);
+  Utterance addMe;
+  addMe.queued = std::chrono::steady_clock::now();
+  addMe.priority = qBound(0, priority, PriorityCount - 1);
+  addMe.first = true;
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    for(const QString &sentence : split)
+    {
+      addMe.text = sentence;
+      lanes.push(addMe);
+      addMe.first = false;
+    }
+    if(addMe.priority == Urgent)
+      urgentWaiting += split.size();
+  }
+  wakeUp.notify_all();
 }
 
 /*!
- * \brief The main loop used for speaking and sending notifications.
- * \details The main loop that the speaker runs. While stopReading is false the
- * loop waits for a string to be added to the queue, it pops it out, and then
- * sends it to flite (if canSpeak is enabled) as well as to libnotify (if
- * canSendNotifications are enabled).
+ * \brief Takes the next sentence to render out of the lanes, waiting until
+ * there is one, see SpeakerLanes::take().
+ * \return The sentence, or one with Utterance::stop set once finishSpeaking()
+ * was called and the lanes are empty.
+ */
+Utterance Speaker::nextUtterance()
+{
+  std::unique_lock<std::mutex> lock(wakeMutex);
+  wakeUp.wait(lock, [this]() { return stopping || !lanes.isEmpty(); });
+  return lanes.take(std::chrono::steady_clock::now());
+}
+
+/*!
+ * \brief Puts a sentence back in its lane if an Urgent one is waiting, or if
+ * one queued before it in its lane stepped aside and hasn't played yet.
+ * \details Called by playLoop() before and while playing a sentence. The
+ * sentence goes back in its place in the lane, see SpeakerLanes::putBack(),
+ * keeping its rendered audio, and is said from the start once the Urgent
+ * ones are done. Checking for the older ones keeps a lane in order when the
+ * next sentence was already rendered as the others stepped aside. Nothing
+ * steps aside once finishSpeaking() was called, since readLoop() may be gone.
+ * \param readMe The sentence about to play, or playing.
+ * \return true if the sentence was put back, and should not be played.
+ */
+bool Speaker::stepAside(Utterance &readMe)
+{
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    if(!canPreempt || stopping ||
+       ((readMe.priority == Urgent || urgentWaiting == 0) &&
+        !lanes.isBehind(readMe)))
+      return false;
+    lanes.putBack(readMe);
+  }
+  wakeUp.notify_all();
+  return true;
+}
+
+/*!
+ * \brief Records that a sentence started playing.
+ * \details Sets startupLatency() on the first sentence ever, and
+ * timeToFirstAudio() and laneLatency() on the first of each speak() call. A
+ * sentence that is interrupted and said again is only counted once. See
+ * SpeakerLanes::started() for the sentences waiting on it.
+ * \param readMe The sentence, which is marked as played.
+ */
+void Speaker::startPlaying(Utterance &readMe)
+{
+  const auto now = std::chrono::steady_clock::now();
+  if(startupDelay < 0)
+    startupDelay = static_cast<int>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(now - startedAt)
+            .count());
+  {
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    lanes.started(readMe);
+    if(readMe.priority == Urgent)
+      --urgentWaiting;
+  }
+  const bool again = readMe.played;
+  readMe.played = true;
+  if(!readMe.first || again)
+    return;
+  const int waited = static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(now -
+                                                            readMe.queued)
+          .count());
+  firstAudioDelay = waited;
+  laneDelays[readMe.priority] += waited;
+  ++laneStarts[readMe.priority];
+}
+
+#ifndef Q_OS_WIN
+/*!
+ * \brief Plays a rendered sentence, stopping early for an Urgent one.
+ * \details Writes to the audio device a tenth of a second at a time, rather
+ * than through play_wave(), so stepAside() can be asked between writes.
+ * \param readMe The sentence.
+ * \return false if the sentence was interrupted and put back in its lane.
+ */
+bool Speaker::play(Utterance &readMe)
+{
+  const cst_wave *wave = readMe.wave.get();
+  cst_audiodev *device =
+      audio_open(wave->sample_rate, wave->num_channels, CST_AUDIO_LINEAR16);
+  if(!device)
+    return true;
+  const int total = wave->num_samples * wave->num_channels;
+  const int chunk = qMax(1, wave->sample_rate / 10) * wave->num_channels;
+  for(int at = 0; at < total; at += chunk)
+  {
+    if(stepAside(readMe))
+    {
+      audio_drain(device);
+      audio_close(device);
+      return false;
+    }
+    audio_write(device, wave->samples + at,
+                qMin(chunk, total - at) * sizeof(short));
+  }
+  audio_flush(device);
+  audio_close(device);
+  return true;
+}
+#endif
+
+#ifndef Q_OS_WIN
+/*!
+ * \brief Gets the version of flite, stored with saved phrases.
+ * \details Read from flite_version.h at build time, so saved phrases are
+ * rendered again after building against another flite.
+ * \return The version, such as "2.1".
+ */
+QString Speaker::engineVersion() { return FLITE_PROJECT_VERSION; }
+
+/*!
+ * \brief Gets a sentence's audio, rendering it only if it wasn't heard
+ * before.
+ * \details The memory cache is checked first, then the phrases saved on disk,
+ * which play straight out of their mapping. Only then is flite run. A
+ * sentence found in the memory cache was heard at least twice, so it is saved
+ * to disk as well, which keeps one-off clipboard sentences out of the store.
+ * \param text The sentence.
+ * \param phrases The saved phrases.
+ * \return The audio, or nullptr if flite failed.
+ */
+std::shared_ptr<Wave> Speaker::render(const QString &text,
+                                      PhraseStore &phrases)
+{
+  const QString key = cacheKey(text);
+  if(std::shared_ptr<Wave> cached = sentences.find(key))
+  {
+    if(!phrases.contains(key))
+      phrases.add(key, cached->samples, cached->num_samples,
+                  cached->sample_rate, cached->num_channels);
+    return cached;
+  }
+  std::shared_ptr<Wave> wave;
+  PhraseAudio saved;
+  if(phrases.find(key, saved))
+  {
+    sentences.countHit();
+    cst_wave *mapped = new_wave();
+    mapped->sample_rate = saved.sampleRate;
+    mapped->num_samples = saved.sampleCount;
+    mapped->num_channels = saved.channels;
+    mapped->samples = const_cast<short *>(saved.samples);
+    // The samples belong to the mapping, which stays open while they play.
+    std::shared_ptr<uchar> mapping = saved.mapping;
+    wave.reset(mapped, [mapping](cst_wave *played)
+               {
+      played->samples = nullptr;
+      delete_wave(played);
+    });
+  }
+  else
+  {
+    sentences.countMiss();
+    cst_wave *made = flite_text_to_wave(text.toUtf8(), voice);
+    if(!made)
+      return wave;
+    wave.reset(made, delete_wave);
+  }
+  sentences.insert(key, wave);
+  return wave;
+}
+#endif
+
+/*!
+ * \brief The loop that renders sentences, the first stage of speaking.
+ * \details Loads the voice first, so strings queued meanwhile are rendered
+ * once it's ready. Then waits for a string to be added to the lanes, takes
+ * it out, see nextUtterance(), and renders it if canSpeak is enabled and the
+ * voice loaded, see render(), then hands it to \link Speaker::playLoop
+ * playLoop\endlink, which shows it either way.
+ * Handing over blocks while the player is a couple of sentences behind. SAPI
+ * renders and plays in one call, so on Windows strings are handed over as
+ * they are.
  */
 void Speaker::readLoop()
 {
+#ifndef Q_OS_WIN
+  // Loaded here rather than in the constructor, so the voice's data is read
+  // off the UI thread.
+  flite_init();
+  voice = register_cmu_us_kal(NULL);
+#endif
+#if !defined(TEST) && !defined(Q_OS_WIN)
+  // Without a voice nothing is rendered, and the saved phrases are left
+  // alone rather than started again for a voice with no name.
+  std::unique_ptr<PhraseStore> phrases;
+  if(voice)
+  {
+    QSettings settings;
+    phrases.reset(new PhraseStore(
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+            "/phrases.qps",
+        voice->name ? QString::fromUtf8(voice->name) : QString(),
+        engineVersion(),
+        settings.value("Speaker_StoreKiB", 32768).toLongLong() * 1024));
+  }
+#endif
+  Utterance renderMe;
+  do
+  {
+    // Takes from the lanes, or waits until it can.
+    renderMe = nextUtterance();
+#if !defined(TEST) && !defined(Q_OS_WIN)
+    // Sentences that stepped aside come back already rendered.
+    if(phrases && !renderMe.stop && !renderMe.wave && canSpeak &&
+       !renderMe.text.trimmed().isEmpty())
+      renderMe.wave = render(renderMe.text, *phrases);
+#endif
+    rendered.push(renderMe);
+  } while(!renderMe.stop);
+}
+
+/*!
+ * \brief The main loop used for speaking and sending notifications.
+ * \details The main loop that the speaker runs. Until told to stop, the loop
+ * waits for a rendered string, it pops it out, and then plays it (if
+ * canSpeak is enabled) as well as sending it to libnotify (if
+ * canSendNotifications are enabled). A sentence steps aside instead when an
+ * Urgent one is waiting, see stepAside(). The first sentence of each speak()
+ * call records how long it waited, see startPlaying(). Before the first one,
+ * the loop waits for the desktop to be ready, see waitUntilReady().
+ */
+void Speaker::playLoop()
+{
 #ifndef TEST
 #ifdef Q_OS_WIN // COM init
   GUID clsid_spvoice = {0x96749377, 0x3391, 0x11D2, 0x9E, 0xE3, 0x00,
                         0xC0,       0x4F,   0x79,   0x73, 0x96};
   GUID iid_ispvoice = {0x6C44DF74, 0x72B9, 0x4992, 0xA1, 0xEC, 0xEF,
                        0x99,       0x6E,   0x04,   0x22, 0xD4};
-  if(FAILED(::CoInitialize(NULL)))
-  {
-    finishSpeaking();
-  }
-  HRESULT hr = CoCreateInstance(clsid_spvoice, NULL, CLSCTX_ALL, iid_ispvoice,
-                                (void **)&voice);
-  if(FAILED(hr))
-  {
-    finishSpeaking();
-  }
+  const bool comReady = SUCCEEDED(::CoInitialize(NULL));
+  // Without a voice, strings are still shown, just not spoken.
+  if(!comReady || FAILED(CoCreateInstance(clsid_spvoice, NULL, CLSCTX_ALL,
+                                          iid_ispvoice, (void **)&voice)))
+    voice = nullptr;
 #else // D-Bus init
+  waitUntilReady();
   QDBusInterface notifier("org.freedesktop.Notifications",
                           "/org/freedesktop/Notifications",
                           "org.freedesktop.Notifications");
@@ -129,51 +753,59 @@ void Speaker::readLoop()
   notifierArgs << QStringList(); // actions
   notifierArgs << hints;         // hints
   notifierArgs << (int)0;        // timeout in ms
-
 #endif
-  std::this_thread::sleep_for(std::chrono::minutes(1));
-#endif // Test's no-sleep
-  QString readMe;
-  while(!stopReading)
+#endif // Test's no-wait
+  Utterance readMe;
+  while(true)
   {
-    // Pops from queue, or waits until it can.
-    queue.pop(readMe);
+    // Pops from the rendered queue, or waits until it can.
+    rendered.pop(readMe);
+    if(readMe.stop)
+      break;
+    if(stepAside(readMe))
+      continue;
+#ifndef TEST
+    // A sentence said again after stepping aside was already shown.
+    const bool shown = readMe.played;
+#endif
+    startPlaying(readMe);
 #ifndef TEST
 #ifndef Q_OS_WIN
-    if(canSendNotifications && !readMe.isEmpty())
+    if(canSendNotifications && !shown && !readMe.text.isEmpty())
     {
-      notifierArgs[4] = readMe;
-      notifierArgs[7].setValue(readMe.size() * 1000);
+      notifierArgs[4] = readMe.text;
+      notifierArgs[7].setValue(readMe.text.size() * 1000);
       notifier.callWithArgumentList(QDBus::AutoDetect, "Notify", notifierArgs);
     }
     if(canSpeak)
     {
-      flite_text_to_speech(readMe.toUtf8(), voice, "play");
+      if(readMe.wave)
+        play(readMe);
     }
     else
     {
-      std::this_thread::sleep_for(
-          std::chrono::seconds(readMe.split(' ').size()));
+      waitUnlessStopping(std::chrono::seconds(readMe.text.split(' ').size()));
     }
 #else
-    if(canSendNotifications && !readMe.isEmpty())
+    if(canSendNotifications && !shown && !readMe.text.isEmpty())
     {
-      Q_EMIT showMessage(readMe);
+      Q_EMIT showMessage(readMe.text);
     }
-    if(canSpeak)
+    if(canSpeak && voice)
     {
-      voice->Speak(readMe.toStdWString().c_str(), SPF_DEFAULT, 0);
+      voice->Speak(readMe.text.toStdWString().c_str(), SPF_DEFAULT, 0);
     }
     else
     {
-      std::this_thread::sleep_for(
-          std::chrono::seconds(readMe.split(' ').size()));
+      waitUnlessStopping(std::chrono::seconds(readMe.text.split(' ').size()));
     }
 #endif // Read Message
 #endif // Test's skip message
   }
-#ifdef Q_OS_WIN
-  voice->Release();
-  ::CoUninitialize();
+#if defined(Q_OS_WIN) && !defined(TEST)
+  if(voice)
+    voice->Release();
+  if(comReady)
+    ::CoUninitialize();
 #endif // COM uninitialize
 }
@@ -1,32 +1,170 @@
 #ifndef SPEAKER_H
 #define SPEAKER_H
 #include <tbb/concurrent_queue.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <QCache>
 #include <QString>
 #include <QObject>
+#include "phrasestore.h"
 #ifndef Q_OS_WIN
 #include <flite/flite.h>
 extern "C" cst_voice *register_cmu_us_kal(const char *voxdir);
 typedef cst_voice Voice;
+typedef cst_wave Wave;
 #else
 #include <sapi.h>
 typedef ISpVoice Voice;
+typedef void Wave;
 #endif
-///\brief Offers a queue and an interface to text to speech and notifications.
+
+///\brief A sentence on its way from speak() to the speakers.
+struct Utterance
+{
+  Utterance();
+  ///\brief What to say and show.
+  QString text;
+  ///\brief The rendered audio, or nullptr if nothing should be played.
+  std::shared_ptr<Wave> wave;
+  ///\brief When speak() queued the sentence.
+  std::chrono::steady_clock::time_point queued;
+  ///\brief The lane the sentence waits in, a Speaker::Priority.
+  int priority;
+  ///\brief Increases with each sentence queued, to keep each lane in order.
+  quint64 sequence;
+  ///\brief If this is the first sentence of a speak() call.
+  bool first;
+  ///\brief If the sentence started playing before, and was interrupted.
+  bool played;
+  ///\brief Set on the utterance that tells playLoop() to finish.
+  bool stop;
+};
+
+/*!
+ * \brief The sentences waiting to be rendered, one first in, first out lane
+ * per Speaker::Priority, and the order they are taken in.
+ * \details Only the front of each lane is considered. A sentence counts as
+ * one lane higher for every agingStep it has waited, but never reaches the
+ * top lane, so Urgent sentences always go first. Ties go to the sentence
+ * queued first. The time is passed in, so the order can be checked without
+ * waiting. A sentence that was put back keeps the sentences queued after it
+ * in its lane waiting, see isBehind(), until it is started() again. Not
+ * thread safe, Speaker guards it with its wakeMutex.
+ */
+class SpeakerLanes
+{
+public:
+  ///\brief How many lanes there are, the last being the top one.
+  static const int laneCount = 3;
+
+private:
+  ///\brief The sentences in each lane, in the order they were queued.
+  std::deque<Utterance> lanes[laneCount];
+  ///\brief The sequence of the next sentence queued.
+  quint64 nextSequence;
+  ///\brief How long a sentence waits before it moves up a lane, 0 never.
+  std::chrono::seconds agingStep;
+  ///\brief The sequences of the sentences put back and not yet started
+  /// again, per lane.
+  std::set<quint64> returned[laneCount];
+
+public:
+  explicit SpeakerLanes(
+      std::chrono::seconds agingStep = std::chrono::seconds(30));
+  void setAgingStep(std::chrono::seconds step);
+  void push(Utterance sentence);
+  void putBack(const Utterance &sentence);
+  void started(const Utterance &sentence);
+  bool isBehind(const Utterance &sentence) const;
+  bool isEmpty() const;
+  Utterance take(std::chrono::steady_clock::time_point now);
+};
+
+/*!
+ * \brief Recently rendered sentences, kept in memory with a budget in KiB.
+ * \details Sentences are found by key(), so the same sentence typed
+ * differently is only rendered once. Used by the rendering thread, but the
+ * counts can be read from any.
+ */
+class SentenceCache
+{
+  ///\brief The sentences by key(), the cost of each is costKiB().
+  QCache<QString, std::shared_ptr<Wave>> waves;
+  ///\brief How many sentences didn't have to be rendered.
+  std::atomic<int> hits;
+  ///\brief How many sentences had to be rendered.
+  std::atomic<int> misses;
+
+public:
+  explicit SentenceCache(int budgetKiB);
+  static QString key(const QString &voiceName, const QString &text);
+  static int costKiB(const Wave *wave);
+  std::shared_ptr<Wave> find(const QString &key);
+  void insert(const QString &key, const std::shared_ptr<Wave> &wave);
+  void countHit();
+  void countMiss();
+  int hitCount() const;
+  int missCount() const;
+};
+
+/*!
+ * \brief Offers a queue and an interface to text to speech and notifications.
+ * \details Speech runs as a two stage pipeline. One thread renders each
+ * sentence to a waveform, and another plays them, so the next sentence is
+ * rendered while the current one plays, and there is no pause between them
+ * for synthesis. Only a couple of rendered sentences are held at once.
+ * Rendered sentences are also kept in an LRU cache with a budget in bytes,
+ * since the same few phrases ("Snap", the hour) are said over and over, and
+ * the ones said more than once are saved in a PhraseStore for the next run.
+ *
+ * Strings wait in one lane per Priority, so an alarm isn't stuck behind
+ * minutes of clipboard. The highest lane doesn't always win: a sentence moves
+ * up a lane for every Speaker_AgingSeconds it waits, though only Urgent
+ * sentences are ever in the Urgent lane. When one is queued, a sentence of a
+ * lower lane that was rendered or is playing steps aside, and is said again
+ * from the start afterwards, unless Speaker_Preempt is off.
+ */
 class Speaker : public QObject
 {
   Q_OBJECT
   Q_CLASSINFO("D-Bus Interface", "com.coderfrog.qcompanion.speaker")
+
+public:
+  ///\brief How soon a string should be spoken, and the lane it waits in.
+  enum Priority
+  {
+    Low,          ///< Long reads, such as the clipboard.
+    Normal,       ///< Everything else, the default.
+    Urgent,       ///< Alarms, which go first and can interrupt the others.
+    PriorityCount ///< The number of lanes.
+  };
+  static_assert(PriorityCount == SpeakerLanes::laneCount,
+                "Every priority needs a lane");
+
+private:
   /*!
-   * \brief The concurrent queue that is used to store strings to be
-   * read/notified.
-   */
-  tbb::concurrent_bounded_queue<QString> queue;
-  /*!
-   * \brief Set to true in the destructor, used to specify that the loop should
-   * not continue.
+   * \brief The strings to be read/notified, waiting to be rendered. Guarded
+   * by wakeMutex.
    */
-  bool stopReading;
+  SpeakerLanes lanes;
+  ///\brief Urgent sentences queued but not yet playing. Guarded by wakeMutex.
+  int urgentWaiting;
+  ///\brief If Urgent sentences can interrupt the others.
+  bool canPreempt;
+  Utterance nextUtterance();
+  bool stepAside(Utterance &readMe);
+  void startPlaying(Utterance &readMe);
+#ifndef Q_OS_WIN
+  bool play(Utterance &readMe);
+#endif
+  ///\brief Rendered sentences waiting to be played.
+  tbb::concurrent_bounded_queue<Utterance> rendered;
   /*! \brief checked to indicate whether strings should be sent as a
    * notification
    */
@@ -34,15 +172,61 @@ class Speaker : public QObject
   ///\brief checked to indicate whether strings should be spoken aloud.
   bool canSpeak;
   void readLoop();
+  void playLoop();
+  bool waitUnlessStopping(std::chrono::milliseconds delay);
+  void waitUntilReady();
+  bool isNotifierReady() const;
+  bool isAudioReady() const;
   ///\brief Where the icon used for notifications is located.
   QString iconLocation;
   /*!
    * \brief The thread that will run \link Speaker::readLoop readLoop \endlink
-   * and check the queue, speaking and notifying when strings come in.
+   * and render the strings that come in.
    */
   std::thread flite;
+  /*!
+   * \brief The thread that will run \link Speaker::playLoop playLoop \endlink,
+   * speaking and notifying each rendered string.
+   */
+  std::thread player;
   ///\brief A handle to the voice used for text to speech.
   Voice *voice;
+  QString cacheKey(const QString &text) const;
+#ifndef Q_OS_WIN
+  std::shared_ptr<Wave> render(const QString &text, PhraseStore &phrases);
+  static QString engineVersion();
+#endif
+  ///\brief Recently rendered sentences, only used by readLoop().
+  SentenceCache sentences;
+  /*!
+   * \brief How long the last speak() call waited for its first sentence to
+   * start, in milliseconds, or -1.
+   */
+  std::atomic<int> firstAudioDelay;
+  ///\brief When the speaker was constructed.
+  std::chrono::steady_clock::time_point startedAt;
+  /*!
+   * \brief How long after construction the first sentence started, in
+   * milliseconds, or -1.
+   */
+  std::atomic<int> startupDelay;
+  /*!
+   * \brief Summed enqueue to start delays of the first sentences played from
+   * each lane, in milliseconds.
+   */
+  std::atomic<qint64> laneDelays[PriorityCount];
+  ///\brief How many first sentences were played from each lane.
+  std::atomic<int> laneStarts[PriorityCount];
+  ///\brief Guards the lanes and stopping, and wakes the loops.
+  std::mutex wakeMutex;
+  ///\brief Signalled by speakWithPriority(), stepAside() and
+  /// finishSpeaking().
+  std::condition_variable wakeUp;
+  /*!
+   * \brief Set by finishSpeaking(), so startup stops waiting, and readLoop()
+   * stops once the lanes are empty.
+   */
+  bool stopping;
 
 public:
   Speaker(QObject *parent, QString iconLocation);
@@ -55,9 +239,15 @@ public:
   Q_SIGNAL void showMessage(QString message);
 public Q_SLOTS:
   Q_SCRIPTABLE void speak(QString speakMe);
+  Q_SCRIPTABLE void speakWithPriority(QString speakMe, int priority);
   Q_SCRIPTABLE void setNotificationsEnabled(bool enable);
   Q_SCRIPTABLE void setTTSEnabled(bool enable);
   Q_SCRIPTABLE bool isNotificationsEnabled();
   Q_SCRIPTABLE bool isTTSEnabled();
+  Q_SCRIPTABLE int timeToFirstAudio();
+  Q_SCRIPTABLE int cacheHits();
+  Q_SCRIPTABLE int cacheMisses();
+  Q_SCRIPTABLE int startupLatency();
+  Q_SCRIPTABLE int laneLatency(int priority);
 };
 #endif // SPEAKER_H
@@ -0,0 +1,197 @@
+#include "stripjpegencoder.h"
+#include <tbb/parallel_for.h>
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <jpeglib.h>
+
+namespace
+{
+///\brief Turns libjpeg's fatal errors into a jump back to encodeStrip.
+struct JumpingErrorManager
+{
+  jpeg_error_mgr manager;
+  std::jmp_buf jump;
+};
+
+/*!
+ * \brief Replaces libjpeg's default of exiting the program.
+ */
+void jumpOnError(j_common_ptr info)
+{
+  std::longjmp(reinterpret_cast<JumpingErrorManager *>(info->err)->jump, 1);
+}
+
+/*!
+ * \brief Replaces libjpeg's default of printing warnings to stderr.
+ */
+void ignoreMessage(j_common_ptr) {}
+
+/*!
+ * \brief Compresses rows top to top + height - 1 of a frame as a JPEG of
+ * their own, with a restart marker after every MCU row.
+ * \param frame The whole frame.
+ * \param top The first row of the strip.
+ * \param height How many rows are in the strip.
+ * \param quality The JPEG quality, 0 to 100.
+ * \param jpeg Set to the compressed strip.
+ * \return False if libjpeg failed.
+ */
+bool encodeStrip(const FrameView &frame, int top, int height, int quality,
+                 std::vector<unsigned char> &jpeg)
+{
+#ifndef JCS_EXTENSIONS
+  std::vector<JSAMPLE> row(static_cast<size_t>(frame.width) * 3);
+#endif
+  jpeg_compress_struct info;
+  JumpingErrorManager error;
+  unsigned char *buffer = nullptr;
+  unsigned long size = 0;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = jumpOnError;
+  error.manager.output_message = ignoreMessage;
+  if(setjmp(error.jump))
+  {
+    jpeg_destroy_compress(&info);
+    std::free(buffer);
+    return false;
+  }
+  jpeg_create_compress(&info);
+  jpeg_mem_dest(&info, &buffer, &size);
+  info.image_width = frame.width;
+  info.image_height = height;
+#ifdef JCS_EXTENSIONS
+  // Pixels are 0xAARRGGBB words, so the byte order follows the CPU's.
+  info.input_components = 4;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  info.in_color_space = JCS_EXT_XRGB;
+#else
+  info.in_color_space = JCS_EXT_BGRX;
+#endif
+#else
+  info.input_components = 3;
+  info.in_color_space = JCS_RGB;
+#endif
+  jpeg_set_defaults(&info);
+  jpeg_set_quality(&info, quality, TRUE);
+  info.restart_in_rows = 1;
+  jpeg_start_compress(&info, TRUE);
+  while(info.next_scanline < info.image_height)
+  {
+    const std::uint32_t *pixels = frame.row(top + int(info.next_scanline));
+#ifdef JCS_EXTENSIONS
+    JSAMPROW rowPointer =
+        const_cast<JSAMPROW>(reinterpret_cast<const JSAMPLE *>(pixels));
+#else
+    for(int x = 0; x < frame.width; ++x)
+    {
+      row[3 * x] = JSAMPLE(pixels[x] >> 16);
+      row[3 * x + 1] = JSAMPLE(pixels[x] >> 8);
+      row[3 * x + 2] = JSAMPLE(pixels[x]);
+    }
+    JSAMPROW rowPointer = row.data();
+#endif
+    jpeg_write_scanlines(&info, &rowPointer, 1);
+  }
+  jpeg_finish_compress(&info);
+  jpeg_destroy_compress(&info);
+  jpeg.assign(buffer, buffer + size);
+  std::free(buffer);
+  return true;
+}
+
+/*!
+ * \brief Finds the end of the headers of a JPEG made by encodeStrip.
+ * \param jpeg The JPEG.
+ * \param frameHeader Set to where the SOF0 segment's height is.
+ * \return Where the coded data starts, or 0 if the headers are broken.
+ */
+size_t findScanData(const std::vector<unsigned char> &jpeg,
+                    size_t &frameHeader)
+{
+  size_t position = 2;
+  while(position + 4 <= jpeg.size() && jpeg[position] == 0xFF)
+  {
+    const unsigned char marker = jpeg[position + 1];
+    const size_t length = (jpeg[position + 2] << 8) | jpeg[position + 3];
+    if(marker == 0xC0)
+      frameHeader = position + 5;
+    position += 2 + length;
+    if(marker == 0xDA)
+      return position <= jpeg.size() ? position : 0;
+  }
+  return 0;
+}
+}
+
+const int StripJpegEncoder::defaultStripHeight;
+
+/*!
+ * \brief Encodes a frame as one JPEG.
+ * \param frame The frame.
+ * \param quality The JPEG quality, 0 to 100.
+ * \param jpeg Set to the JPEG file's contents.
+ * \param stripHeight How many rows each task compresses, rounded up to a
+ * multiple of 16 so strips always end on an MCU row.
+ * \return False if the frame is too tall for a JPEG or libjpeg failed.
+ */
+bool StripJpegEncoder::encode(const FrameView &frame, int quality,
+                              std::vector<unsigned char> &jpeg,
+                              int stripHeight)
+{
+  if(frame.width <= 0 || frame.height <= 0 || frame.height > 65535 ||
+     frame.width > 65535)
+    return false;
+  stripHeight = std::max(16, (stripHeight + 15) / 16 * 16);
+  const int strips = (frame.height + stripHeight - 1) / stripHeight;
+  std::vector<std::vector<unsigned char>> encoded(strips);
+  std::vector<char> succeeded(strips, 0);
+  tbb::parallel_for(0, strips, [&](int strip)
+                    {
+    const int top = strip * stripHeight;
+    succeeded[strip] =
+        encodeStrip(frame, top, std::min(stripHeight, frame.height - top),
+                    quality, encoded[strip]);
+  });
+  if(std::find(succeeded.begin(), succeeded.end(), 0) != succeeded.end())
+    return false;
+
+  size_t frameHeader = 0;
+  const size_t headerEnd = findScanData(encoded[0], frameHeader);
+  if(headerEnd == 0 || frameHeader == 0)
+    return false;
+  jpeg.assign(encoded[0].begin(), encoded[0].begin() + headerEnd);
+  jpeg[frameHeader] = static_cast<unsigned char>(frame.height >> 8);
+  jpeg[frameHeader + 1] = static_cast<unsigned char>(frame.height);
+  int restart = 0;
+  for(int strip = 0; strip < strips; ++strip)
+  {
+    const std::vector<unsigned char> &data = encoded[strip];
+    size_t start = headerEnd;
+    if(strip > 0)
+    {
+      size_t unused;
+      start = findScanData(data, unused);
+      if(start == 0)
+        return false;
+      jpeg.push_back(0xFF);
+      jpeg.push_back(static_cast<unsigned char>(0xD0 + restart++ % 8));
+    }
+    // Everything up to the strip's EOI, renumbering its restart markers.
+    const size_t end = data.size() - 2;
+    for(size_t i = start; i < end; ++i)
+    {
+      jpeg.push_back(data[i]);
+      if(data[i] == 0xFF && i + 1 < end && data[i + 1] >= 0xD0 &&
+         data[i + 1] <= 0xD7)
+      {
+        jpeg.push_back(static_cast<unsigned char>(0xD0 + restart++ % 8));
+        ++i;
+      }
+    }
+  }
+  jpeg.push_back(0xFF);
+  jpeg.push_back(0xD9);
+  return true;
+}
@@ -0,0 +1,28 @@
+#ifndef STRIPJPEGENCODER_H
+#define STRIPJPEGENCODER_H
+#include <vector>
+#include "diffengine.h"
+
+/*!
+ * \brief Encodes a frame as a baseline JPEG, compressing horizontal strips of
+ * it in parallel.
+ * \details Every strip is compressed by its own TBB task with libjpeg, using
+ * the same quality, the standard Huffman tables and a restart marker after
+ * every row of MCUs. Restart markers reset the entropy coder, so the strips'
+ * coded data can be laid end to end behind the first strip's headers to give
+ * one ordinary JPEG. Only the markers' numbers, which count 0 to 7 through
+ * the whole picture, and the picture height need fixing up.
+ */
+class StripJpegEncoder
+{
+  StripJpegEncoder() = delete;
+
+public:
+  ///\brief The default strip height, in rows. A multiple of 16.
+  static const int defaultStripHeight = 256;
+  static bool encode(const FrameView &frame, int quality,
+                     std::vector<unsigned char> &jpeg,
+                     int stripHeight = defaultStripHeight);
+};
+
+#endif // STRIPJPEGENCODER_H
@@ -0,0 +1,195 @@
+#include "thumbnailloader.h"
+#include "snaparchive.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+/*!
+ * \brief A worker's turn, decodes whichever request is newest when it runs.
+ */
+class ThumbnailLoader::Task : public QRunnable
+{
+  ///\brief The loader that queued the task.
+  ThumbnailLoader *loader;
+
+public:
+  explicit Task(ThumbnailLoader *loader) : loader(loader) {}
+  virtual void run() override
+  {
+    bool found;
+    const Request request = loader->takeNewest(found);
+    if(found)
+      loader->decode(request);
+  }
+};
+
+/*!
+ * \brief Creates a loader for one save folder.
+ * \details One core is left for the GUI.
+ * \param directory The save folder, the one a TimelineIndex names files in.
+ * \param thumbnailSize The largest size of a thumbnail.
+ * \param cacheKiB How much memory the thumbnails may take, in KiB.
+ * \param parent The owning object, used for Qt's memory management.
+ */
+ThumbnailLoader::ThumbnailLoader(const QString &directory,
+                                 const QSize &thumbnailSize, int cacheKiB,
+                                 QObject *parent)
+    : QObject(parent), directory(directory), thumbnailSize(thumbnailSize),
+      cache(cacheKiB)
+{
+  pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+/*!
+ * \brief Forgets waiting requests and waits for the running ones.
+ */
+ThumbnailLoader::~ThumbnailLoader()
+{
+  {
+    QMutexLocker locker(&waitingMutex);
+    waiting.clear();
+  }
+  pool.waitForDone();
+}
+
+/*!
+ * \brief Names a screenshot's thumbnail.
+ * \details Pictures in an archive share its file, so their time is added.
+ * \param fileName The screenshot's file, relative to the save folder.
+ * \param taken When the screenshot was taken.
+ * \return The key the thumbnail is cached and announced under.
+ */
+QString ThumbnailLoader::keyFor(const QString &fileName, const QDateTime &taken)
+{
+  if(!fileName.endsWith(".qsa"))
+    return fileName;
+  return fileName + '@' + QString::number(taken.toMSecsSinceEpoch());
+}
+
+/*!
+ * \brief Gets a screenshot's thumbnail, if it is ready.
+ * \details If it isn't, it is queued to be made and loaded() is emitted once
+ * it is.
+ * \param fileName The screenshot's file, relative to the save folder. A .qsa
+ * archive is read at taken.
+ * \param taken When the screenshot was taken.
+ * \return The thumbnail, or a null image if it isn't ready yet.
+ */
+QImage ThumbnailLoader::thumbnail(const QString &fileName,
+                                  const QDateTime &taken)
+{
+  const bool archived = fileName.endsWith(".qsa");
+  const QString key = keyFor(fileName, taken);
+  if(QImage *cached = cache.object(key))
+    return *cached;
+  if(pending.contains(key))
+    return QImage();
+  Request request;
+  request.key = key;
+  request.path = directory + '/' + fileName;
+  request.taken = taken;
+  request.settled = archived || fileName.startsWith("objects/");
+  request.sidecar = directory + "/.thumbs/" +
+                    (archived ? fileName.left(fileName.size() - 4) + '-' +
+                                    key.section('@', -1) + ".jpg"
+                              : fileName);
+  pending.insert(key);
+  {
+    QMutexLocker locker(&waitingMutex);
+    waiting.append(request);
+    if(waiting.size() > maxWaiting)
+    {
+      // Forgotten requests are asked for again if their rows come back.
+      const QString dropped = waiting.first().key;
+      waiting.remove(0);
+      QMetaObject::invokeMethod(this, "store", Qt::QueuedConnection,
+                                Q_ARG(QString, dropped),
+                                Q_ARG(QImage, QImage()));
+    }
+  }
+  pool.start(new Task(this));
+  return QImage();
+}
+
+/*!
+ * \brief Waits until every queued thumbnail is made.
+ * \details The thumbnails are stored once the loader's thread gets back to
+ * its event loop.
+ */
+void ThumbnailLoader::waitForDone() { pool.waitForDone(); }
+
+/*!
+ * \brief Takes the newest waiting request, called by the workers.
+ * \param found Set to false if nothing was waiting.
+ * \return The request.
+ */
+ThumbnailLoader::Request ThumbnailLoader::takeNewest(bool &found)
+{
+  QMutexLocker locker(&waitingMutex);
+  found = !waiting.isEmpty();
+  if(!found)
+    return Request();
+  const Request request = waiting.last();
+  waiting.removeLast();
+  return request;
+}
+
+/*!
+ * \brief Makes a thumbnail on a worker thread, and hands it to store().
+ * \details The sidecar is used if the screenshot is settled or older than
+ * it. An archive's time changes whenever a picture is added, not when the
+ * one wanted changes, so it can't tell. Otherwise the screenshot is decoded
+ * and a new sidecar written.
+ * \param request What to make.
+ */
+void ThumbnailLoader::decode(const Request &request)
+{
+  const QFileInfo source(request.path);
+  const QFileInfo sidecar(request.sidecar);
+  QImage thumbnail;
+  if(sidecar.exists() &&
+     (request.settled || sidecar.lastModified() >= source.lastModified()))
+    thumbnail.load(request.sidecar);
+  if(thumbnail.isNull() && source.exists())
+  {
+    if(source.suffix() == "qsa")
+    {
+      SnapArchiveReader reader(request.path);
+      thumbnail = reader.frameAt(request.taken)
+                      .scaled(thumbnailSize, Qt::KeepAspectRatio,
+                              Qt::SmoothTransformation);
+    }
+    else
+    {
+      QImageReader reader(request.path);
+      reader.setScaledSize(
+          reader.size().scaled(thumbnailSize, Qt::KeepAspectRatio));
+      thumbnail = reader.read();
+    }
+    if(!thumbnail.isNull() && QDir().mkpath(sidecar.path()))
+      thumbnail.save(request.sidecar, "JPG", 80);
+  }
+  QMetaObject::invokeMethod(this, "store", Qt::QueuedConnection,
+                            Q_ARG(QString, request.key),
+                            Q_ARG(QImage, thumbnail));
+}
+
+/*!
+ * \brief Keeps a finished thumbnail and announces it.
+ * \details A null thumbnail means the request was dropped or the screenshot
+ * couldn't be read, it is only forgotten so it can be asked for again.
+ * \param key The request's key.
+ * \param thumbnail The thumbnail.
+ */
+void ThumbnailLoader::store(QString key, QImage thumbnail)
+{
+  pending.remove(key);
+  if(thumbnail.isNull())
+    return;
+  cache.insert(key, new QImage(thumbnail),
+               qMax(1, thumbnail.byteCount() / 1024));
+  Q_EMIT loaded(key);
+}
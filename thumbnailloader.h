@@ -0,0 +1,80 @@
+#ifndef THUMBNAILLOADER_H
+#define THUMBNAILLOADER_H
+#include <QObject>
+#include <QCache>
+#include <QDateTime>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QSize>
+#include <QThreadPool>
+#include <QVector>
+
+/*!
+ * \brief Makes small pictures of screenshots on a pool of worker threads.
+ * \details Thumbnails are kept in memory in an LRU cache of a fixed size, and
+ * on disk next to the screenshots in a .thumbs folder, so each screenshot is
+ * only decoded once. Archived and content stored pictures are never written
+ * again, so their sidecars are always used; pictures on their own may be
+ * saved again smaller, so their sidecars must be newer than they are. JPEGs
+ * are decoded straight to the small size, which lets libjpeg skip most of
+ * the work.
+ * Requests are answered newest first, since those are the rows on screen
+ * right now, and the oldest are forgotten once too many are waiting.
+ * Everything but the decoding happens on the thread that owns the loader.
+ */
+class ThumbnailLoader : public QObject
+{
+  Q_OBJECT
+  ///\brief A screenshot waiting to be decoded.
+  struct Request
+  {
+    ///\brief The cache key.
+    QString key;
+    ///\brief The screenshot's file.
+    QString path;
+    ///\brief When it was taken, picks the picture out of an archive.
+    QDateTime taken;
+    ///\brief The thumbnail's file.
+    QString sidecar;
+    /*!
+     * \brief If the picture never changes once written, so any sidecar of it
+     * is current.
+     */
+    bool settled;
+  };
+  class Task;
+  Request takeNewest(bool &found);
+  void decode(const Request &request);
+  ///\brief The folder the screenshots are in.
+  QString directory;
+  ///\brief The largest size of a thumbnail.
+  QSize thumbnailSize;
+  ///\brief Recently used thumbnails, the cost of each is its size in KiB.
+  QCache<QString, QImage> cache;
+  ///\brief Keys that were asked for and have not been answered yet.
+  QSet<QString> pending;
+  ///\brief The requests waiting for a worker, newest last.
+  QVector<Request> waiting;
+  ///\brief Guards waiting.
+  QMutex waitingMutex;
+  ///\brief The workers.
+  QThreadPool pool;
+private Q_SLOTS:
+  void store(QString key, QImage thumbnail);
+
+public:
+  ///\brief The most requests that may wait for a worker.
+  static const int maxWaiting = 256;
+  ThumbnailLoader(const QString &directory, const QSize &thumbnailSize,
+                  int cacheKiB = 65536, QObject *parent = nullptr);
+  virtual ~ThumbnailLoader();
+  static QString keyFor(const QString &fileName, const QDateTime &taken);
+  QImage thumbnail(const QString &fileName, const QDateTime &taken);
+  void waitForDone();
+Q_SIGNALS:
+  ///\brief Emitted once a thumbnail asked for by thumbnail() is ready.
+  void loaded(QString key);
+};
+
+#endif // THUMBNAILLOADER_H
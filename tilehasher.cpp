@@ -0,0 +1,118 @@
+#include "tilehasher.h"
+#include <tbb/parallel_for.h>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+///\brief The multiplier used to spread bits, from the 64 bit golden ratio.
+const std::uint64_t hashMultiplier = 0x9E3779B97F4A7C15ULL;
+
+/*!
+ * \brief Mixes one word into a running hash.
+ */
+inline std::uint64_t mix(std::uint64_t hash, std::uint64_t word)
+{
+  hash ^= word;
+  hash = (hash << 29) | (hash >> 35);
+  return hash * hashMultiplier;
+}
+
+/*!
+ * \brief Final avalanche so neighbouring tiles with similar content don't end
+ * up with similar hashes.
+ */
+inline std::uint64_t finish(std::uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  return hash ^ (hash >> 33);
+}
+}
+
+/*!
+ * \brief Gets how many tiles wide a frame is.
+ * \param width The frame's width in pixels.
+ * \return The number of tile columns, counting a partial one on the right.
+ */
+int TileHasher::tileColumns(int width)
+{
+  return (width + tileSize - 1) / tileSize;
+}
+
+/*!
+ * \brief Gets how many tiles tall a frame is.
+ * \param height The frame's height in pixels.
+ * \return The number of tile rows, counting a partial one at the bottom.
+ */
+int TileHasher::tileRows(int height)
+{
+  return (height + tileSize - 1) / tileSize;
+}
+
+/*!
+ * \brief Hashes every tile of a frame.
+ * \details Each band of tiles is handled by one TBB task, which walks the
+ * band's scanlines once from top to bottom and feeds each row segment into its
+ * tile's running hash.
+ * \param frame The frame to fingerprint.
+ * \return tileColumns() * tileRows() hashes, in row-major order.
+ */
+std::vector<std::uint64_t> TileHasher::hashTiles(const FrameView &frame)
+{
+  const int columns = tileColumns(frame.width);
+  const int rows = tileRows(frame.height);
+  std::vector<std::uint64_t> hashes(static_cast<size_t>(columns) * rows);
+  tbb::parallel_for(0, rows, [&](int tileRow)
+                    {
+    std::uint64_t *band =
+        hashes.data() + static_cast<size_t>(tileRow) * columns;
+    for(int column = 0; column < columns; ++column)
+      band[column] = static_cast<std::uint64_t>(tileRow) << 32 | column;
+    const int top = tileRow * tileSize;
+    const int bottom = std::min(top + tileSize, frame.height);
+    for(int y = top; y < bottom; ++y)
+    {
+      const std::uint32_t *row = frame.row(y);
+      for(int column = 0; column < columns; ++column)
+      {
+        const int left = column * tileSize;
+        const int right = std::min(left + tileSize, frame.width);
+        std::uint64_t hash = band[column];
+        int x = left;
+        for(; x + 2 <= right; x += 2)
+        {
+          std::uint64_t pair;
+          std::memcpy(&pair, row + x, sizeof(pair));
+          hash = mix(hash, pair);
+        }
+        if(x < right)
+          hash = mix(hash, row[x]);
+        band[column] = hash;
+      }
+    }
+    for(int column = 0; column < columns; ++column)
+      band[column] = finish(band[column]);
+  });
+  return hashes;
+}
+
+/*!
+ * \brief Counts the tiles whose hashes differ.
+ * \param oldHashes The fingerprint of the earlier frame.
+ * \param newHashes The fingerprint of the later frame.
+ * \return The number of differing tiles, or every tile if the fingerprints are
+ * for frames of different sizes.
+ */
+int TileHasher::countChanged(const std::vector<std::uint64_t> &oldHashes,
+                             const std::vector<std::uint64_t> &newHashes)
+{
+  if(oldHashes.size() != newHashes.size())
+    return static_cast<int>(newHashes.size());
+  int changed = 0;
+  for(size_t i = 0; i < newHashes.size(); ++i)
+    changed += oldHashes[i] != newHashes[i];
+  return changed;
+}
@@ -0,0 +1,28 @@
+#ifndef TILEHASHER_H
+#define TILEHASHER_H
+#include <vector>
+#include "diffengine.h"
+
+/*!
+ * \brief Fingerprints a frame as a grid of 64 bit tile hashes.
+ * \details The frame is cut into tileSize x tileSize tiles (the right and
+ * bottom edges may be smaller) and each tile is reduced to one hash. Two frames
+ * can then be compared by comparing their small hash arrays, so the previous
+ * frame itself never has to be kept around.
+ * Tiles are stored row-major, tileColumns() per row.
+ */
+class TileHasher
+{
+  TileHasher() = delete;
+
+public:
+  ///\brief The width and height of a tile, in pixels.
+  static const int tileSize = 64;
+  static int tileColumns(int width);
+  static int tileRows(int height);
+  static std::vector<std::uint64_t> hashTiles(const FrameView &frame);
+  static int countChanged(const std::vector<std::uint64_t> &oldHashes,
+                          const std::vector<std::uint64_t> &newHashes);
+};
+
+#endif // TILEHASHER_H
@@ -0,0 +1,332 @@
+#include "timelineindex.h"
+#include "contentstore.h"
+#include "snaparchive.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+
+namespace
+{
+/*!
+ * \brief Lays an entry out as a record.
+ * \details The time, screen, changed tile count and offset, then the hash
+ * padded to ContentStore::keySize bytes and the UTF-8 file name padded to
+ * TimelineIndex::nameSize bytes.
+ */
+QByteArray encodeEntry(const TimelineEntry &entry)
+{
+  QByteArray record;
+  QDataStream stream(&record, QIODevice::WriteOnly);
+  stream << qint64(entry.taken.toMSecsSinceEpoch()) << qint32(entry.screen)
+         << qint32(entry.changedTiles) << qint64(entry.offset);
+  QByteArray hash = entry.hash.left(ContentStore::keySize);
+  hash.append(QByteArray(ContentStore::keySize - hash.size(), '\0'));
+  QByteArray name = entry.fileName.toUtf8().left(TimelineIndex::nameSize);
+  name.append(QByteArray(TimelineIndex::nameSize - name.size(), '\0'));
+  return record + hash + name;
+}
+
+/*!
+ * \brief Reads a record made by encodeEntry.
+ */
+TimelineEntry decodeEntry(const QByteArray &record)
+{
+  TimelineEntry entry;
+  QDataStream stream(record);
+  qint64 msecs, offset;
+  qint32 screen, changedTiles;
+  stream >> msecs >> screen >> changedTiles >> offset;
+  entry.taken = QDateTime::fromMSecsSinceEpoch(msecs);
+  entry.screen = screen;
+  entry.changedTiles = changedTiles;
+  entry.offset = offset;
+  const QByteArray hash = record.mid(24, ContentStore::keySize);
+  if(hash.count('\0') != hash.size())
+    entry.hash = hash;
+  const QByteArray name =
+      record.mid(24 + ContentStore::keySize, TimelineIndex::nameSize);
+  entry.fileName = QString::fromUtf8(name.left(name.indexOf('\0')));
+  return entry;
+}
+
+/*!
+ * \brief Opens an index for reading and checks its header.
+ * \return If the file is an index this version can read.
+ */
+bool openIndex(QFile &file)
+{
+  if(!file.open(QIODevice::ReadOnly))
+    return false;
+  QDataStream stream(&file);
+  quint32 fileMagic, fileVersion;
+  stream >> fileMagic >> fileVersion;
+  return stream.status() == QDataStream::Ok &&
+         fileMagic == TimelineIndex::magic &&
+         fileVersion <= TimelineIndex::version;
+}
+
+/*!
+ * \brief Reads the time of a record, without the rest of it.
+ */
+qint64 readTime(QFile &file, qint64 index)
+{
+  file.seek(TimelineIndex::headerSize + index * TimelineIndex::recordSize);
+  QDataStream stream(&file);
+  qint64 msecs;
+  stream >> msecs;
+  return msecs;
+}
+
+/*!
+ * \brief Gets the screen number from the part of a name after the time, as
+ * in -1 or -1_2.
+ */
+int screenFromSuffix(const QString &suffix)
+{
+  if(!suffix.startsWith('-'))
+    return 0;
+  return suffix.mid(1).section('_', 0, 0).toInt();
+}
+}
+
+const quint32 TimelineIndex::magic;
+const quint32 TimelineIndex::version;
+const int TimelineIndex::headerSize;
+const int TimelineIndex::recordSize;
+const int TimelineIndex::nameSize;
+
+/*!
+ * \brief Creates an entry with nothing known about it.
+ */
+TimelineEntry::TimelineEntry() : screen(0), changedTiles(-1), offset(0) {}
+
+/*!
+ * \brief Opens the index of a folder.
+ * \param directory The save folder, the index lives in it.
+ */
+TimelineIndex::TimelineIndex(const QString &directory)
+    : directory(directory)
+{
+}
+
+/*!
+ * \brief Gets where the index is kept.
+ * \return The path of timeline.qti.
+ */
+QString TimelineIndex::path() const { return directory + "/timeline.qti"; }
+
+/*!
+ * \brief Adds a picture to the end of the index.
+ * \details The picture should not be older than the last one added, or
+ * lookups around it may miss it until the index is rebuilt.
+ * \param entry The picture.
+ * \return If the record was written.
+ */
+bool TimelineIndex::append(const TimelineEntry &entry) const
+{
+  QFile file(path());
+  if(!file.open(QIODevice::Append))
+    return false;
+  QByteArray data;
+  if(file.size() == 0)
+  {
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << magic << version;
+  }
+  data += encodeEntry(entry);
+  return file.write(data) == data.size();
+}
+
+/*!
+ * \brief Gets how many pictures are in the index.
+ * \details A record cut short at the end, from a crash while writing, is not
+ * counted.
+ * \return The number of records, 0 if there is no readable index.
+ */
+qint64 TimelineIndex::count() const
+{
+  QFile file(path());
+  if(!openIndex(file))
+    return 0;
+  return (file.size() - headerSize) / recordSize;
+}
+
+/*!
+ * \brief Reads one picture's record.
+ * \param index Which record, from 0 to count() - 1.
+ * \return The record, or an empty entry if there is no such record.
+ */
+TimelineEntry TimelineIndex::at(qint64 index) const
+{
+  QFile file(path());
+  if(!openIndex(file) || index < 0 ||
+     headerSize + (index + 1) * recordSize > file.size())
+    return TimelineEntry();
+  file.seek(headerSize + index * recordSize);
+  return decodeEntry(file.read(recordSize));
+}
+
+/*!
+ * \brief Finds the first picture taken at or after a time.
+ * \param when The time.
+ * \return The record's number, or count() if every picture is older.
+ */
+qint64 TimelineIndex::lowerBound(const QDateTime &when) const
+{
+  QFile file(path());
+  if(!openIndex(file))
+    return 0;
+  const qint64 target = when.toMSecsSinceEpoch();
+  qint64 low = 0;
+  qint64 high = (file.size() - headerSize) / recordSize;
+  while(low < high)
+  {
+    const qint64 middle = low + (high - low) / 2;
+    if(readTime(file, middle) < target)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  return low;
+}
+
+/*!
+ * \brief Gets the pictures taken between two times.
+ * \param from The first time, included.
+ * \param to The last time, included.
+ * \return The pictures, oldest first.
+ */
+QList<TimelineEntry> TimelineIndex::range(const QDateTime &from,
+                                          const QDateTime &to) const
+{
+  QList<TimelineEntry> entries;
+  QFile file(path());
+  if(!openIndex(file))
+    return entries;
+  const qint64 records = (file.size() - headerSize) / recordSize;
+  const qint64 first = lowerBound(from);
+  file.seek(headerSize + first * recordSize);
+  const qint64 last = to.toMSecsSinceEpoch();
+  for(qint64 index = first; index < records; ++index)
+  {
+    const TimelineEntry entry = decodeEntry(file.read(recordSize));
+    if(entry.taken.toMSecsSinceEpoch() > last)
+      break;
+    entries.append(entry);
+  }
+  return entries;
+}
+
+/*!
+ * \brief Drops the records of pictures that were deleted.
+ * \details The records kept are written to a temporary name and renamed
+ * over the index, in the same order. A record appended meanwhile would be
+ * lost with the old index, so the caller holds the folder's SaveFolderLock,
+ * as the write thread does while appending.
+ * \param gone Tells if a record's picture was deleted.
+ * \param forgotten If not null, the dropped records are added to it.
+ * \return If the index was rewritten, or there is none.
+ */
+bool TimelineIndex::forget(
+    const std::function<bool(const TimelineEntry &)> &gone,
+    QList<TimelineEntry> *forgotten) const
+{
+  QFile index(path());
+  if(!index.exists())
+    return true;
+  if(!openIndex(index))
+    return false;
+  const QByteArray records = index.readAll();
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream << magic << version;
+  int offset = 0;
+  for(; offset + recordSize <= records.size(); offset += recordSize)
+  {
+    const QByteArray record = records.mid(offset, recordSize);
+    const TimelineEntry entry = decodeEntry(record);
+    if(!gone(entry))
+      data += record;
+    else if(forgotten)
+      forgotten->append(entry);
+  }
+  // A record cut short by a crash is dropped, so later ones line up again.
+  QFile file(path() + ".part");
+  if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+    return false;
+  index.close();
+  file.close();
+  QFile::remove(path());
+  return file.rename(path());
+}
+
+/*!
+ * \brief Makes the index again from what is in the folder.
+ * \details Pictures named yyyyMMddhhmmss[-screen][_n].jpg, every record of
+ * the yyyyMMdd[-screen].qsa archives and every line of the content store's
+ * index are listed, sorted by time, and written to a new index that replaces
+ * the old one. Changed tile counts are not known for any of them.
+ * \return If the new index was written.
+ */
+bool TimelineIndex::rebuild() const
+{
+  QList<TimelineEntry> entries;
+  const QDir dir(directory);
+  for(const QFileInfo &info :
+      dir.entryInfoList(QStringList() << "*.jpg", QDir::Files))
+  {
+    const QString base = info.completeBaseName();
+    TimelineEntry entry;
+    entry.taken = QDateTime::fromString(base.left(14), "yyyyMMddhhmmss");
+    if(!entry.taken.isValid())
+      continue;
+    entry.screen = screenFromSuffix(base.mid(14));
+    entry.fileName = info.fileName();
+    entries.append(entry);
+  }
+  for(const QFileInfo &info :
+      dir.entryInfoList(QStringList() << "*.qsa", QDir::Files))
+  {
+    SnapArchiveReader reader(info.filePath());
+    if(!reader.isValid())
+      continue;
+    const QList<QDateTime> times = reader.timestamps();
+    const QList<qint64> offsets = reader.recordOffsets();
+    for(int i = 0; i < times.size(); ++i)
+    {
+      TimelineEntry entry;
+      entry.taken = times[i];
+      entry.screen = screenFromSuffix(info.completeBaseName().mid(8));
+      entry.offset = offsets[i];
+      entry.fileName = info.fileName();
+      entries.append(entry);
+    }
+  }
+  const ContentStore store(directory);
+  for(const ContentStoreEntry &stored : store.entries())
+  {
+    TimelineEntry entry;
+    entry.taken = stored.taken;
+    entry.screen = stored.screen;
+    entry.hash = stored.key;
+    entry.fileName = dir.relativeFilePath(store.objectPath(stored.key));
+    entries.append(entry);
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const TimelineEntry &a, const TimelineEntry &b)
+                   { return a.taken < b.taken; });
+
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream << magic << version;
+  for(const TimelineEntry &entry : entries)
+    data += encodeEntry(entry);
+  QFile file(path() + ".part");
+  if(!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+    return false;
+  file.close();
+  QFile::remove(path());
+  return file.rename(path());
+}
@@ -0,0 +1,68 @@
+#ifndef TIMELINEINDEX_H
+#define TIMELINEINDEX_H
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <functional>
+
+///\brief One screenshot in a TimelineIndex.
+struct TimelineEntry
+{
+  TimelineEntry();
+  ///\brief When the picture was taken.
+  QDateTime taken;
+  ///\brief Which screen the picture is of.
+  int screen;
+  ///\brief How many tiles changed since the last picture, or -1 if unknown.
+  int changedTiles;
+  ///\brief Where the picture's record starts, for pictures in an archive.
+  qint64 offset;
+  ///\brief The picture's ContentStore key, empty if it has none.
+  QByteArray hash;
+  ///\brief The picture's file, relative to the index's folder.
+  QString fileName;
+};
+
+/*!
+ * \brief A sorted list of every screenshot in a save folder, in one file.
+ * \details timeline.qti starts with a magic number and version, followed by
+ * fixed size records in the order the pictures were taken. Since every
+ * record is the same size, the records around a time are found by a binary
+ * search that reads only O(log n) of them, instead of listing the folder.
+ * Records are only ever appended, by one thread. Pictures deleted from the
+ * folder are dropped with forget(), which must not overlap an append; both
+ * are done holding the folder's SaveFolderLock. If the index is lost or
+ * falls out of step with the folder, rebuild() makes it again from the
+ * pictures, archives and content store in the folder.
+ */
+class TimelineIndex
+{
+  ///\brief The folder the index describes.
+  QString directory;
+
+public:
+  ///\brief Identifies a file as a timeline index.
+  static const quint32 magic = 0x51535449;
+  ///\brief The format version written into new indexes.
+  static const quint32 version = 1;
+  ///\brief The size of the magic number and version.
+  static const int headerSize = 8;
+  ///\brief The size of a record.
+  static const int recordSize = 128;
+  ///\brief The most bytes of a file name a record can hold.
+  static const int nameSize = 84;
+  explicit TimelineIndex(const QString &directory);
+  QString path() const;
+  bool append(const TimelineEntry &entry) const;
+  qint64 count() const;
+  TimelineEntry at(qint64 index) const;
+  qint64 lowerBound(const QDateTime &when) const;
+  QList<TimelineEntry> range(const QDateTime &from,
+                             const QDateTime &to) const;
+  bool forget(const std::function<bool(const TimelineEntry &)> &gone,
+              QList<TimelineEntry> *forgotten = nullptr) const;
+  bool rebuild() const;
+};
+
+#endif // TIMELINEINDEX_H
@@ -0,0 +1,243 @@
+#include "xshmcapture.h"
+#include <QGuiApplication>
+#include <QScreen>
+#include <atomic>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+
+///\brief A shared memory picture of one screen.
+struct XShmCaptureBackend::Segment
+{
+  ///\brief The X side of the picture, its data is the shared memory.
+  XImage *image;
+  ///\brief The shared memory the server writes into.
+  XShmSegmentInfo info;
+  ///\brief True while a QImage points at this segment.
+  std::atomic<bool> busy;
+};
+
+namespace
+{
+///\brief Set by trapAttachError when the server refuses a segment.
+bool attachFailed = false;
+
+/*!
+ * \brief Records a failed XShmAttach instead of Xlib's default of exiting.
+ * \details This happens when the server is remote and can't see our memory.
+ */
+int trapAttachError(Display *, XErrorEvent *)
+{
+  attachFailed = true;
+  return 0;
+}
+}
+
+/*!
+ * \brief Connects to the X server and checks that it will share memory with
+ * us, by attaching a one pixel segment.
+ */
+XShmCaptureBackend::XShmCaptureBackend()
+    : display(XOpenDisplay(nullptr)), available(false)
+{
+  if(!display)
+    return;
+  if(XShmQueryExtension(display))
+  {
+    Segment *probe = createSegment(1, 1);
+    if(probe)
+    {
+      available = true;
+      destroySegment(probe);
+    }
+  }
+}
+
+/*!
+ * \brief Frees every segment and closes the connection.
+ * \details A segment that is somehow still pointed at by a QImage is leaked
+ * rather than freed from under it.
+ */
+XShmCaptureBackend::~XShmCaptureBackend()
+{
+  for(std::vector<Segment *> &screen : segments)
+  {
+    for(Segment *segment : screen)
+    {
+      if(!segment->busy)
+        destroySegment(segment);
+    }
+  }
+  if(display)
+    XCloseDisplay(display);
+}
+
+/*!
+ * \brief Checks if pictures can be taken through shared memory.
+ * \return If the server is reachable and shares memory with us.
+ */
+bool XShmCaptureBackend::isAvailable() const { return available; }
+
+/*!
+ * \brief Makes a shared memory segment and attaches it to the server.
+ * \param width The width of the pictures it will hold.
+ * \param height The height of the pictures it will hold.
+ * \return The segment, or nullptr if the server can't give us 32 bit pixels or
+ * refuses to attach it.
+ */
+XShmCaptureBackend::Segment *XShmCaptureBackend::createSegment(int width,
+                                                               int height)
+{
+  const int screen = DefaultScreen(display);
+  Segment *segment = new Segment;
+  segment->busy = false;
+  segment->image = XShmCreateImage(display, DefaultVisual(display, screen),
+                                   DefaultDepth(display, screen), ZPixmap,
+                                   nullptr, &segment->info, width, height);
+  if(!segment->image || segment->image->bits_per_pixel != 32)
+  {
+    if(segment->image)
+      XDestroyImage(segment->image);
+    delete segment;
+    return nullptr;
+  }
+  segment->info.shmid =
+      shmget(IPC_PRIVATE, segment->image->bytes_per_line * height,
+             IPC_CREAT | 0600);
+  segment->info.shmaddr = segment->image->data =
+      segment->info.shmid < 0
+          ? reinterpret_cast<char *>(-1)
+          : static_cast<char *>(shmat(segment->info.shmid, nullptr, 0));
+  segment->info.readOnly = False;
+  if(segment->info.shmaddr == reinterpret_cast<char *>(-1))
+  {
+    if(segment->info.shmid >= 0)
+      shmctl(segment->info.shmid, IPC_RMID, nullptr);
+    segment->image->data = nullptr;
+    XDestroyImage(segment->image);
+    delete segment;
+    return nullptr;
+  }
+
+  attachFailed = false;
+  XErrorHandler oldHandler = XSetErrorHandler(trapAttachError);
+  XShmAttach(display, &segment->info);
+  XSync(display, False);
+  XSetErrorHandler(oldHandler);
+  // The memory is freed once both we and the server have detached.
+  shmctl(segment->info.shmid, IPC_RMID, nullptr);
+  if(attachFailed)
+  {
+    shmdt(segment->info.shmaddr);
+    segment->image->data = nullptr;
+    XDestroyImage(segment->image);
+    delete segment;
+    return nullptr;
+  }
+  return segment;
+}
+
+/*!
+ * \brief Detaches and frees a segment.
+ * \param segment A segment no QImage points at.
+ */
+void XShmCaptureBackend::destroySegment(Segment *segment)
+{
+  XShmDetach(display, &segment->info);
+  XSync(display, False);
+  shmdt(segment->info.shmaddr);
+  segment->image->data = nullptr;
+  XDestroyImage(segment->image);
+  delete segment;
+}
+
+/*!
+ * \brief Finds a segment of the right size that no QImage points at.
+ * \details Free segments of the wrong size, left over from a resolution
+ * change, are freed. A new segment is made if the screen has room for one.
+ * \param screen The screen's number.
+ * \param width The screen's width in pixels.
+ * \param height The screen's height in pixels.
+ * \return A free segment, or nullptr if every segment is busy.
+ */
+XShmCaptureBackend::Segment *XShmCaptureBackend::freeSegment(int screen,
+                                                             int width,
+                                                             int height)
+{
+  std::vector<Segment *> &owned = segments[screen];
+  for(size_t i = 0; i < owned.size();)
+  {
+    Segment *segment = owned[i];
+    if(segment->busy)
+    {
+      ++i;
+      continue;
+    }
+    if(segment->image->width == width && segment->image->height == height)
+      return segment;
+    destroySegment(segment);
+    owned.erase(owned.begin() + i);
+  }
+  if(owned.size() >= segmentsPerScreen)
+    return nullptr;
+  Segment *segment = createSegment(width, height);
+  if(segment)
+    owned.push_back(segment);
+  return segment;
+}
+
+/*!
+ * \brief Called by Qt when the last QImage pointing at a segment goes away.
+ * \details May be called from any thread.
+ * \param segment The segment to mark free.
+ */
+void XShmCaptureBackend::release(void *segment)
+{
+  static_cast<Segment *>(segment)->busy = false;
+}
+
+/*!
+ * \brief Has the server copy each screen into a free segment.
+ * \return A picture per screen, in the order Qt lists the screens. Each
+ * points at its segment until it is destroyed.
+ */
+QList<QImage> XShmCaptureBackend::grabScreens()
+{
+  QList<QImage> pictures;
+  const QList<QScreen *> screens = QGuiApplication::screens();
+  if(segments.size() < static_cast<size_t>(screens.size()))
+    segments.resize(screens.size());
+  const Window root = DefaultRootWindow(display);
+  for(int i = 0; i < screens.size(); ++i)
+  {
+    const QRect geometry = screens[i]->geometry();
+    const qreal ratio = screens[i]->devicePixelRatio();
+    const int width = qRound(geometry.width() * ratio);
+    const int height = qRound(geometry.height() * ratio);
+    Segment *segment = freeSegment(i, width, height);
+    if(!segment ||
+       !XShmGetImage(display, root, segment->image,
+                     qRound(geometry.x() * ratio),
+                     qRound(geometry.y() * ratio), AllPlanes))
+    {
+      pictures.append(screens[i]->grabWindow(0).toImage());
+      continue;
+    }
+    // The server leaves the pad byte at 0, Qt's captures have it at 0xff.
+    setOpaque(reinterpret_cast<uchar *>(segment->image->data), width, height,
+              segment->image->bytes_per_line);
+    segment->busy = true;
+    pictures.append(QImage(reinterpret_cast<uchar *>(segment->image->data),
+                           width, height, segment->image->bytes_per_line,
+                           QImage::Format_RGB32, release, segment));
+  }
+  return pictures;
+}
+
+/*!
+ * \brief Gets the backend's name.
+ * \return "XShm"
+ */
+QString XShmCaptureBackend::name() const { return "XShm"; }
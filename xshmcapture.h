@@ -0,0 +1,44 @@
+#ifndef XSHMCAPTURE_H
+#define XSHMCAPTURE_H
+#include "capturebackend.h"
+#include <vector>
+struct _XDisplay;
+
+/*!
+ * \brief Takes pictures on X11 through the MIT-SHM extension.
+ * \details The X server copies each screen straight into a shared memory
+ * segment, and the returned QImage points at that segment rather than a copy
+ * of it, so the diff engine reads the server's pixels in place. The only
+ * pass over them here sets each pixel's pad byte, see
+ * CaptureBackend::setOpaque().
+ * Segments are reused between pictures. A segment stays busy for as long as
+ * any QImage still points at it (the last picture kept for comparison, or one
+ * still in the pipeline), so each screen gets a few of them. If every segment
+ * is busy, or the server will not attach one, that screen is pictured through
+ * Qt instead.
+ */
+class XShmCaptureBackend : public CaptureBackend
+{
+  struct Segment;
+  ///\brief Our own connection to the X server.
+  _XDisplay *display;
+  ///\brief If the server accepted a test segment.
+  bool available;
+  ///\brief The segments made for each screen, by screen number.
+  std::vector<std::vector<Segment *>> segments;
+  ///\brief The most segments made for a single screen.
+  static const size_t segmentsPerScreen = 3;
+  Segment *createSegment(int width, int height);
+  void destroySegment(Segment *segment);
+  Segment *freeSegment(int screen, int width, int height);
+  static void release(void *segment);
+
+public:
+  XShmCaptureBackend();
+  virtual ~XShmCaptureBackend();
+  bool isAvailable() const;
+  virtual QList<QImage> grabScreens() override;
+  virtual QString name() const override;
+};
+
+#endif // XSHMCAPTURE_H
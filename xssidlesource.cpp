@@ -0,0 +1,53 @@
+#include "xssidlesource.h"
+#include <X11/Xlib.h>
+#include <X11/extensions/scrnsaver.h>
+
+/*!
+ * \brief Connects to the X server and checks it has the extension.
+ */
+XssIdleSource::XssIdleSource()
+    : display(XOpenDisplay(nullptr)), available(false)
+{
+  int eventBase, errorBase;
+  available =
+      display && XScreenSaverQueryExtension(display, &eventBase, &errorBase);
+}
+
+/*!
+ * \brief Closes the connection.
+ */
+XssIdleSource::~XssIdleSource()
+{
+  if(display)
+    XCloseDisplay(display);
+}
+
+/*!
+ * \brief Checks if the idle counter can be read.
+ * \return True if the server has the XScreenSaver extension.
+ */
+bool XssIdleSource::isAvailable() const { return available; }
+
+/*!
+ * \brief Gets how long it has been since the last keyboard or mouse input.
+ * \return The time in milliseconds, or -1 if it can't be told.
+ */
+qint64 XssIdleSource::idleMsecs()
+{
+  if(!available)
+    return -1;
+  XScreenSaverInfo *info = XScreenSaverAllocInfo();
+  if(!info)
+    return -1;
+  qint64 idle = -1;
+  if(XScreenSaverQueryInfo(display, DefaultRootWindow(display), info))
+    idle = info->idle;
+  XFree(info);
+  return idle;
+}
+
+/*!
+ * \brief Gets the source's name.
+ * \return "XScreenSaver"
+ */
+QString XssIdleSource::name() const { return "XScreenSaver"; }
@@ -0,0 +1,28 @@
+#ifndef XSSIDLESOURCE_H
+#define XSSIDLESOURCE_H
+#include "idlesource.h"
+struct _XDisplay;
+
+/*!
+ * \brief Reads the X server's idle counter through the XScreenSaver
+ * extension.
+ * \details The counter is reset by any keyboard or mouse input, whether or
+ * not a screensaver is running, so it also catches a locked or walked away
+ * desktop. Asking costs one round trip to the server.
+ */
+class XssIdleSource : public IdleSource
+{
+  ///\brief Our own connection to the X server.
+  _XDisplay *display;
+  ///\brief If the server has the extension.
+  bool available;
+
+public:
+  XssIdleSource();
+  virtual ~XssIdleSource();
+  bool isAvailable() const;
+  virtual qint64 idleMsecs() override;
+  virtual QString name() const override;
+};
+
+#endif // XSSIDLESOURCE_H